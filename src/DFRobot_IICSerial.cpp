@@ -101,10 +101,17 @@ int DFRobot_IICSerial::available(void) {
   }
   index = (int)val;
   if (index == 0) {
+    // RFCNT wrap to 0 when FIFO is full, which is also the only time it can overflow
     fsr = readFIFOStateReg();
     if (fsr.rDat == 1) {
       index = 256;
     }
+    // Flag stay set across polls, count when it rise only
+    if (fsr.rFoe == 1 && !_rxOverflowFlag) {
+      _rxOverflowCount++;
+      DBG("RX FIFO overflow!");
+    }
+    _rxOverflowFlag = (fsr.rFoe == 1);
   }
   return (index + ((unsigned int)(SERIAL_RX_BUFFER_SIZE + _rx_buffer_head - _rx_buffer_tail)) %
                       SERIAL_RX_BUFFER_SIZE);
@@ -171,15 +178,7 @@ size_t DFRobot_IICSerial::write(const uint8_t *pBuf, size_t size) {
     return 0;
   }
   uint8_t *_pBuf = (uint8_t *)pBuf;
-  sFsrReg_t fsr;
-  uint8_t val = 0;
-  fsr = readFIFOStateReg();
-  if (fsr.tFull == 1) {
-    DBG("FIFO full!");
-    return 0;
-  }
-  writeFIFO(_pBuf, size);
-  return size;
+  return writeFIFO(_pBuf, size);
 }
 
 size_t DFRobot_IICSerial::read(void *pBuf, size_t size) {
@@ -195,9 +194,14 @@ size_t DFRobot_IICSerial::read(void *pBuf, size_t size) {
   return size;
 }
 void DFRobot_IICSerial::flush(void) {
+  // Give up after the time needed to transmit a full FIFO twice
+  unsigned long timeoutMs = ((SUBUART_FIFO_SIZE * 10 * 1000UL) / _baud) * 2 + 10;
+  unsigned long start = millis();
   sFsrReg_t fsr = readFIFOStateReg();
-  while (fsr.tDat == 1)
-    ;
+  while (fsr.tDat == 1 && millis() - start < timeoutMs) {
+    waitTxDrain(IIC_BUFFER_SIZE);
+    fsr = readFIFOStateReg();
+  }
 }
 
 void DFRobot_IICSerial::subSerialConfig(uint8_t subUartChannel) {
@@ -316,6 +320,7 @@ uint8_t DFRobot_IICSerial::getGlobalRegType(eGlobalRegType_t type) {
 }
 
 void DFRobot_IICSerial::setSubSerialBaudRate(unsigned long baud) {
+  _baud = baud;
   uint8_t scr = 0x00, clear = 0x00;
   readReg(REG_WK2132_SCR, &scr, 1);
   subSerialRegConfig(REG_WK2132_SCR, &clear);
@@ -632,24 +637,64 @@ uint8_t DFRobot_IICSerial::readFIFO(void *pBuf, size_t size) {
   }
   return (uint8_t)size;
 }
-void DFRobot_IICSerial::writeFIFO(void *pBuf, size_t size) {
+size_t DFRobot_IICSerial::writeFIFO(void *pBuf, size_t size) {
   if (pBuf == NULL) {
     DBG("pBuf ERROR!! : null pointer");
-    return;
+    return 0;
   }
-  _addr = updateAddr(_addr, _subSerialChannel, OBJECT_FIFO);
   uint8_t *_pBuf = (uint8_t *)pBuf;
-  size_t left = size;
+  size_t left = size, num = 0, space = 0;
+  // Stop when FIFO not drained after the time needed to transmit a full FIFO a few times
+  int stalled = 0;
   while (left) {
-    size = (left > IIC_BUFFER_SIZE) ? IIC_BUFFER_SIZE : left;
+    if (space == 0) {
+      space = txFIFOFreeSpace();
+      if (space == 0) {
+        if (++stalled > 4) {
+          DBG("FIFO full!");
+          break;
+        }
+        waitTxDrain(SUBUART_FIFO_SIZE / 2);
+        continue;
+      }
+      stalled = 0;
+    }
+    num = (left > IIC_BUFFER_SIZE) ? IIC_BUFFER_SIZE : left;
+    if (num > space) {
+      num = space;
+    }
+    _addr = updateAddr(_addr, _subSerialChannel, OBJECT_FIFO);
     _pWire->beginTransmission(_addr);
-    _pWire->write(_pBuf, size);
+    _pWire->write(_pBuf, num);
     if (_pWire->endTransmission() != 0) {
-      return;
+      break;
     }
-    delay(10);
-    left -= size;
-    _pBuf = _pBuf + size;
+    left -= num;
+    space -= num;
+    _pBuf = _pBuf + num;
+  }
+  return size - left;
+}
+
+size_t DFRobot_IICSerial::txFIFOFreeSpace() {
+  sFsrReg_t fsr = readFIFOStateReg();
+  if (fsr.tFull == 1) {
+    return 0;
+  }
+  uint8_t count = 0;
+  if (readReg(REG_WK2132_TFCNT, &count, 1) != 1) {
+    return 0;
+  }
+  return SUBUART_FIFO_SIZE - count;
+}
+
+void DFRobot_IICSerial::waitTxDrain(size_t bytes) {
+  // 10 bits each byte on the line (start, 8 data, stop)
+  unsigned long us = (bytes * 10 * 1000000UL) / _baud;
+  if (us >= 1000) {
+    delay(us / 1000);
+  } else {
+    delayMicroseconds(us);
   }
 }
 #endif
@@ -80,6 +80,7 @@ public:
   #define FOSC                 14745600L//< External cystal frequency 14.7456MHz
   #define OBJECT_REGISTER      0x00     //< Register object
   #define OBJECT_FIFO          0x01     //< FIFO buffer object
+  #define SUBUART_FIFO_SIZE    256      //< Sub UART transmit/receive FIFO hardware size in bytes
 #ifdef ARDUINO_ARCH_NRF5
   #define IIC_BUFFER_SIZE      63       //< micro:bit IIC can transmit at most 63 bytes each time
 #elif ARDUINO_ARCH_MPYTHON
@@ -336,6 +337,19 @@ public:
   using Print::write; /*!< pull in write(str) and write(buf, size) from Print */
   operator bool() { return true; }
 
+  /**
+   * @fn setBaudRate
+   * @brief Change sub UART band rate after begin() without reset the sub UART
+   * @param baud Band rate, see begin() for supported band rate
+   */
+  void setBaudRate(unsigned long baud) { setSubSerialBaudRate(baud); }
+  /**
+   * @fn getRxOverflowCount
+   * @brief Number of receive FIFO overflow detected when checking available(), counted once each
+   * time FSR RFOE flag get set
+   * @return Return overflow count since constructed
+   */
+  uint32_t getRxOverflowCount() { return _rxOverflowCount; }
   bool isChannelInSleep(uint8_t subUartChannel);
   void printAllRegsForCurrentCh();
   void prepareSleep();
@@ -459,11 +473,27 @@ protected:
 
   /**
    * @fn writeFIFO
-   * @brief Write FIFO buffer
+   * @brief Write FIFO buffer, only as much as the transmit FIFO free space each time
+   * @n and wait for the FIFO to drain at the configured band rate when it is full
    * @param pBuf Store buffer for the data to be written
    * @param size Length of the data to be written
+   * @return Return the number of bytes written
+   */
+  size_t writeFIFO(void *pBuf, size_t size);
+
+  /**
+   * @fn txFIFOFreeSpace
+   * @brief Get free space of transmit FIFO from TFCNT and FSR register
+   * @return Return free space in bytes, 0 if full or failed to read
+   */
+  size_t txFIFOFreeSpace();
+
+  /**
+   * @fn waitTxDrain
+   * @brief Wait for the time needed to transmit a number of bytes at the configured band rate
+   * @param bytes Number of bytes expected to be transmitted
    */
-  void writeFIFO(void *pBuf, size_t size);
+  void waitTxDrain(size_t bytes);
 
   /**
    * @fn readReg
@@ -494,6 +524,9 @@ private:
   TwoWire *_pWire;
   uint8_t _addr;
   uint8_t _subSerialChannel;
+  unsigned long _baud = 115200;
+  uint32_t _rxOverflowCount = 0;
+  bool _rxOverflowFlag = false; // FSR RFOE at last check
 };
 #endif
 #endif
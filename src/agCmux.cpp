@@ -0,0 +1,339 @@
+/**
+ * AirGradient
+ * https://airgradient.com
+ *
+ * CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
+ */
+
+#ifndef ESP8266
+
+#include "agCmux.h"
+
+#include <cstring>
+
+#include "common.h"
+#include "agLogger.h"
+
+#define CMUX_FLAG 0xF9
+#define CMUX_EA 0x01
+#define CMUX_CR 0x02
+#define CMUX_PF 0x10
+
+// Frame types, P/F bit excluded
+#define CMUX_SABM 0x2F
+#define CMUX_UA 0x63
+#define CMUX_DM 0x0F
+#define CMUX_DISC 0x43
+#define CMUX_UIH 0xEF
+
+// Control channel message types, C/R bit excluded
+#define CMUX_MSG_CLD 0xC1 // multiplexer close down
+
+// FCS over header bytes followed by received FCS, see GSM 07.10 annex B
+#define CMUX_FCS_GOOD 0xCF
+
+static uint8_t fcsUpdate(uint8_t fcs, uint8_t b) {
+  fcs ^= b;
+  for (int i = 0; i < 8; i++) {
+    fcs = (fcs & 0x01) ? (fcs >> 1) ^ 0xE0 : (fcs >> 1);
+  }
+  return fcs;
+}
+
+int AgCmuxChannel::available() {
+  std::lock_guard<std::recursive_mutex> lock(_mux->_mutex);
+  // Serial line belong to single AT channel again once closed
+  if (!_mux->_opened) {
+    return 0;
+  }
+  _mux->_poll();
+  return _count;
+}
+
+int AgCmuxChannel::read() {
+  std::lock_guard<std::recursive_mutex> lock(_mux->_mutex);
+  if (_count == 0) {
+    if (!_mux->_opened) {
+      return -1;
+    }
+    _mux->_poll();
+    if (_count == 0) {
+      return -1;
+    }
+  }
+
+  uint8_t b = _rx[_head];
+  _head = (_head + 1) % CONFIG_CELLULAR_CMUX_BUFFER_SIZE;
+  _count--;
+  return b;
+}
+
+void AgCmuxChannel::print(const char *str) {
+  write(reinterpret_cast<const uint8_t *>(str), strlen(str));
+}
+
+void AgCmuxChannel::write(const uint8_t *data, int length) {
+  std::lock_guard<std::recursive_mutex> lock(_mux->_mutex);
+  if (!_mux->_opened) {
+    return;
+  }
+  while (length > 0) {
+    int chunk = length > CMUX_FRAME_INFO_MAX ? CMUX_FRAME_INFO_MAX : length;
+    _mux->_sendFrame(_dlci, CMUX_UIH, true, data, chunk);
+    data += chunk;
+    length -= chunk;
+  }
+}
+
+uint32_t AgCmuxChannel::getOverflowCount() {
+  std::lock_guard<std::recursive_mutex> lock(_mux->_mutex);
+  return _overflow;
+}
+
+AgCmux::AgCmux(AirgradientSerial *serial) : serial_(serial) {
+  for (int dlci = 0; dlci <= CMUX_CHANNEL_MAX; dlci++) {
+    _channels[dlci]._mux = this;
+    _channels[dlci]._dlci = dlci;
+  }
+}
+
+bool AgCmux::open(int channelCount, uint32_t timeoutMs) {
+  if (channelCount < 1 || channelCount > CMUX_CHANNEL_MAX) {
+    AG_LOGE(TAG, "Channel count must be between 1 and %d", CMUX_CHANNEL_MAX);
+    return false;
+  }
+
+  // Control channel first, then each virtual channel
+  for (int dlci = 0; dlci <= channelCount; dlci++) {
+    {
+      std::lock_guard<std::recursive_mutex> lock(_mutex);
+      _ack[dlci] = 0;
+      _channels[dlci]._count = 0;
+      _sendFrame(dlci, CMUX_SABM | CMUX_PF, true, nullptr, 0);
+    }
+    if (!_waitAck(dlci, timeoutMs)) {
+      AG_LOGE(TAG, "Channel %d not accepted", dlci);
+      return false;
+    }
+  }
+
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  _channelCount = channelCount;
+  _opened = true;
+  AG_LOGI(TAG, "Multiplexer opened with %d channels", channelCount);
+
+  return true;
+}
+
+void AgCmux::close(bool closeDown) {
+  if (closeDown) {
+    for (int dlci = _channelCount; dlci >= 1; dlci--) {
+      {
+        std::lock_guard<std::recursive_mutex> lock(_mutex);
+        _ack[dlci] = 0;
+        _sendFrame(dlci, CMUX_DISC | CMUX_PF, true, nullptr, 0);
+      }
+      _waitAck(dlci, 1000);
+    }
+
+    // Close down on control channel, module then leave multiplexer mode
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    uint8_t message[] = {CMUX_MSG_CLD | CMUX_CR, CMUX_EA};
+    _sendFrame(0, CMUX_UIH, true, message, sizeof(message));
+  }
+
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  _opened = false;
+  _channelCount = 0;
+  _state = WaitFlag;
+  AG_LOGI(TAG, "Multiplexer closed");
+}
+
+AgCmuxChannel *AgCmux::channel(int dlci) {
+  if (!_opened || dlci < 1 || dlci > _channelCount) {
+    return nullptr;
+  }
+  return &_channels[dlci];
+}
+
+void AgCmux::_poll() {
+  while (serial_->available()) {
+    _parse(serial_->read());
+  }
+}
+
+void AgCmux::_parse(uint8_t b) {
+  switch (_state) {
+  case WaitFlag:
+    if (b == CMUX_FLAG) {
+      _state = Address;
+    }
+    break;
+  case Address:
+    // Closing flag of previous frame is followed by opening flag of the next
+    if (b == CMUX_FLAG) {
+      break;
+    }
+    _address = b;
+    _header[0] = b;
+    _headerLength = 1;
+    _state = Control;
+    break;
+  case Control:
+    _control = b;
+    _header[_headerLength++] = b;
+    _state = Length;
+    break;
+  case Length:
+    _header[_headerLength++] = b;
+    _infoLength = b >> 1;
+    _infoReceived = 0;
+    if (b & CMUX_EA) {
+      _state = _infoLength > 0 ? Info : Fcs;
+    } else {
+      _state = LengthExtended;
+    }
+    break;
+  case LengthExtended:
+    _header[_headerLength++] = b;
+    _infoLength |= static_cast<size_t>(b) << 7;
+    _state = _infoLength > 0 ? Info : Fcs;
+    break;
+  case Info:
+    // Longer than expected is still consumed to stay in sync, then dropped
+    if (_infoReceived < sizeof(_info)) {
+      _info[_infoReceived] = b;
+    }
+    if (++_infoReceived >= _infoLength) {
+      _state = Fcs;
+    }
+    break;
+  case Fcs: {
+    uint8_t fcs = 0xFF;
+    for (size_t i = 0; i < _headerLength; i++) {
+      fcs = fcsUpdate(fcs, _header[i]);
+    }
+    if (fcsUpdate(fcs, b) != CMUX_FCS_GOOD) {
+      AG_LOGW(TAG, "Drop frame with bad FCS");
+      _state = WaitFlag;
+    } else {
+      _state = EndFlag;
+    }
+    break;
+  }
+  case EndFlag:
+    if (b == CMUX_FLAG) {
+      _handleFrame();
+      _state = Address;
+    } else {
+      _state = WaitFlag;
+    }
+    break;
+  }
+}
+
+void AgCmux::_handleFrame() {
+  uint8_t dlci = _address >> 2;
+  if (dlci > CMUX_CHANNEL_MAX) {
+    return;
+  }
+
+  switch (_control & ~CMUX_PF) {
+  case CMUX_UA:
+    _ack[dlci] = 1;
+    break;
+  case CMUX_DM:
+    _ack[dlci] = -1;
+    break;
+  case CMUX_DISC:
+    AG_LOGW(TAG, "Channel %d closed by module", dlci);
+    _sendFrame(dlci, CMUX_UA | CMUX_PF, false, nullptr, 0);
+    break;
+  case CMUX_UIH: {
+    if (_infoLength > sizeof(_info)) {
+      AG_LOGW(TAG, "Drop frame of %d bytes on channel %d", static_cast<int>(_infoLength), dlci);
+      break;
+    }
+    if (dlci == 0) {
+      _handleControl(_info, _infoLength);
+      break;
+    }
+
+    AgCmuxChannel &channel = _channels[dlci];
+    for (size_t i = 0; i < _infoLength; i++) {
+      if (channel._count == CONFIG_CELLULAR_CMUX_BUFFER_SIZE) {
+        channel._overflow += _infoLength - i;
+        break;
+      }
+      channel._rx[(channel._head + channel._count) % CONFIG_CELLULAR_CMUX_BUFFER_SIZE] =
+          _info[i];
+      channel._count++;
+    }
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+void AgCmux::_handleControl(const uint8_t *data, size_t length) {
+  if (length < 2) {
+    return;
+  }
+
+  // Answer module command (eg. modem status) with the same message as response
+  uint8_t type = data[0];
+  if (type & CMUX_CR) {
+    uint8_t response[CMUX_FRAME_INFO_MAX];
+    size_t responseLength = length < sizeof(response) ? length : sizeof(response);
+    memcpy(response, data, responseLength);
+    response[0] = type & ~CMUX_CR;
+    _sendFrame(0, CMUX_UIH, false, response, responseLength);
+  }
+}
+
+void AgCmux::_sendFrame(uint8_t dlci, uint8_t control, bool command, const uint8_t *data,
+                        size_t length) {
+  // Command sent by initiator has C/R bit set, response has it cleared
+  uint8_t header[5];
+  size_t headerLength = 0;
+  header[headerLength++] = CMUX_FLAG;
+  header[headerLength++] = (dlci << 2) | (command ? CMUX_CR : 0) | CMUX_EA;
+  header[headerLength++] = control;
+  if (length < 128) {
+    header[headerLength++] = (length << 1) | CMUX_EA;
+  } else {
+    header[headerLength++] = (length & 0x7F) << 1;
+    header[headerLength++] = length >> 7;
+  }
+
+  // UIH frame check sequence only cover the header
+  uint8_t fcs = 0xFF;
+  for (size_t i = 1; i < headerLength; i++) {
+    fcs = fcsUpdate(fcs, header[i]);
+  }
+  uint8_t trailer[2] = {static_cast<uint8_t>(0xFF - fcs), CMUX_FLAG};
+
+  serial_->write(header, headerLength);
+  if (length > 0) {
+    serial_->write(data, length);
+  }
+  serial_->write(trailer, sizeof(trailer));
+}
+
+bool AgCmux::_waitAck(uint8_t dlci, uint32_t timeoutMs) {
+  for (uint32_t start = MILLIS(); (MILLIS() - start) < timeoutMs;) {
+    {
+      std::lock_guard<std::recursive_mutex> lock(_mutex);
+      _poll();
+      if (_ack[dlci] != 0) {
+        return _ack[dlci] == 1;
+      }
+    }
+    DELAY_MS(10);
+  }
+
+  return false;
+}
+
+#endif // ESP8266
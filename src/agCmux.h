@@ -0,0 +1,150 @@
+/**
+ * AirGradient
+ * https://airgradient.com
+ *
+ * CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
+ */
+
+#ifndef AG_CMUX_H
+#define AG_CMUX_H
+
+#ifndef ESP8266
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "sdkconfig.h"
+
+#ifdef ARDUINO
+#include "agSerial.h"
+#else
+#include "AirgradientSerial.h"
+#endif
+
+#ifndef CONFIG_CELLULAR_CMUX_BUFFER_SIZE
+// This configuration define by kconfig
+#define CONFIG_CELLULAR_CMUX_BUFFER_SIZE 1024
+#endif
+
+// Virtual channels (DLCI 1..n) over one serial line, DLCI 0 is the control channel
+#define CMUX_CHANNEL_MAX 3
+// Default N1 of basic option, longest information field per frame
+#define CMUX_FRAME_INFO_MAX 31
+
+class AgCmux;
+
+/**
+ * @brief One virtual channel of AgCmux carrying its own byte stream, eg. an AT command channel.
+ * Received data is buffered until read, the serial line is only read when a channel polls it
+ */
+class AgCmuxChannel {
+public:
+  int available();
+  // Return -1 if nothing received
+  int read();
+  void print(const char *str);
+  void write(const uint8_t *data, int length);
+
+  /**
+   * @brief Number of bytes dropped because channel buffer was full
+   */
+  uint32_t getOverflowCount();
+
+private:
+  friend class AgCmux;
+
+  AgCmux *_mux = nullptr;
+  uint8_t _dlci = 0;
+  // Ring buffer, guarded by multiplexer mutex
+  uint8_t _rx[CONFIG_CELLULAR_CMUX_BUFFER_SIZE];
+  size_t _head = 0;
+  size_t _count = 0;
+  uint32_t _overflow = 0;
+};
+
+/**
+ * @brief GSM 07.10 multiplexer, basic option, on the serial line to the module. Module must
+ * already accepted AT+CMUX before open()
+ *
+ * ```
+ * at.sendAT("+CMUX=0");
+ * at.waitResponse();
+ * AgCmux mux(serial);
+ * if (mux.open(2)) {
+ *   AgCmuxChannel *commands = mux.channel(1);
+ *   AgCmuxChannel *status = mux.channel(2);
+ * }
+ * ```
+ */
+class AgCmux {
+public:
+#ifdef ARDUINO
+  // NOTE: Temporarily accomodate ununified AirgradientSerial
+  typedef AgSerial AirgradientSerial;
+#endif
+
+  explicit AgCmux(AirgradientSerial *serial);
+  ~AgCmux() {};
+  AgCmux(const AgCmux &) = delete;
+  AgCmux &operator=(const AgCmux &) = delete;
+
+  /**
+   * @brief Open control channel then channel 1 to channelCount
+   *
+   * @return true if every channel accepted by the module
+   */
+  bool open(int channelCount, uint32_t timeoutMs = 3000);
+
+  /**
+   * @brief Close every channel and the multiplexer, module go back to single AT channel
+   *
+   * @param closeDown false when module already left multiplexer mode (eg. reset), to only
+   * forget channel state without sending anything
+   */
+  void close(bool closeDown = true);
+
+  bool isOpened() { return _opened; }
+
+  /**
+   * @brief Get channel by DLCI, nullptr if not opened
+   */
+  AgCmuxChannel *channel(int dlci);
+
+private:
+  const char *const TAG = "AgCmux";
+
+  enum ParseState { WaitFlag, Address, Control, Length, LengthExtended, Info, Fcs, EndFlag };
+
+  friend class AgCmuxChannel;
+
+  void _poll();
+  void _parse(uint8_t b);
+  void _handleFrame();
+  void _handleControl(const uint8_t *data, size_t length);
+  void _sendFrame(uint8_t dlci, uint8_t control, bool command, const uint8_t *data,
+                  size_t length);
+  bool _waitAck(uint8_t dlci, uint32_t timeoutMs);
+
+  AirgradientSerial *serial_;
+  // Guard serial line access, frame parser and channel buffers
+  std::recursive_mutex _mutex;
+  bool _opened = false;
+  int _channelCount = 0;
+  AgCmuxChannel _channels[CMUX_CHANNEL_MAX + 1];
+  // Answer of SABM or DISC per DLCI; 0 waiting, 1 UA, -1 DM
+  int _ack[CMUX_CHANNEL_MAX + 1] = {};
+
+  // Frame being received
+  ParseState _state = WaitFlag;
+  uint8_t _address = 0;
+  uint8_t _control = 0;
+  uint8_t _header[4];
+  size_t _headerLength = 0;
+  size_t _infoLength = 0;
+  size_t _infoReceived = 0;
+  uint8_t _info[CMUX_FRAME_INFO_MAX * 4];
+};
+
+#endif // ESP8266
+#endif // AG_CMUX_H
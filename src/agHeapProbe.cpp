@@ -0,0 +1,90 @@
+/**
+ * AirGradient
+ * https://airgradient.com
+ *
+ * CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
+ */
+
+#include "agHeapProbe.h"
+
+#if CONFIG_HEAP_ALLOCATION_PROBE
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "agLogger.h"
+
+static const char *const TAG = "AgHeapProbe";
+
+// Task being probed and its allocation count. Slot claimed by setting its task, only that task
+// touch the count afterward, so no lock needed
+struct ProbeSlot {
+  std::atomic<TaskHandle_t> task;
+  uint32_t allocations;
+};
+static ProbeSlot _slots[AG_HEAP_PROBE_TASK_MAX];
+static std::atomic<int> _armed(0);
+
+// Array and nothrow variants end up here as well
+void *operator new(std::size_t size) {
+  // Static constructors allocate before the scheduler, nothing is probed then
+  if (_armed.load() > 0 && xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED) {
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    for (int i = 0; i < AG_HEAP_PROBE_TASK_MAX; i++) {
+      if (_slots[i].task.load() == self) {
+        _slots[i].allocations++;
+      }
+    }
+  }
+
+  void *ptr = malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) {
+    abort();
+  }
+  return ptr;
+}
+
+void operator delete(void *ptr) noexcept { free(ptr); }
+
+void operator delete(void *ptr, std::size_t size) noexcept { free(ptr); }
+
+AgHeapProbe::Scope::Scope() : _slot(-1) {
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  for (int i = 0; i < AG_HEAP_PROBE_TASK_MAX; i++) {
+    TaskHandle_t expected = nullptr;
+    // Calling task does not allocate before its count is reset
+    if (_slots[i].task.compare_exchange_strong(expected, self)) {
+      _slots[i].allocations = 0;
+      _slot = i;
+      _armed++;
+      return;
+    }
+  }
+  AG_LOGW(TAG, "No free probe slot, allocations not checked");
+}
+
+AgHeapProbe::Scope::~Scope() {
+  if (_slot < 0) {
+    return;
+  }
+  _slots[_slot].task.store(nullptr);
+  _armed--;
+  _slot = -1;
+}
+
+void AgHeapProbe::Scope::check(const char *operation) {
+  if (_slot < 0) {
+    return;
+  }
+  uint32_t allocations = _slots[_slot].allocations;
+  if (allocations == 0) {
+    return;
+  }
+
+  AG_LOGE(TAG, "%s allocated %d times from heap in steady state", operation, allocations);
+  abort();
+}
+
+#endif // CONFIG_HEAP_ALLOCATION_PROBE
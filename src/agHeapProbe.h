@@ -0,0 +1,59 @@
+/**
+ * AirGradient
+ * https://airgradient.com
+ *
+ * CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
+ */
+
+#ifndef AG_HEAP_PROBE_H
+#define AG_HEAP_PROBE_H
+
+#include <cstdint>
+#include "sdkconfig.h"
+
+#if CONFIG_HEAP_ALLOCATION_PROBE
+
+// Tasks that can be probed at the same time
+#define AG_HEAP_PROBE_TASK_MAX 4
+
+/**
+ * Test hook to make sure steady state operation does not allocate from heap. Only allocations of
+ * the task that started the probe are counted, other tasks (WiFi, lwIP, application) are free to
+ * allocate meanwhile
+ *
+ * ```
+ * AG_HEAP_PROBE_BEGIN();
+ * ... // operation that should not allocate
+ * AG_HEAP_PROBE_END("httpPostMeasures"); // abort if this task allocated since begin
+ * ```
+ */
+namespace AgHeapProbe {
+/**
+ * @brief Count allocations of the calling task while alive
+ */
+class Scope {
+public:
+  Scope();
+  ~Scope();
+  Scope(const Scope &) = delete;
+  Scope &operator=(const Scope &) = delete;
+
+  // Abort if calling task allocated since constructed
+  void check(const char *operation);
+
+private:
+  int _slot;
+};
+} // namespace AgHeapProbe
+
+#define AG_HEAP_PROBE_BEGIN() AgHeapProbe::Scope _agHeapProbe
+#define AG_HEAP_PROBE_END(operation) _agHeapProbe.check(operation)
+
+#else
+
+#define AG_HEAP_PROBE_BEGIN()
+#define AG_HEAP_PROBE_END(operation)
+
+#endif // CONFIG_HEAP_ALLOCATION_PROBE
+
+#endif // AG_HEAP_PROBE_H
@@ -0,0 +1,136 @@
+/**
+ * AirGradient
+ * https://airgradient.com
+ *
+ * CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
+ */
+
+#include "agResourceMonitor.h"
+
+#if CONFIG_RESOURCE_MONITOR
+
+#include <cstring>
+#include <mutex>
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "common.h"
+#include "agLogger.h"
+
+static const char *const TAG = "AgResourceMonitor";
+
+static AgResourceMonitor::OperationUsage _table[CONFIG_RESOURCE_MONITOR_MAX_OPERATIONS];
+static int _tableCount = 0;
+static std::mutex _tableMutex;
+static uint32_t _logIntervalMs = CONFIG_RESOURCE_MONITOR_LOG_INTERVAL_S * 1000;
+static uint32_t _lastLogTime = 0;
+
+// NOTE: On ESP-IDF FreeRTOS, stack high water mark is in bytes
+static uint32_t currentStackFree() { return uxTaskGetStackHighWaterMark(nullptr); }
+
+static uint32_t currentHeapFree() { return heap_caps_get_free_size(MALLOC_CAP_DEFAULT); }
+
+AgResourceMonitor::Scope::Scope(const char *operation)
+    : _operation(operation), _stackFree(currentStackFree()), _heapFree(currentHeapFree()) {}
+
+AgResourceMonitor::Scope::~Scope() { _record(_operation, _stackFree, _heapFree); }
+
+int AgResourceMonitor::snapshot(OperationUsage *out, int max) {
+  std::lock_guard<std::mutex> lock(_tableMutex);
+  int count = _tableCount < max ? _tableCount : max;
+  memcpy(out, _table, count * sizeof(OperationUsage));
+  return count;
+}
+
+void AgResourceMonitor::log() {
+  AG_LOGI(TAG, "operation | calls | min stack free | max stack drop | min heap free | "
+               "min heap ever free | max heap retained");
+  // Copy one entry at a time, whole table is too big for the caller stack and the lock is not
+  // held while logging
+  for (int i = 0;; i++) {
+    OperationUsage usage;
+    {
+      std::lock_guard<std::mutex> lock(_tableMutex);
+      if (i >= _tableCount) {
+        break;
+      }
+      usage = _table[i];
+    }
+    AG_LOGI(TAG, "%s | %d | %d | %d | %d | %d | %d", usage.operation, usage.calls,
+            usage.minStackFree, usage.maxStackDrop, usage.minHeapFree, usage.minHeapEverFree,
+            usage.maxHeapRetained);
+  }
+}
+
+void AgResourceMonitor::setLogInterval(uint32_t intervalS) { _logIntervalMs = intervalS * 1000; }
+
+void AgResourceMonitor::reset() {
+  std::lock_guard<std::mutex> lock(_tableMutex);
+  _tableCount = 0;
+}
+
+void AgResourceMonitor::_record(const char *operation, uint32_t stackFreeEntry,
+                                uint32_t heapFreeEntry) {
+  uint32_t stackFreeExit = currentStackFree();
+  uint32_t heapFreeExit = currentHeapFree();
+  uint32_t heapEverFree = heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+  uint32_t stackDrop = stackFreeEntry > stackFreeExit ? stackFreeEntry - stackFreeExit : 0;
+  int32_t heapRetained = static_cast<int32_t>(heapFreeEntry - heapFreeExit);
+  uint32_t heapFree = heapFreeEntry < heapFreeExit ? heapFreeEntry : heapFreeExit;
+
+  bool logNow = false;
+  {
+    std::lock_guard<std::mutex> lock(_tableMutex);
+
+    // Operation name is string literal, compare its address first
+    OperationUsage *usage = nullptr;
+    for (int i = 0; i < _tableCount; i++) {
+      if (_table[i].operation == operation || strcmp(_table[i].operation, operation) == 0) {
+        usage = &_table[i];
+        break;
+      }
+    }
+
+    if (usage == nullptr) {
+      if (_tableCount >= CONFIG_RESOURCE_MONITOR_MAX_OPERATIONS) {
+        return;
+      }
+      usage = &_table[_tableCount++];
+      usage->operation = operation;
+      usage->calls = 0;
+      usage->minStackFree = stackFreeExit;
+      usage->maxStackDrop = stackDrop;
+      usage->minHeapFree = heapFree;
+      usage->minHeapEverFree = heapEverFree;
+      usage->maxHeapRetained = heapRetained;
+    }
+
+    usage->calls++;
+    if (stackFreeExit < usage->minStackFree) {
+      usage->minStackFree = stackFreeExit;
+    }
+    if (stackDrop > usage->maxStackDrop) {
+      usage->maxStackDrop = stackDrop;
+    }
+    if (heapFree < usage->minHeapFree) {
+      usage->minHeapFree = heapFree;
+    }
+    if (heapEverFree < usage->minHeapEverFree) {
+      usage->minHeapEverFree = heapEverFree;
+    }
+    if (heapRetained > usage->maxHeapRetained) {
+      usage->maxHeapRetained = heapRetained;
+    }
+
+    if (_logIntervalMs > 0 && (MILLIS() - _lastLogTime) >= _logIntervalMs) {
+      _lastLogTime = MILLIS();
+      logNow = true;
+    }
+  }
+
+  if (logNow) {
+    log();
+  }
+}
+
+#endif // CONFIG_RESOURCE_MONITOR
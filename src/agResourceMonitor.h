@@ -0,0 +1,102 @@
+/**
+ * AirGradient
+ * https://airgradient.com
+ *
+ * CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
+ */
+
+#ifndef AG_RESOURCE_MONITOR_H
+#define AG_RESOURCE_MONITOR_H
+
+#include <cstdint>
+#include "sdkconfig.h"
+
+#if CONFIG_RESOURCE_MONITOR
+
+#ifndef CONFIG_RESOURCE_MONITOR_MAX_OPERATIONS
+// This configuration define by kconfig
+#define CONFIG_RESOURCE_MONITOR_MAX_OPERATIONS 32
+#endif
+
+#ifndef CONFIG_RESOURCE_MONITOR_LOG_INTERVAL_S
+// This configuration define by kconfig
+#define CONFIG_RESOURCE_MONITOR_LOG_INTERVAL_S 0
+#endif
+
+/**
+ * @brief Record heap and task stack usage at entry and exit of client and cellular module
+ * operations, to size task stack and buffers from field data
+ *
+ * ```
+ * CellReturnStatus CellularModuleA7672XX::reinitialize() {
+ *   AG_RESOURCE_SCOPE("A7672XX::reinitialize");
+ *   ...
+ * }
+ *
+ * AgResourceMonitor::OperationUsage table[CONFIG_RESOURCE_MONITOR_MAX_OPERATIONS];
+ * int count = AgResourceMonitor::snapshot(table, CONFIG_RESOURCE_MONITOR_MAX_OPERATIONS);
+ * ```
+ */
+class AgResourceMonitor {
+public:
+  struct OperationUsage {
+    const char *operation;
+    uint32_t calls;
+    uint32_t minStackFree;     // lowest task stack high water mark seen at operation exit
+    uint32_t maxStackDrop;     // largest decrease of high water mark during one call
+    uint32_t minHeapFree;      // lowest free heap seen at operation entry or exit
+    uint32_t minHeapEverFree;  // lowest free heap since boot, seen at operation exit
+    int32_t maxHeapRetained;   // largest heap still held after one call finish
+  };
+
+  // Capture usage on construction and record it to the table on destruction
+  class Scope {
+  public:
+    explicit Scope(const char *operation);
+    ~Scope();
+
+  private:
+    const char *_operation;
+    uint32_t _stackFree;
+    uint32_t _heapFree;
+  };
+
+  /**
+   * @brief Copy recorded usage table
+   *
+   * @param out where table is copied to
+   * @param max max entry of 'out'
+   * @return number of entry copied
+   */
+  static int snapshot(OperationUsage *out, int max);
+
+  /**
+   * @brief Print recorded usage table
+   */
+  static void log();
+
+  /**
+   * @brief Set how often table is printed after an operation finish
+   *
+   * @param intervalS interval in seconds, 0 to disable
+   */
+  static void setLogInterval(uint32_t intervalS);
+
+  /**
+   * @brief Clear recorded usage table
+   */
+  static void reset();
+
+private:
+  static void _record(const char *operation, uint32_t stackFreeEntry, uint32_t heapFreeEntry);
+};
+
+#define AG_RESOURCE_SCOPE(operation) AgResourceMonitor::Scope _agResourceScope(operation)
+
+#else
+
+#define AG_RESOURCE_SCOPE(operation)
+
+#endif // CONFIG_RESOURCE_MONITOR
+
+#endif // AG_RESOURCE_MONITOR_H
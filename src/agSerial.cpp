@@ -10,10 +10,11 @@
 
 #include "agSerial.h"
 #include "agLogger.h"
+#include "agTrace.h"
 
 #define MAX_RETRY_IICSERIAL_UART_INIT 3
 
-AgSerial::AgSerial(TwoWire &wire) : _wire(wire) {}
+AgSerial::AgSerial(TwoWire &wire) : _wire(&wire) {}
 
 AgSerial::~AgSerial() {
   if (iicSerial_ != nullptr) {
@@ -34,7 +35,7 @@ void AgSerial::init(int iicResetIO) {
   gpio_reset_pin(_iicResetIO); // IIC-UART reset
   gpio_set_direction(_iicResetIO, GPIO_MODE_OUTPUT);
   gpio_set_level(_iicResetIO, 1);
-  iicSerial_ = new DFRobot_IICSerial(_wire, SUBUART_CHANNEL_1, 1, 1);
+  iicSerial_ = new DFRobot_IICSerial(*_wire, SUBUART_CHANNEL_1, 1, 1);
   AG_LOGI(TAG, "IICSerial initialized");
 }
 
@@ -48,6 +49,7 @@ bool AgSerial::open(int baud) {
   do {
     if (iicSerial_->begin(baud) == 0) {
       _atLineOpened = true;
+      _baudRate = baud;
       break;
     }
 
@@ -80,15 +82,59 @@ void AgSerial::close() {
 
 void AgSerial::setDebug(bool enable) { _debug = enable; }
 
-bool AgSerial::available() { return (iicSerial_->available() > 0); }
+bool AgSerial::setBaudRate(int baud) {
+  if (!_atLineOpened) {
+    AG_LOGW(TAG, "IICSerial line not opened, cannot change baud rate");
+    return false;
+  }
+
+  iicSerial_->setBaudRate(baud);
+  _baudRate = baud;
+  AG_LOGI(TAG, "IICSerial baud rate set to %d", baud);
+  return true;
+}
+
+bool AgSerial::setFlowControl(bool enable) {
+  if (enable) {
+    AG_LOGW(TAG, "IICSerial not support RTS/CTS flow control");
+  }
+  return !enable;
+}
+
+uint32_t AgSerial::getOverflowCount() {
+  if (iicSerial_ == nullptr) {
+    return 0;
+  }
+  return iicSerial_->getRxOverflowCount();
+}
+
+bool AgSerial::available() {
+#if CONFIG_TRACE_ENABLED
+  // Only trace I2C FIFO poll that return data, polling is too frequent otherwise
+  int64_t start = esp_timer_get_time();
+  bool result = (iicSerial_->available() > 0);
+  if (result) {
+    AgTrace::record("serial", "poll", start, esp_timer_get_time());
+  }
+  return result;
+#else
+  return (iicSerial_->available() > 0);
+#endif
+}
 
 void AgSerial::print(const char *str) {
+  AG_TRACE_SPAN("serial", "write");
   if (_debug) {
     Serial.print(str); // TODO: Change to idf compatiblee
   }
   iicSerial_->print(str);
 }
 
+void AgSerial::write(const uint8_t *data, int length) {
+  AG_TRACE_SPAN("serial", "write");
+  iicSerial_->write(data, length);
+}
+
 uint8_t AgSerial::read() {
   if (_debug) {
     char b = iicSerial_->read();
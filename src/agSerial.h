@@ -15,27 +15,66 @@
 #include "Wire.h"
 #include "DFRobot_IICSerial.h"
 
+/**
+ * @brief Serial line to the cellular module through the WK2132 I2C-to-UART bridge
+ *
+ * Functions are virtual so other transport (eg. AgUartSerial) can be used by ATCommandHandler
+ */
 class AgSerial {
 private:
   const char *const TAG = "AGSERIAL";
   bool _atLineOpened = false;
-  TwoWire &_wire; // TODO: remove after DFRobot_IICSerial move to idf
+  TwoWire *_wire = nullptr; // TODO: remove after DFRobot_IICSerial move to idf
   DFRobot_IICSerial *iicSerial_ = nullptr;
   gpio_num_t _iicResetIO = GPIO_NUM_NC;
+
+protected:
   bool _debug = false;
+  int _baudRate = 115200;
+
+  // For derived class that not use I2C bridge
+  AgSerial() {}
 
 public:
   AgSerial(TwoWire &wire);
-  ~AgSerial();
+  virtual ~AgSerial();
 
-  void init(int iicResetIO);
-  bool open(int baud = 115200);
-  void close();
+  virtual void init(int iicResetIO);
+  virtual bool open(int baud = 115200);
+  virtual void close();
   void setDebug(bool enable = true);
 
-  bool available();
-  void print(const char *str);
-  uint8_t read();
+  /**
+   * @brief Change baud rate of an opened serial line
+   *
+   * @param baud new baud rate
+   * @return true if applied
+   */
+  virtual bool setBaudRate(int baud);
+  int getBaudRate() { return _baudRate; }
+
+  /**
+   * @brief Enable or disable RTS/CTS hardware flow control on the serial line
+   *
+   * WK2132 sub UART does not have RTS/CTS, so this always return false for I2C bridge
+   *
+   * @param enable true to enable
+   * @return true if flow control applied
+   */
+  virtual bool setFlowControl(bool enable);
+
+  /**
+   * @brief Number of RX overflow detected on the serial line, data was lost when this increase
+   */
+  virtual uint32_t getOverflowCount();
+
+  virtual bool available();
+  virtual void print(const char *str);
+  /**
+   * @brief Write binary data that might contain NUL, eg. socket payload
+   */
+  virtual void write(const uint8_t *data, int length);
+  virtual uint8_t read();
 };
 
 #endif // ESP8266
@@ -0,0 +1,126 @@
+/**
+ * AirGradient
+ * https://airgradient.com
+ *
+ * CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
+ */
+
+#include "agTrace.h"
+
+#if CONFIG_TRACE_ENABLED
+
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+struct TraceEvent {
+  uint32_t id;
+  const char *category;
+  char name[AG_TRACE_NAME_LENGTH];
+  uint32_t tid;
+  int64_t startUs;
+  int64_t endUs; // -1 while span still open
+};
+
+static TraceEvent _events[CONFIG_TRACE_BUFFER_EVENTS];
+static uint32_t _nextId = 0;
+static std::mutex _eventsMutex;
+
+static uint32_t currentTaskId() {
+  return static_cast<uint32_t>(reinterpret_cast<uintptr_t>(xTaskGetCurrentTaskHandle()));
+}
+
+// Copy name to fixed length, escape characters that break JSON string
+static void copyName(char *dest, const char *src) {
+  size_t idx = 0;
+  for (; *src != '\0' && idx < AG_TRACE_NAME_LENGTH - 1; src++) {
+    char c = *src;
+    if (c == '"' || c == '\\') {
+      c = '\'';
+    } else if (c < ' ') {
+      continue;
+    }
+    dest[idx++] = c;
+  }
+  dest[idx] = '\0';
+}
+
+uint32_t AgTrace::begin(const char *category, const char *name) {
+  int64_t now = esp_timer_get_time();
+  uint32_t tid = currentTaskId();
+
+  std::lock_guard<std::mutex> lock(_eventsMutex);
+  uint32_t id = _nextId++;
+  TraceEvent &event = _events[id % CONFIG_TRACE_BUFFER_EVENTS];
+  event.id = id;
+  event.category = category;
+  copyName(event.name, name);
+  event.tid = tid;
+  event.startUs = now;
+  event.endUs = -1;
+
+  return id;
+}
+
+void AgTrace::end(uint32_t id) {
+  int64_t now = esp_timer_get_time();
+
+  std::lock_guard<std::mutex> lock(_eventsMutex);
+  TraceEvent &event = _events[id % CONFIG_TRACE_BUFFER_EVENTS];
+  if (event.id == id) {
+    event.endUs = now;
+  }
+}
+
+void AgTrace::record(const char *category, const char *name, int64_t startUs, int64_t endUs) {
+  uint32_t id = begin(category, name);
+
+  std::lock_guard<std::mutex> lock(_eventsMutex);
+  TraceEvent &event = _events[id % CONFIG_TRACE_BUFFER_EVENTS];
+  if (event.id == id) {
+    event.startUs = startUs;
+    event.endUs = endUs;
+  }
+}
+
+void AgTrace::exportChromeTrace(const std::function<void(const char *)> &write) {
+  char buf[160];
+  write("{\"traceEvents\":[");
+
+  std::lock_guard<std::mutex> lock(_eventsMutex);
+  uint32_t first = 0;
+  if (_nextId > CONFIG_TRACE_BUFFER_EVENTS) {
+    first = _nextId - CONFIG_TRACE_BUFFER_EVENTS;
+  }
+  for (uint32_t id = first; id < _nextId; id++) {
+    const TraceEvent &event = _events[id % CONFIG_TRACE_BUFFER_EVENTS];
+    const char *separator = (id == first) ? "" : ",";
+    if (event.endUs < 0) {
+      // Span not finished yet
+      snprintf(buf, sizeof(buf),
+               "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"B\",\"ts\":%lld,\"pid\":1,\"tid\":%u}",
+               separator, event.name, event.category, static_cast<long long>(event.startUs),
+               static_cast<unsigned>(event.tid));
+    } else {
+      snprintf(buf, sizeof(buf),
+               "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,"
+               "\"pid\":1,\"tid\":%u}",
+               separator, event.name, event.category, static_cast<long long>(event.startUs),
+               static_cast<long long>(event.endUs - event.startUs),
+               static_cast<unsigned>(event.tid));
+    }
+    write(buf);
+  }
+
+  write("],\"displayTimeUnit\":\"ms\"}");
+}
+
+void AgTrace::clear() {
+  std::lock_guard<std::mutex> lock(_eventsMutex);
+  _nextId = 0;
+}
+
+#endif // CONFIG_TRACE_ENABLED
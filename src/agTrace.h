@@ -0,0 +1,95 @@
+/**
+ * AirGradient
+ * https://airgradient.com
+ *
+ * CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
+ */
+
+#ifndef AG_TRACE_H
+#define AG_TRACE_H
+
+#include <cstdint>
+#include <functional>
+#include "sdkconfig.h"
+
+#if CONFIG_TRACE_ENABLED
+
+#include "esp_timer.h"
+
+#ifndef CONFIG_TRACE_BUFFER_EVENTS
+// This configuration define by kconfig
+#define CONFIG_TRACE_BUFFER_EVENTS 256
+#endif
+
+#define AG_TRACE_NAME_LENGTH 24
+
+/**
+ * @brief Record spans of client operations, module states, AT commands and serial transfers into
+ * a fixed ring buffer, oldest span overwritten when full. Export as Chrome trace event JSON that
+ * can be opened with chrome://tracing or ui.perfetto.dev
+ *
+ * ```
+ * {
+ *   AG_TRACE_SPAN("module", "HTTPACTION"); // end when out of scope
+ *   ...
+ * }
+ *
+ * uint32_t id = AgTrace::begin("at", cmd); // name is copied
+ * ...
+ * AgTrace::end(id);
+ *
+ * AgTrace::exportChromeTrace([](const char *chunk) { Serial.print(chunk); });
+ * ```
+ */
+class AgTrace {
+public:
+  class Span {
+  public:
+    Span(const char *category, const char *name) : _id(begin(category, name)) {}
+    ~Span() { end(_id); }
+
+  private:
+    uint32_t _id;
+  };
+
+  /**
+   * @brief Start a span on current task
+   *
+   * @param category layer of the span, must be string literal
+   * @param name span name, copied up to AG_TRACE_NAME_LENGTH - 1 characters
+   * @return span id to end the span
+   */
+  static uint32_t begin(const char *category, const char *name);
+
+  /**
+   * @brief End a span, ignored if span already overwritten on the ring buffer
+   */
+  static void end(uint32_t id);
+
+  /**
+   * @brief Record finished span with known start and end time
+   */
+  static void record(const char *category, const char *name, int64_t startUs, int64_t endUs);
+
+  /**
+   * @brief Write recorded spans as Chrome trace event JSON, oldest first
+   *
+   * @param write called with each chunk of the JSON text
+   */
+  static void exportChromeTrace(const std::function<void(const char *)> &write);
+
+  /**
+   * @brief Remove all recorded spans
+   */
+  static void clear();
+};
+
+#define AG_TRACE_SPAN(category, name) AgTrace::Span _agTraceSpan(category, name)
+
+#else
+
+#define AG_TRACE_SPAN(category, name)
+
+#endif // CONFIG_TRACE_ENABLED
+
+#endif // AG_TRACE_H
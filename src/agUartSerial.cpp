@@ -0,0 +1,213 @@
+/**
+ * AirGradient
+ * https://airgradient.com
+ *
+ * CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
+ */
+
+#ifdef ARDUINO
+#ifndef ESP8266
+
+#include "agUartSerial.h"
+#include <cstring>
+#include "agLogger.h"
+#include "agTrace.h"
+
+AgUartSerial::AgUartSerial(uart_port_t port, int txPin, int rxPin, int rtsPin, int ctsPin)
+    : _port(port), _txPin(txPin), _rxPin(rxPin), _rtsPin(rtsPin), _ctsPin(ctsPin) {}
+
+AgUartSerial::~AgUartSerial() {
+  close();
+  if (_installed) {
+    uart_driver_delete(_port);
+    _installed = false;
+  }
+}
+
+void AgUartSerial::init(int resetIO) {
+  if (_installed) {
+    // already initialized
+    AG_LOGI(TAG, "UART already initialized");
+    return;
+  }
+
+  esp_err_t err = uart_driver_install(_port, AG_UART_RX_BUFFER_SIZE, AG_UART_TX_BUFFER_SIZE,
+                                      AG_UART_EVENT_QUEUE_SIZE, &_eventQueue, 0);
+  if (err != ESP_OK) {
+    AG_LOGE(TAG, "Failed install UART driver, err: %s", esp_err_to_name(err));
+    return;
+  }
+
+  err = uart_set_pin(_port, _txPin, _rxPin, _rtsPin < 0 ? UART_PIN_NO_CHANGE : _rtsPin,
+                     _ctsPin < 0 ? UART_PIN_NO_CHANGE : _ctsPin);
+  if (err != ESP_OK) {
+    AG_LOGE(TAG, "Failed set UART pin, err: %s", esp_err_to_name(err));
+    uart_driver_delete(_port);
+    return;
+  }
+
+  _installed = true;
+  AG_LOGI(TAG, "UART initialized");
+}
+
+bool AgUartSerial::open(int baud) {
+  if (_opened) {
+    AG_LOGI(TAG, "UART already opened");
+    return true;
+  }
+
+  if (!_installed) {
+    AG_LOGE(TAG, "UART driver not installed, call init() first");
+    return false;
+  }
+
+  uart_config_t config = {};
+  config.baud_rate = baud;
+  config.data_bits = UART_DATA_8_BITS;
+  config.parity = UART_PARITY_DISABLE;
+  config.stop_bits = UART_STOP_BITS_1;
+  // Flow control enabled after module configured for it, see setFlowControl()
+  config.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+  config.source_clk = UART_SCLK_DEFAULT;
+
+  esp_err_t err = uart_param_config(_port, &config);
+  if (err != ESP_OK) {
+    AG_LOGE(TAG, "Failed configure UART, err: %s", esp_err_to_name(err));
+    return false;
+  }
+
+  uart_flush_input(_port);
+  _rxCacheLen = 0;
+  _rxCachePos = 0;
+  _overflowCount = 0;
+  _baudRate = baud;
+  _opened = true;
+
+  AG_LOGI(TAG, "UART success open serial line at %d", baud);
+  return true;
+}
+
+void AgUartSerial::close() {
+  if (!_opened) {
+    return;
+  }
+
+  uart_wait_tx_done(_port, pdMS_TO_TICKS(1000));
+  _opened = false;
+}
+
+bool AgUartSerial::setBaudRate(int baud) {
+  if (!_opened) {
+    AG_LOGW(TAG, "UART not opened, cannot change baud rate");
+    return false;
+  }
+
+  uart_wait_tx_done(_port, pdMS_TO_TICKS(100));
+  if (uart_set_baudrate(_port, baud) != ESP_OK) {
+    AG_LOGE(TAG, "Failed set UART baud rate to %d", baud);
+    return false;
+  }
+
+  _baudRate = baud;
+  AG_LOGI(TAG, "UART baud rate set to %d", baud);
+  return true;
+}
+
+bool AgUartSerial::setFlowControl(bool enable) {
+  if (!_opened) {
+    AG_LOGW(TAG, "UART not opened, cannot change flow control");
+    return false;
+  }
+
+  if (enable && (_rtsPin < 0 || _ctsPin < 0)) {
+    AG_LOGW(TAG, "RTS/CTS pin not provided, flow control not supported");
+    return false;
+  }
+
+  // Deassert RTS when hardware RX FIFO reach threshold, before it overflow
+  uart_hw_flowcontrol_t mode = enable ? UART_HW_FLOWCTRL_CTS_RTS : UART_HW_FLOWCTRL_DISABLE;
+  if (uart_set_hw_flow_ctrl(_port, mode, 100) != ESP_OK) {
+    AG_LOGE(TAG, "Failed set UART flow control");
+    return false;
+  }
+
+  AG_LOGI(TAG, "UART RTS/CTS flow control %s", enable ? "enabled" : "disabled");
+  return true;
+}
+
+bool AgUartSerial::available() {
+  if (_rxCachePos < _rxCacheLen) {
+    return true;
+  }
+
+  _handleEvents();
+
+  size_t buffered = 0;
+  uart_get_buffered_data_len(_port, &buffered);
+  return buffered > 0;
+}
+
+void AgUartSerial::print(const char *str) {
+  AG_TRACE_SPAN("serial", "write");
+  if (_debug) {
+    Serial.print(str); // TODO: Change to idf compatiblee
+  }
+  uart_write_bytes(_port, str, strlen(str));
+}
+
+void AgUartSerial::write(const uint8_t *data, int length) {
+  AG_TRACE_SPAN("serial", "write");
+  uart_write_bytes(_port, data, length);
+}
+
+uint8_t AgUartSerial::read() {
+  if (_rxCachePos >= _rxCacheLen) {
+    // Refill local cache with whatever already in driver ring buffer, without blocking
+    size_t buffered = 0;
+    uart_get_buffered_data_len(_port, &buffered);
+    if (buffered > AG_UART_RX_CACHE_SIZE) {
+      buffered = AG_UART_RX_CACHE_SIZE;
+    }
+
+    AG_TRACE_SPAN("serial", "read");
+    int len = uart_read_bytes(_port, _rxCache, buffered > 0 ? buffered : 1, 0);
+    if (len <= 0) {
+      // Nothing to read, same behavior as IIC serial
+      return 0xFF;
+    }
+    _rxCacheLen = len;
+    _rxCachePos = 0;
+  }
+
+  uint8_t b = _rxCache[_rxCachePos++];
+  if (_debug) {
+    Serial.write(b); // TODO: Change to idf compatiblee
+  }
+  return b;
+}
+
+void AgUartSerial::_handleEvents() {
+  if (_eventQueue == nullptr) {
+    return;
+  }
+
+  uart_event_t event;
+  while (xQueueReceive(_eventQueue, &event, 0) == pdTRUE) {
+    switch (event.type) {
+    case UART_FIFO_OVF:
+    case UART_BUFFER_FULL:
+      _overflowCount++;
+      AG_LOGW(TAG, "UART RX overflow (%d), data might be lost", _overflowCount);
+      break;
+    case UART_FRAME_ERR:
+    case UART_PARITY_ERR:
+      AG_LOGW(TAG, "UART RX frame or parity error");
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+#endif // ESP8266
+#endif // ARDUINO
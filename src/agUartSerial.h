@@ -0,0 +1,87 @@
+/**
+ * AirGradient
+ * https://airgradient.com
+ *
+ * CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
+ */
+
+#ifdef ARDUINO
+#ifndef AIRGRADIENT_UART_SERIAL_H
+#define AIRGRADIENT_UART_SERIAL_H
+
+#ifndef ESP8266
+
+#include "driver/uart.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "agSerial.h"
+
+#define AG_UART_RX_BUFFER_SIZE 4096 // bytes, driver ring buffer
+#define AG_UART_TX_BUFFER_SIZE 2048 // bytes, driver ring buffer
+#define AG_UART_EVENT_QUEUE_SIZE 20
+#define AG_UART_RX_CACHE_SIZE 64 // bytes, local cache to serve byte per byte read()
+
+/**
+ * @brief Serial line to the cellular module wired directly to ESP32 UART
+ *
+ * For boards without WK2132 I2C-to-UART bridge. RX is handled by the IDF UART driver interrupt into
+ * a large ring buffer, so bytes are not lost while the task is sleeping between polls, and TX is
+ * queued with uart_write_bytes() without any per chunk delay.
+ *
+ * Can be used by ATCommandHandler the same way as AgSerial
+ */
+class AgUartSerial : public AgSerial {
+private:
+  const char *const TAG = "AGUARTSERIAL";
+  uart_port_t _port;
+  int _txPin;
+  int _rxPin;
+  int _rtsPin;
+  int _ctsPin;
+  QueueHandle_t _eventQueue = nullptr;
+  bool _installed = false;
+  bool _opened = false;
+  uint8_t _rxCache[AG_UART_RX_CACHE_SIZE];
+  int _rxCacheLen = 0;
+  int _rxCachePos = 0;
+  uint32_t _overflowCount = 0;
+
+public:
+  /**
+   * @param port UART port number connected to the cellular module
+   * @param txPin GPIO for UART TX
+   * @param rxPin GPIO for UART RX
+   * @param rtsPin GPIO for RTS, -1 if not wired
+   * @param ctsPin GPIO for CTS, -1 if not wired
+   */
+  AgUartSerial(uart_port_t port, int txPin, int rxPin, int rtsPin = -1, int ctsPin = -1);
+  ~AgUartSerial() override;
+
+  /**
+   * @brief Install UART driver
+   *
+   * @param resetIO not used, there's no bridge to reset
+   */
+  void init(int resetIO = -1) override;
+  bool open(int baud = 115200) override;
+  void close() override;
+  bool setBaudRate(int baud) override;
+  bool setFlowControl(bool enable) override;
+
+  bool available() override;
+  void print(const char *str) override;
+  void write(const uint8_t *data, int length) override;
+  uint8_t read() override;
+
+  /**
+   * @brief Number of RX overflow reported by UART driver since opened
+   */
+  uint32_t getOverflowCount() override { return _overflowCount; }
+
+private:
+  void _handleEvents();
+};
+
+#endif // ESP8266
+#endif // AIRGRADIENT_UART_SERIAL_H
+#endif // ARDUINO
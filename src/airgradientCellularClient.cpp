@@ -10,10 +10,14 @@
 #ifndef ESP8266
 
 #include "airgradientCellularClient.h"
-#include <sstream>
+#include <streambuf>
+#include "esp_random.h"
 #include "cellularModule.h"
 #include "common.h"
+#include "agHeapProbe.h"
 #include "agLogger.h"
+#include "agResourceMonitor.h"
+#include "agTrace.h"
 #include "config.h"
 
 #define ONE_OPENAIR_POST_MEASURES_ENDPOINT "cts"
@@ -24,19 +28,60 @@
 #define POST_MEASURES_ENDPOINT OPENAIR_MAX_POST_MEASURES_ENDPOINT
 #endif
 
+// CoAP transmission parameters, RFC 7252 section 4.8
+#define COAP_ACK_TIMEOUT_MS 2000
+#define COAP_MAX_RETRANSMIT 4
+// Wait for separate response after empty ACK
+#define COAP_SEPARATE_RESPONSE_TIMEOUT_MS 10000
+#define COAP_TOKEN_LENGTH 4
+
+// Stream buffer that append to a string, reusing its capacity
+class StringAppendBuf : public std::streambuf {
+public:
+  explicit StringAppendBuf(std::string &target) : _target(target) {}
+
+protected:
+  int_type overflow(int_type ch) override {
+    if (ch != traits_type::eof()) {
+      _target.push_back(static_cast<char>(ch));
+    }
+    return ch;
+  }
+
+  std::streamsize xsputn(const char *s, std::streamsize n) override {
+    _target.append(s, n);
+    return n;
+  }
+
+private:
+  std::string &_target;
+};
+
 AirgradientCellularClient::AirgradientCellularClient(CellularModule *cellularModule)
     : cell_(cellularModule) {}
 
 bool AirgradientCellularClient::begin(std::string sn, PayloadType pt) {
+  AG_RESOURCE_SCOPE("CellClient::begin");
+  AG_TRACE_SPAN("client", "begin");
   // Update parent serialNumber variable
   serialNumber = sn;
   payloadType = pt;
   clientReady = false;
+  _topic = buildMqttTopicPublishMeasures();
+#if CONFIG_CELLULAR_STATIC_BUFFERS
+  _url.reserve(100);
+  _payload.reserve(CONFIG_CELLULAR_PAYLOAD_ARENA_SIZE);
+  _datagram.reserve(CONFIG_CELLULAR_COAP_BLOCK_SIZE + 64);
+#endif
+  // Random start so restarted device don't reuse recent message id and token
+  _coapMessageId = esp_random();
+  _coapToken = esp_random();
 
   if (!cell_->init()) {
     AG_LOGE(TAG, "Cannot initialized cellular client");
     return false;
   }
+  cell_->setHttpsCACert(AG_SERVER_ROOT_CA);
 
   // To make sure module ready to use
   if (cell_->isSimReady() != CellReturnStatus::Ok) {
@@ -76,22 +121,28 @@ void AirgradientCellularClient::setNetworkRegistrationTimeoutMs(int timeoutMs) {
 
 std::string AirgradientCellularClient::getICCID() { return _iccid; }
 
+void AirgradientCellularClient::setHttpsEnabled(bool enabled) { _httpsEnabled = enabled; }
+
 bool AirgradientCellularClient::ensureClientConnection(bool reset) {
+  AG_RESOURCE_SCOPE("CellClient::ensureClientConnection");
+  AG_TRACE_SPAN("client", "ensureClientConnection");
+  CellDeadlineScope deadline(cell_, operationBudgetMs);
+  lastDeadlineExceeded = false;
   AG_LOGE(TAG, "Ensuring client connection, restarting cellular module");
+  // Module sockets are gone once reinitialized
+  _datagramSocket = -1;
   if (reset) {
+    // Both wait until module restarted, readiness is ensured when reinitialize
     if (cell_->reset() == false) {
       AG_LOGW(TAG, "Reset failed, power cycle module...");
       cell_->powerOff(true);
-      DELAY_MS(2000);
       cell_->powerOn();
     }
-
-    AG_LOGI(TAG, "Wait for 10s for module to warming up");
-    DELAY_MS(10000);
   }
 
   if (cell_->reinitialize() != CellReturnStatus::Ok) {
     AG_LOGE(TAG, "Failed to reinitialized the cellular module");
+    lastDeadlineExceeded = cell_->isDeadlineExceeded();
     clientReady = false;
     return false;
   }
@@ -101,6 +152,7 @@ bool AirgradientCellularClient::ensureClientConnection(bool reset) {
       cell_->startNetworkRegistration(CellTechnology::Auto, _apn, _networkRegistrationTimeoutMs);
   if (result.status != CellReturnStatus::Ok) {
     AG_LOGE(TAG, "Cellular client failed, module cannot register to network");
+    lastDeadlineExceeded = (result.status == CellReturnStatus::DeadlineExceeded);
     clientReady = false;
     return false;
   }
@@ -112,10 +164,20 @@ bool AirgradientCellularClient::ensureClientConnection(bool reset) {
 }
 
 std::string AirgradientCellularClient::httpFetchConfig() {
-  std::string url = buildFetchConfigUrl();
-  AG_LOGI(TAG, "Fetch configuration from %s", url.c_str());
-
-  auto result = cell_->httpGet(url); // TODO: Define timeouts
+  AG_RESOURCE_SCOPE("CellClient::httpFetchConfig");
+  AG_TRACE_SPAN("client", "httpFetchConfig");
+  char url[100] = {0};
+  buildFetchConfigUrl(url, sizeof(url), _httpsEnabled);
+  _url.assign(url);
+  AG_LOGI(TAG, "Fetch configuration from %s", url);
+
+  // Server answer 304 without body when configuration still match the cached one
+  loadConfigCache();
+  AG_HEAP_PROBE_BEGIN();
+  CellDeadlineScope deadline(cell_, operationBudgetMs);
+  auto result = cell_->httpGetIfNoneMatch(_url, cachedConfigEtag.c_str()); // TODO: Define timeouts
+  AG_HEAP_PROBE_END("httpFetchConfig");
+  lastDeadlineExceeded = (result.status == CellReturnStatus::DeadlineExceeded);
   if (result.status != CellReturnStatus::Ok) {
     AG_LOGE(TAG, "Module not return OK when call httpGet()");
     lastFetchConfigSucceed = false;
@@ -126,6 +188,14 @@ std::string AirgradientCellularClient::httpFetchConfig() {
   // Reset client ready state
   clientReady = true;
 
+  if (result.data.statusCode == 304 && !cachedConfig.empty()) {
+    AG_LOGI(TAG, "Configuration not modified, use cached configuration");
+    registeredOnAgServer = true;
+    lastFetchConfigSucceed = true;
+    configChanged = false;
+    return cachedConfig;
+  }
+
   // Response status check if fetch failed
   if (result.data.statusCode != 200) {
     AG_LOGW(TAG, "Failed fetch configuration from server with return code %d",
@@ -150,10 +220,14 @@ std::string AirgradientCellularClient::httpFetchConfig() {
     return {};
   }
 
-  AG_LOGI(TAG, "Received configuration: (%d) %s", result.data.bodyLen, result.data.body.get());
-
   // Move the string from unique_ptr
   std::string body = std::string(result.data.body.get());
+  updateConfigCache(body, result.data.etag != nullptr ? result.data.etag : "");
+  if (configChanged) {
+    AG_LOGI(TAG, "Received configuration: (%d) %s", result.data.bodyLen, result.data.body.get());
+  } else {
+    AG_LOGI(TAG, "Received configuration is the same as cached one");
+  }
 
   AG_LOGI(TAG, "Success fetch configuration from server, still needs to be parsed and validated");
 
@@ -161,13 +235,37 @@ std::string AirgradientCellularClient::httpFetchConfig() {
 }
 
 bool AirgradientCellularClient::httpPostMeasures(const std::string &payload) {
-  char url[80] = {0};
-  sprintf(url, "http://%s/sensors/%s/%s", httpDomain.c_str(), serialNumber.c_str(),
-          _getEndpoint().c_str());
+  AG_RESOURCE_SCOPE("CellClient::httpPostMeasures");
+  AG_TRACE_SPAN("client", "httpPostMeasures");
+  char url[88] = {0};
+  sprintf(url, "%s://%s/sensors/%s/%s", _httpsEnabled ? "https" : "http", httpDomain.c_str(),
+          serialNumber.c_str(), _getEndpoint().c_str());
   AG_LOGI(TAG, "Post measures to %s", url);
   AG_LOGI(TAG, "Payload: %s", payload.c_str());
 
-  auto result = cell_->httpPost(url, payload); // TODO: Define timeouts
+  // Not even wake the radio while server asked to wait, caller keep the measures
+  if (isRateLimited()) {
+    AG_LOGW(TAG, "Post measures deferred, rate limited for another %lums",
+            (unsigned long)getRateLimitRemainingMs());
+    lastPostMeasuresSucceed = false;
+    return false;
+  }
+
+  _url.assign(url);
+
+  AG_HEAP_PROBE_BEGIN();
+  CellDeadlineScope deadline(cell_, operationBudgetMs);
+  lastUplinkStats = UplinkStats();
+  uint32_t startTime = MILLIS();
+  auto result = cell_->httpPost(_url, payload); // TODO: Define timeouts
+  // Request line and headers are built by the module, only url and body counted
+  lastUplinkStats.airtimeMs = MILLIS() - startTime;
+  lastUplinkStats.bytesSent = _url.length() + payload.length();
+  lastUplinkStats.transmissions = 1;
+  AG_HEAP_PROBE_END("httpPostMeasures");
+  AG_LOGI(TAG, "Post measures over %s took %dms", _httpsEnabled ? "https" : "http",
+          lastUplinkStats.airtimeMs);
+  lastDeadlineExceeded = (result.status == CellReturnStatus::DeadlineExceeded);
   if (result.status != CellReturnStatus::Ok) {
     AG_LOGE(TAG, "Module not return OK when call httpPost()");
     lastPostMeasuresSucceed = false;
@@ -178,14 +276,21 @@ bool AirgradientCellularClient::httpPostMeasures(const std::string &payload) {
   // Reset client ready state
   clientReady = true;
 
+  // Measures not accepted, caller keep them and post again once the wait is over
+  if (result.data.statusCode == 429 || result.data.statusCode == 503) {
+    startRateLimit(result.data.retryAfter);
+    lastPostMeasuresSucceed = false;
+    return false;
+  }
+
   // Response status check if post failed
-  if ((result.data.statusCode != 200) && (result.data.statusCode != 429) &&
-      (result.data.statusCode != 201)) {
+  if ((result.data.statusCode != 200) && (result.data.statusCode != 201)) {
     AG_LOGW(TAG, "Failed post measures to server with response code %d", result.data.statusCode);
     lastPostMeasuresSucceed = false;
     return false;
   }
 
+  clearRateLimit();
   lastPostMeasuresSucceed = true;
   AG_LOGI(TAG, "Success post measures to server with response code %d", result.data.statusCode);
 
@@ -193,31 +298,13 @@ bool AirgradientCellularClient::httpPostMeasures(const std::string &payload) {
 }
 
 bool AirgradientCellularClient::httpPostMeasures(const AirgradientPayload &payload) {
-  // Build payload using oss, easier to manage if there's an invalid value that should not included
-  std::ostringstream oss;
-
-  // Add interval at the first position
-  oss << payload.measureInterval;
-
-  if (payloadType == MAX_WITH_O3_NO2 || payloadType == MAX_WITHOUT_O3_NO2) {
-    auto *sensor = static_cast<std::vector<MaxSensorPayload> *>(payload.sensor);
-    for (auto it = sensor->begin(); it != sensor->end(); ++it) {
-      // Seperator between measures cycle
-      oss << ",";
-      // Serialize each measurement
-      _serialize(oss, it->rco2, it->particleCount003, it->pm01, it->pm25, it->pm10, it->tvocRaw,
-                 it->noxRaw, it->atmp, it->rhum, payload.signal, it->vBat, it->vPanel,
-                 it->o3WorkingElectrode, it->o3AuxiliaryElectrode, it->no2WorkingElectrode,
-                 it->no2AuxiliaryElectrode, it->afeTemp);
-    }
-  } else {
-    // TODO: Add for OneOpenAir payload
-  }
-
-  // Compile it
-  std::string toSend = oss.str();
+  AG_RESOURCE_SCOPE("CellClient::httpPostMeasures(payload)");
+  AG_TRACE_SPAN("client", "httpPostMeasures(payload)");
+  AG_HEAP_PROBE_BEGIN();
+  _buildMeasuresPayload(payload, _payload);
+  AG_HEAP_PROBE_END("httpPostMeasures payload");
 
-  return httpPostMeasures(toSend);
+  return httpPostMeasures(_payload);
 }
 
 bool AirgradientCellularClient::mqttConnect() { return mqttConnect(mqttDomain, mqttPort); }
@@ -245,9 +332,13 @@ bool AirgradientCellularClient::mqttConnect(const char *uri) {
 
 bool AirgradientCellularClient::mqttConnect(const std::string &host, int port, std::string username,
                                             std::string password) {
+  AG_RESOURCE_SCOPE("CellClient::mqttConnect");
+  AG_TRACE_SPAN("client", "mqttConnect");
 
   AG_LOGI(TAG, "Attempt connection to MQTT broker: %s:%d", host.c_str(), port);
+  CellDeadlineScope deadline(cell_, operationBudgetMs);
   auto result = cell_->mqttConnect(serialNumber, host, port, username, password);
+  lastDeadlineExceeded = (result == CellReturnStatus::DeadlineExceeded);
   if (result != CellReturnStatus::Ok) {
     AG_LOGE(TAG, "Failed connect to mqtt broker");
     return false;
@@ -258,7 +349,12 @@ bool AirgradientCellularClient::mqttConnect(const std::string &host, int port, s
 }
 
 bool AirgradientCellularClient::mqttDisconnect() {
-  if (cell_->mqttDisconnect() != CellReturnStatus::Ok) {
+  AG_RESOURCE_SCOPE("CellClient::mqttDisconnect");
+  AG_TRACE_SPAN("client", "mqttDisconnect");
+  CellDeadlineScope deadline(cell_, operationBudgetMs);
+  auto result = cell_->mqttDisconnect();
+  lastDeadlineExceeded = (result == CellReturnStatus::DeadlineExceeded);
+  if (result != CellReturnStatus::Ok) {
     AG_LOGE(TAG, "Failed disconnect from mqtt broker");
     return false;
   }
@@ -268,11 +364,21 @@ bool AirgradientCellularClient::mqttDisconnect() {
 }
 
 bool AirgradientCellularClient::mqttPublishMeasures(const std::string &payload) {
+  AG_RESOURCE_SCOPE("CellClient::mqttPublishMeasures");
+  AG_TRACE_SPAN("client", "mqttPublishMeasures");
   // TODO: Ensure mqtt connection
-  auto topic = buildMqttTopicPublishMeasures();
-  AG_LOGI(TAG, "Publish to %s", topic.c_str());
+  AG_LOGI(TAG, "Publish to %s", _topic.c_str());
   AG_LOGI(TAG, "Payload: %s", payload.c_str());
-  auto result = cell_->mqttPublish(topic, payload);
+  AG_HEAP_PROBE_BEGIN();
+  CellDeadlineScope deadline(cell_, operationBudgetMs);
+  lastUplinkStats = UplinkStats();
+  uint32_t startTime = MILLIS();
+  auto result = cell_->mqttPublish(_topic, payload);
+  lastUplinkStats.airtimeMs = MILLIS() - startTime;
+  lastUplinkStats.bytesSent = _topic.length() + payload.length();
+  lastUplinkStats.transmissions = 1;
+  AG_HEAP_PROBE_END("mqttPublishMeasures");
+  lastDeadlineExceeded = (result == CellReturnStatus::DeadlineExceeded);
   if (result != CellReturnStatus::Ok) {
     AG_LOGE(TAG, "Failed publish measures to mqtt server");
     return false;
@@ -283,9 +389,297 @@ bool AirgradientCellularClient::mqttPublishMeasures(const std::string &payload)
 }
 
 bool AirgradientCellularClient::mqttPublishMeasures(const AirgradientPayload &payload) {
+  AG_RESOURCE_SCOPE("CellClient::mqttPublishMeasures(payload)");
+  AG_TRACE_SPAN("client", "mqttPublishMeasures(payload)");
+  AG_HEAP_PROBE_BEGIN();
+  _buildMeasuresPayload(payload, _payload);
+  AG_HEAP_PROBE_END("mqttPublishMeasures payload");
+
+  return mqttPublishMeasures(_payload);
+}
+
+bool AirgradientCellularClient::coapPostMeasures(const std::string &payload) {
+  AG_RESOURCE_SCOPE("CellClient::coapPostMeasures");
+  AG_TRACE_SPAN("client", "coapPostMeasures");
+  AG_LOGI(TAG, "Post measures over CoAP to %s:%d",
+          datagramHost.empty() ? httpDomain.c_str() : datagramHost.c_str(), datagramPort);
+  AG_LOGI(TAG, "Payload: %s", payload.c_str());
+
+  AG_HEAP_PROBE_BEGIN();
+  CellDeadlineScope deadline(cell_, operationBudgetMs);
+  lastUplinkStats = UplinkStats();
+  uint32_t startTime = MILLIS();
+  bool success = _coapPost(payload);
+  lastUplinkStats.airtimeMs = MILLIS() - startTime;
+  AG_HEAP_PROBE_END("coapPostMeasures");
+  lastDeadlineExceeded = cell_->isDeadlineExceeded();
+  lastPostMeasuresSucceed = success;
+  AG_LOGI(TAG, "CoAP uplink sent %u bytes in %d datagrams, received %u bytes, airtime %ums",
+          lastUplinkStats.bytesSent, lastUplinkStats.transmissions,
+          lastUplinkStats.bytesReceived, lastUplinkStats.airtimeMs);
+  if (!success) {
+    AG_LOGE(TAG, "Failed post measures over CoAP");
+    return false;
+  }
+
+  AG_LOGI(TAG, "Success post measures over CoAP");
+  return true;
+}
+
+bool AirgradientCellularClient::coapPostMeasures(const AirgradientPayload &payload) {
+  AG_RESOURCE_SCOPE("CellClient::coapPostMeasures(payload)");
+  AG_TRACE_SPAN("client", "coapPostMeasures(payload)");
+  AG_HEAP_PROBE_BEGIN();
+  _buildMeasuresPayload(payload, _payload);
+  AG_HEAP_PROBE_END("coapPostMeasures payload");
+
+  return coapPostMeasures(_payload);
+}
+
+bool AirgradientCellularClient::udpSendMeasures(const std::string &payload) {
+  AG_RESOURCE_SCOPE("CellClient::udpSendMeasures");
+  AG_TRACE_SPAN("client", "udpSendMeasures");
+  AG_LOGI(TAG, "Send measures over UDP to %s:%d",
+          datagramHost.empty() ? httpDomain.c_str() : datagramHost.c_str(), datagramPort);
+  AG_LOGI(TAG, "Payload: %s", payload.c_str());
+
+  AG_HEAP_PROBE_BEGIN();
+  CellDeadlineScope deadline(cell_, operationBudgetMs);
+  lastUplinkStats = UplinkStats();
+  uint32_t startTime = MILLIS();
+
+  // Datagram is "<serial number>/<endpoint>" line followed by the same payload as http
+  _datagram.assign(serialNumber);
+  _datagram += '/';
+  _datagram += _getEndpoint();
+  _datagram += '\n';
+  _datagram += payload;
+  bool success = _ensureDatagramSocket() && _sendDatagram(_datagram.data(), _datagram.length());
+
+  lastUplinkStats.airtimeMs = MILLIS() - startTime;
+  AG_HEAP_PROBE_END("udpSendMeasures");
+  lastDeadlineExceeded = cell_->isDeadlineExceeded();
+  // Not acknowledged, only tell if module sent it
+  lastPostMeasuresSucceed = success;
+  AG_LOGI(TAG, "UDP uplink sent %u bytes, airtime %ums", lastUplinkStats.bytesSent,
+          lastUplinkStats.airtimeMs);
+  if (!success) {
+    AG_LOGE(TAG, "Failed send measures over UDP");
+    return false;
+  }
 
+  return true;
+}
+
+bool AirgradientCellularClient::udpSendMeasures(const AirgradientPayload &payload) {
+  AG_RESOURCE_SCOPE("CellClient::udpSendMeasures(payload)");
+  AG_TRACE_SPAN("client", "udpSendMeasures(payload)");
+  AG_HEAP_PROBE_BEGIN();
+  _buildMeasuresPayload(payload, _payload);
+  AG_HEAP_PROBE_END("udpSendMeasures payload");
+
+  return udpSendMeasures(_payload);
+}
+
+bool AirgradientCellularClient::_coapPost(const std::string &payload) {
+  if (!_ensureDatagramSocket()) {
+    return false;
+  }
+
+  // Block size must be power of two between 16 and 1024, szx = log2(size) - 4
+  uint8_t szx = 0;
+  while (szx < 6 && (16 << (szx + 1)) <= CONFIG_CELLULAR_COAP_BLOCK_SIZE) {
+    szx++;
+  }
+  size_t blockSize = 16 << szx;
+  bool blockwise = payload.length() > blockSize;
+
+  // Same token for every block of the request
+  uint8_t token[COAP_TOKEN_LENGTH];
+  uint32_t tokenValue = _coapToken++;
+  for (int i = 0; i < COAP_TOKEN_LENGTH; i++) {
+    token[i] = (tokenValue >> (i * 8)) & 0xFF;
+  }
+
+  const std::string endpoint = _getEndpoint();
+  size_t offset = 0;
+  uint32_t blockNum = 0;
+  do {
+    size_t chunk = payload.length() - offset;
+    if (blockwise && chunk > blockSize) {
+      chunk = blockSize;
+    }
+    bool more = (offset + chunk) < payload.length();
+
+    // POST /sensors/<serial number>/<endpoint>, same resource as http
+    uint16_t messageId = _coapMessageId++;
+    CoapWriter writer(_datagram);
+    writer.header(COAP_TYPE_CONFIRMABLE, COAP_CODE_POST, messageId, token, sizeof(token));
+    writer.option(COAP_OPTION_URI_PATH, "sensors");
+    writer.option(COAP_OPTION_URI_PATH, serialNumber.c_str());
+    writer.option(COAP_OPTION_URI_PATH, endpoint.c_str());
+    writer.uintOption(COAP_OPTION_CONTENT_FORMAT, COAP_CONTENT_FORMAT_TEXT);
+    if (blockwise) {
+      writer.uintOption(COAP_OPTION_BLOCK1, coapBlockValue(blockNum, more, szx));
+    }
+    writer.payload(payload.data() + offset, chunk);
+
+    CoapResponse response;
+    if (!_coapExchange(messageId, token, sizeof(token), response)) {
+      return false;
+    }
+
+    offset += chunk;
+    if (more) {
+      if (response.code != COAP_CODE_CONTINUE) {
+        AG_LOGW(TAG, "CoAP block %u not accepted, response code %d.%02d", blockNum,
+                COAP_CODE_CLASS(response.code), response.code & 0x1F);
+        return false;
+      }
+      // Server may ask for smaller block on its first response
+      if (response.hasBlock1 && (response.block1 & 0x07) < szx) {
+        szx = response.block1 & 0x07;
+        blockSize = 16 << szx;
+      }
+      blockNum = offset / blockSize;
+    } else if (COAP_CODE_CLASS(response.code) != 2) {
+      AG_LOGW(TAG, "Failed post measures over CoAP, response code %d.%02d",
+              COAP_CODE_CLASS(response.code), response.code & 0x1F);
+      return false;
+    }
+  } while (offset < payload.length());
+
+  return true;
+}
+
+bool AirgradientCellularClient::_coapExchange(uint16_t messageId, const uint8_t *token,
+                                              size_t tokenLength, CoapResponse &response) {
+  // Initial timeout randomized between ACK_TIMEOUT and ACK_TIMEOUT * 1.5, doubled every retry
+  uint32_t timeoutMs = COAP_ACK_TIMEOUT_MS + (esp_random() % (COAP_ACK_TIMEOUT_MS / 2));
+  bool acknowledged = false;
+  int attempt = 0;
+  uint32_t waitStartTime = 0;
+
+  while (true) {
+    if (!acknowledged) {
+      if (attempt > COAP_MAX_RETRANSMIT) {
+        AG_LOGW(TAG, "CoAP message %u not acknowledged", messageId);
+        return false;
+      }
+      if (attempt > 0) {
+        AG_LOGW(TAG, "CoAP message %u not acknowledged, retransmit", messageId);
+        timeoutMs *= 2;
+      }
+      if (!_sendDatagram(_datagram.data(), _datagram.length())) {
+        return false;
+      }
+      attempt++;
+      waitStartTime = MILLIS();
+    }
+
+    uint32_t elapsed = MILLIS() - waitStartTime;
+    uint32_t waitMs = acknowledged ? COAP_SEPARATE_RESPONSE_TIMEOUT_MS : timeoutMs;
+    if (elapsed >= waitMs) {
+      if (acknowledged) {
+        AG_LOGW(TAG, "Timeout wait CoAP separate response");
+        return false;
+      }
+      continue;
+    }
+    if (cell_->isDeadlineExceeded()) {
+      return false;
+    }
+
+    auto result = cell_->socketRecv(_datagramSocket, _datagramReceived,
+                                    sizeof(_datagramReceived), waitMs - elapsed);
+    if (result.status == CellReturnStatus::Timeout) {
+      continue;
+    } else if (result.status != CellReturnStatus::Ok) {
+      _closeDatagramSocket();
+      return false;
+    }
+    lastUplinkStats.bytesReceived += result.data;
+
+    if (!coapParse(_datagramReceived, result.data, response)) {
+      AG_LOGW(TAG, "Drop malformed CoAP datagram");
+      continue;
+    }
+
+    if (response.messageId == messageId && response.type == COAP_TYPE_RESET) {
+      AG_LOGW(TAG, "CoAP message %u rejected by server", messageId);
+      return false;
+    }
+
+    if (response.messageId == messageId && response.type == COAP_TYPE_ACKNOWLEDGEMENT) {
+      if (response.code != COAP_CODE_EMPTY) {
+        // Piggybacked response
+        return true;
+      }
+      // Response will follow in its own message, stop retransmit
+      acknowledged = true;
+      waitStartTime = MILLIS();
+      continue;
+    }
+
+    if (response.code != COAP_CODE_EMPTY && response.isToken(token, tokenLength) &&
+        (response.type == COAP_TYPE_CONFIRMABLE || response.type == COAP_TYPE_NON_CONFIRMABLE)) {
+      // Separate response, might come before its empty ACK
+      if (response.type == COAP_TYPE_CONFIRMABLE) {
+        char ack[4] = {static_cast<char>(0x40 | (COAP_TYPE_ACKNOWLEDGEMENT << 4)), COAP_CODE_EMPTY,
+                       static_cast<char>(response.messageId >> 8),
+                       static_cast<char>(response.messageId & 0xFF)};
+        _sendDatagram(ack, sizeof(ack));
+      }
+      return true;
+    }
+  }
+}
+
+bool AirgradientCellularClient::_sendDatagram(const char *data, size_t length) {
+  const std::string &host = datagramHost.empty() ? httpDomain : datagramHost;
+  lastUplinkStats.transmissions++;
+  auto result = cell_->socketSendTo(_datagramSocket, host, datagramPort, data, length);
+  if (result.status != CellReturnStatus::Ok) {
+    AG_LOGW(TAG, "Failed send datagram to %s:%d", host.c_str(), datagramPort);
+    _closeDatagramSocket();
+    return false;
+  }
+  lastUplinkStats.bytesSent += result.data;
+
+  return true;
+}
+
+bool AirgradientCellularClient::_ensureDatagramSocket() {
+  if (_datagramSocket >= 0) {
+    return true;
+  }
+
+  auto result = cell_->udpOpen();
+  if (result.status != CellReturnStatus::Ok) {
+    AG_LOGE(TAG, "Failed open UDP socket");
+    return false;
+  }
+  _datagramSocket = result.data;
+
+  return true;
+}
+
+void AirgradientCellularClient::_closeDatagramSocket() {
+  if (_datagramSocket < 0) {
+    return;
+  }
+  // Open again on next upload
+  cell_->socketClose(_datagramSocket);
+  _datagramSocket = -1;
+}
+
+void AirgradientCellularClient::_buildMeasuresPayload(const AirgradientPayload &payload,
+                                                      std::string &out) {
   // Build payload using oss, easier to manage if there's an invalid value that should not included
-  std::ostringstream oss;
+  // Stream write directly to output to reuse its capacity
+  out.clear();
+  StringAppendBuf buf(out);
+  std::ostream oss(&buf);
 
   // Add interval at the first position
   oss << payload.measureInterval;
@@ -304,14 +698,9 @@ bool AirgradientCellularClient::mqttPublishMeasures(const AirgradientPayload &pa
   } else {
     // TODO: Add for OneOpenAir payload
   }
-
-  // Compile it
-  std::string toSend = oss.str();
-
-  return mqttPublishMeasures(toSend);
 }
 
-void AirgradientCellularClient::_serialize(std::ostringstream &oss, int rco2, int particleCount003,
+void AirgradientCellularClient::_serialize(std::ostream &oss, int rco2, int particleCount003,
                                            float pm01, float pm25, float pm10, int tvoc, int nox,
                                            float atmp, float rhum, int signal, float vBat,
                                            float vPanel, float o3WorkingElectrode,
@@ -8,16 +8,27 @@
 #ifndef AIRGRADIENT_CELLULAR_CLIENT_H
 #define AIRGRADIENT_CELLULAR_CLIENT_H
 
-#include <sstream>
+#include <ostream>
 #ifndef ESP8266
 
 #include <string>
 
 #include "airgradientClient.h"
 #include "cellularModule.h"
+#include "coapMessage.h"
 
 #define DEFAULT_AIRGRADIENT_APN "iot.1nce.net"
 
+#ifndef CONFIG_CELLULAR_PAYLOAD_ARENA_SIZE
+// This configuration define by kconfig
+#define CONFIG_CELLULAR_PAYLOAD_ARENA_SIZE 2048
+#endif
+
+#ifndef CONFIG_CELLULAR_COAP_BLOCK_SIZE
+// This configuration define by kconfig
+#define CONFIG_CELLULAR_COAP_BLOCK_SIZE 512
+#endif
+
 class AirgradientCellularClient : public AirgradientClient {
 private:
   const char *const TAG = "AgCellClient";
@@ -25,29 +36,57 @@ private:
   std::string _iccid = "";
   CellularModule *cell_ = nullptr;
   int _networkRegistrationTimeoutMs = (3 * 60000);
+  // Reused for every request, capacity reserved on begin() when static buffers enabled
+  std::string _url;
+  std::string _topic;
+  std::string _payload;
+  // CoAP and UDP uplink, socket kept open between uploads
+  std::string _datagram;
+  int _datagramSocket = -1;
+  uint16_t _coapMessageId = 0;
+  uint32_t _coapToken = 0;
+  char _datagramReceived[128];
+  bool _httpsEnabled = false;
 
 public:
   AirgradientCellularClient(CellularModule *cellularModule);
-  ~AirgradientCellularClient() {};
-
-  bool begin(std::string sn, PayloadType pt);
-  void setAPN(const std::string &apn);
-  void setNetworkRegistrationTimeoutMs(int timeoutMs);
-  std::string getICCID();
-  bool ensureClientConnection(bool reset);
-  std::string httpFetchConfig();
-  bool httpPostMeasures(const std::string &payload);
-  bool httpPostMeasures(const AirgradientPayload &payload);
-  bool mqttConnect();
-  bool mqttConnect(const char *uri);
-  bool mqttConnect(const std::string &host, int port, std::string username = "", std::string password = "");
-  bool mqttDisconnect();
-  bool mqttPublishMeasures(const std::string &payload);
-  bool mqttPublishMeasures(const AirgradientPayload &payload);
+  ~AirgradientCellularClient() override {};
+
+  bool begin(std::string sn, PayloadType pt) override;
+  void setAPN(const std::string &apn) override;
+  void setNetworkRegistrationTimeoutMs(int timeoutMs) override;
+  std::string getICCID() override;
+  bool ensureClientConnection(bool reset) override;
+  std::string httpFetchConfig() override;
+  bool httpPostMeasures(const std::string &payload) override;
+  bool httpPostMeasures(const AirgradientPayload &payload) override;
+  bool mqttConnect() override;
+  bool mqttConnect(const char *uri) override;
+  bool mqttConnect(const std::string &host, int port, std::string username = "", std::string password = "") override;
+  bool mqttDisconnect() override;
+  bool mqttPublishMeasures(const std::string &payload) override;
+  bool mqttPublishMeasures(const AirgradientPayload &payload) override;
+  bool coapPostMeasures(const std::string &payload) override;
+  bool coapPostMeasures(const AirgradientPayload &payload) override;
+  bool udpSendMeasures(const std::string &payload) override;
+  bool udpSendMeasures(const AirgradientPayload &payload) override;
+
+  /**
+   * @brief Fetch configuration and post measures over https, server verified against
+   * AirGradient root CA. Module keep the certificate and SSL context between requests
+   */
+  void setHttpsEnabled(bool enabled);
 
 private:
   std::string _getEndpoint();
-  void _serialize(std::ostringstream &oss, int rco2, int particleCount003, float pm01, float pm25,
+  void _buildMeasuresPayload(const AirgradientPayload &payload, std::string &out);
+  bool _coapPost(const std::string &payload);
+  bool _coapExchange(uint16_t messageId, const uint8_t *token, size_t tokenLength,
+                     CoapResponse &response);
+  bool _sendDatagram(const char *data, size_t length);
+  bool _ensureDatagramSocket();
+  void _closeDatagramSocket();
+  void _serialize(std::ostream &oss, int rco2, int particleCount003, float pm01, float pm25,
                   float pm10, int tvoc, int nox, float atmp, float rhum, int signal,
                   float vBat = -1.0f, float vPanel = -1.0f, float o3WorkingElectrode = -1.0f,
                   float o3AuxiliaryElectrode = -1.0f, float no2WorkingElectrode = -1.0f,
@@ -7,8 +7,27 @@
 
 #include "airgradientClient.h"
 #include "common.h"
+#include "agLogger.h"
+#include <cstdlib>
 #include <string>
 
+#ifndef ESP8266
+#include "esp_random.h"
+#include "nvs.h"
+
+#define CONFIG_CACHE_NVS_NAMESPACE "agclient"
+#define CONFIG_CACHE_NVS_KEY "config"
+#define CONFIG_CACHE_NVS_ETAG_KEY "configEtag"
+#else
+#include <Arduino.h>
+#endif
+
+// Wait when server did not provide Retry-After, doubled up to the maximum
+#define RATE_LIMIT_DEFAULT_MS 60000
+#define RATE_LIMIT_MAX_MS (60 * 60000)
+
+static const char *const TAG = "AgClient";
+
 bool AirgradientClient::begin(std::string sn, PayloadType pt) { return true; }
 
 void AirgradientClient::setAPN(const std::string &apn) {}
@@ -48,6 +67,14 @@ bool AirgradientClient::mqttPublishMeasures(const std::string &payload) { return
 
 bool AirgradientClient::mqttPublishMeasures(const AirgradientPayload &payload) { return false; }
 
+bool AirgradientClient::coapPostMeasures(const std::string &payload) { return false; }
+
+bool AirgradientClient::coapPostMeasures(const AirgradientPayload &payload) { return false; }
+
+bool AirgradientClient::udpSendMeasures(const std::string &payload) { return false; }
+
+bool AirgradientClient::udpSendMeasures(const AirgradientPayload &payload) { return false; }
+
 void AirgradientClient::resetFetchConfigurationStatus() { lastFetchConfigSucceed = true; }
 
 void AirgradientClient::resetPostMeasuresStatus() { lastPostMeasuresSucceed = true; }
@@ -58,18 +85,262 @@ bool AirgradientClient::isLastPostMeasureSucceed() { return lastPostMeasuresSucc
 
 bool AirgradientClient::isRegisteredOnAgServer() { return registeredOnAgServer; }
 
+void AirgradientClient::setOperationBudgetMs(uint32_t budgetMs) { operationBudgetMs = budgetMs; }
+
+bool AirgradientClient::isLastOperationDeadlineExceeded() { return lastDeadlineExceeded; }
+
+void AirgradientClient::setUplinkProtocol(UplinkProtocol protocol) { uplinkProtocol = protocol; }
+
+AirgradientClient::UplinkProtocol AirgradientClient::getUplinkProtocol() { return uplinkProtocol; }
+
+bool AirgradientClient::postMeasures(const AirgradientPayload &payload) {
+  switch (uplinkProtocol) {
+  case UPLINK_MQTT:
+    return mqttPublishMeasures(payload);
+  case UPLINK_COAP:
+    return coapPostMeasures(payload);
+  case UPLINK_UDP:
+    return udpSendMeasures(payload);
+  case UPLINK_HTTP:
+  default:
+    return httpPostMeasures(payload);
+  }
+}
+
+void AirgradientClient::setDatagramServer(const std::string &host, int port) {
+  datagramHost = host;
+  datagramPort = port;
+}
+
+AirgradientClient::UplinkStats AirgradientClient::getLastUplinkStats() { return lastUplinkStats; }
+
+bool AirgradientClient::isConfigChanged() { return configChanged; }
+
+bool AirgradientClient::fetchRemoteConfig(RemoteConfig &config) {
+  std::string body = httpFetchConfig();
+  if (body.empty()) {
+    return false;
+  }
+
+  if (remoteConfigParsed && !configChanged) {
+    config = remoteConfig;
+    config.changed = 0;
+    return true;
+  }
+
+  RemoteConfig parsed;
+  if (!remoteConfigParse(body.c_str(), body.length(), parsed)) {
+    AG_LOGE(TAG, "Failed parse configuration from server");
+    return false;
+  }
+  parsed.changed = remoteConfigParsed ? remoteConfigDiff(parsed, remoteConfig) : parsed.present;
+  AG_LOGI(TAG, "Configuration hash %08lx, changed fields 0x%04lx", (unsigned long)parsed.hash(),
+          (unsigned long)parsed.changed);
+
+  remoteConfig = parsed;
+  remoteConfigParsed = true;
+  config = parsed;
+  return true;
+}
+
+bool AirgradientClient::isRateLimited() { return getRateLimitRemainingMs() > 0; }
+
+uint32_t AirgradientClient::getRateLimitRemainingMs() {
+#ifndef ESP8266
+  if (rateLimitWindowMs == 0) {
+    return 0;
+  }
+  uint32_t elapsed = MILLIS() - rateLimitStartMs;
+  if (elapsed >= rateLimitWindowMs) {
+    rateLimitWindowMs = 0;
+    return 0;
+  }
+  return rateLimitWindowMs - elapsed;
+#else
+  return 0;
+#endif
+}
+
+void AirgradientClient::startRateLimit(const char *retryAfter) {
+#ifndef ESP8266
+  // HTTP-date form is not supported, no wall clock to compare with
+  uint32_t windowMs = 0;
+  if (retryAfter != nullptr && *retryAfter >= '0' && *retryAfter <= '9') {
+    // Clamp before scaling, large value would wrap to a short or zero window
+    unsigned long seconds = strtoul(retryAfter, nullptr, 10);
+    if (seconds > RATE_LIMIT_MAX_MS / 1000) {
+      seconds = RATE_LIMIT_MAX_MS / 1000;
+    }
+    windowMs = seconds * 1000;
+  }
+  if (windowMs == 0) {
+    rateLimitBackoffMs =
+        rateLimitBackoffMs == 0 ? RATE_LIMIT_DEFAULT_MS : rateLimitBackoffMs * 2;
+    if (rateLimitBackoffMs > RATE_LIMIT_MAX_MS) {
+      rateLimitBackoffMs = RATE_LIMIT_MAX_MS;
+    }
+    windowMs = rateLimitBackoffMs;
+  }
+  if (windowMs > RATE_LIMIT_MAX_MS) {
+    windowMs = RATE_LIMIT_MAX_MS;
+  }
+
+  rateLimitStartMs = MILLIS();
+  rateLimitWindowMs = windowMs;
+  AG_LOGW(TAG, "Server rate limited posts, hold them for %lus", (unsigned long)(windowMs / 1000));
+#endif
+}
+
+void AirgradientClient::clearRateLimit() {
+  rateLimitWindowMs = 0;
+  rateLimitBackoffMs = 0;
+}
+
+void AirgradientClient::setUploadSlotting(uint32_t intervalMs, uint32_t jitterMs) {
+  uploadSlotIntervalMs = intervalMs;
+  uploadSlotJitterMs = jitterMs;
+  uploadSlotCount = 0;
+}
+
+// FNV-1a, spread evenly even for serial numbers that only differ in last characters
+static uint32_t serialHash(const std::string &serialNumber) {
+  uint32_t hash = 2166136261UL;
+  for (char c : serialNumber) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 16777619UL;
+  }
+  return hash;
+}
+
+uint32_t AirgradientClient::getUploadSlotOffsetMs() {
+  if (uploadSlotIntervalMs == 0) {
+    return 0;
+  }
+
+  return serialHash(serialNumber) % uploadSlotIntervalMs;
+}
+
+static uint32_t uploadJitterMs(const std::string &serialNumber, uint32_t jitterMs,
+                               uint32_t count) {
+  if (jitterMs == 0) {
+    return 0;
+  }
+
+#ifndef ESP8266
+  return esp_random() % (jitterMs + 1);
+#else
+  // No hardware random here, differ per device and per upload is enough to spread them
+  uint32_t hash = serialHash(serialNumber);
+  hash = (hash ^ count) * 16777619UL;
+  hash ^= hash >> 15;
+  return hash % (jitterMs + 1);
+#endif
+}
+
+uint32_t AirgradientClient::getNextUploadDelayMs() {
+  if (uploadSlotIntervalMs == 0) {
+    return 0;
+  }
+
+#ifndef ESP8266
+  uint32_t now = MILLIS();
+#else
+  uint32_t now = millis();
+#endif
+  uint32_t count = uploadSlotCount++;
+  if (count == 0) {
+    // Slot grid anchored at first call
+    uint32_t offset = getUploadSlotOffsetMs();
+    uploadSlotNextMs = now + offset;
+    return offset;
+  }
+
+  // Advance to the first slot after now, jitter is added on top and never moves the grid
+  int32_t untilSlot = static_cast<int32_t>(uploadSlotNextMs - now);
+  if (untilSlot <= 0) {
+    uint32_t late = static_cast<uint32_t>(-untilSlot);
+    uploadSlotNextMs += (late / uploadSlotIntervalMs + 1) * uploadSlotIntervalMs;
+  }
+  uint32_t delay = uploadSlotNextMs - now;
+
+  return delay + uploadJitterMs(serialNumber, uploadSlotJitterMs, count);
+}
+
+void AirgradientClient::loadConfigCache() {
+  if (configCacheLoaded) {
+    return;
+  }
+  configCacheLoaded = true;
+
+#ifndef ESP8266
+  nvs_handle_t handle;
+  if (nvs_open(CONFIG_CACHE_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+    return;
+  }
+
+  // Configuration only usable together with its ETag
+  size_t configLength = 0;
+  size_t etagLength = 0;
+  if (nvs_get_str(handle, CONFIG_CACHE_NVS_KEY, nullptr, &configLength) == ESP_OK &&
+      nvs_get_str(handle, CONFIG_CACHE_NVS_ETAG_KEY, nullptr, &etagLength) == ESP_OK &&
+      configLength > 1) {
+    // Length include NUL terminator
+    cachedConfig.resize(configLength);
+    cachedConfigEtag.resize(etagLength);
+    nvs_get_str(handle, CONFIG_CACHE_NVS_KEY, &cachedConfig[0], &configLength);
+    nvs_get_str(handle, CONFIG_CACHE_NVS_ETAG_KEY, &cachedConfigEtag[0], &etagLength);
+    cachedConfig.resize(configLength - 1);
+    cachedConfigEtag.resize(etagLength - 1);
+    AG_LOGI(TAG, "Loaded cached configuration (%d) with ETag %s", cachedConfig.length(),
+            cachedConfigEtag.c_str());
+  }
+  nvs_close(handle);
+#endif
+}
+
+void AirgradientClient::updateConfigCache(const std::string &config, const std::string &etag) {
+  configChanged = (config != cachedConfig);
+  if (!configChanged && etag == cachedConfigEtag) {
+    return;
+  }
+  cachedConfig = config;
+  cachedConfigEtag = etag;
+
+#ifndef ESP8266
+  // Flash written only when configuration or its ETag changed
+  nvs_handle_t handle;
+  if (nvs_open(CONFIG_CACHE_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+    AG_LOGW(TAG, "Failed open nvs to store configuration");
+    return;
+  }
+  esp_err_t err = nvs_set_str(handle, CONFIG_CACHE_NVS_KEY, cachedConfig.c_str());
+  if (err == ESP_OK) {
+    err = nvs_set_str(handle, CONFIG_CACHE_NVS_ETAG_KEY, cachedConfigEtag.c_str());
+  }
+  if (err == ESP_OK) {
+    err = nvs_commit(handle);
+  }
+  nvs_close(handle);
+  if (err != ESP_OK) {
+    AG_LOGW(TAG, "Failed store configuration, error %d", err);
+  }
+#endif
+}
+
 std::string AirgradientClient::buildFetchConfigUrl(bool useHttps) {
-  // http://hw.airgradient.com/sensors/airgradient:aabbccddeeff/one/config
   char url[80] = {0};
+  buildFetchConfigUrl(url, sizeof(url), useHttps);
+  return std::string(url);
+}
+
+void AirgradientClient::buildFetchConfigUrl(char *url, size_t size, bool useHttps) {
+  // http://hw.airgradient.com/sensors/airgradient:aabbccddeeff/one/config
   if (useHttps) {
-    sprintf(url, "https://%s/sensors/airgradient:%s/one/config", httpDomain.c_str(),
-            serialNumber.c_str());
+    snprintf(url, size, "https://%s/sensors/airgradient:%s/one/config", httpDomain.c_str(),
+             serialNumber.c_str());
   } else {
-    sprintf(url, "http://%s/sensors/airgradient:%s/one/config", httpDomain.c_str(),
-            serialNumber.c_str());
+    snprintf(url, size, "http://%s/sensors/airgradient:%s/one/config", httpDomain.c_str(),
+             serialNumber.c_str());
   }
-
-  return std::string(url);
 }
 
 std::string AirgradientClient::buildPostMeasuresUrl(bool useHttps) {
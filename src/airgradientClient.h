@@ -9,6 +9,8 @@
 #define AIRGRADIENT_CLIENT_H
 
 #include "common.h"
+#include "remoteConfig.h"
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -52,6 +54,22 @@ public:
     void *sensor;
   };
 
+  // Transport used by postMeasures()
+  enum UplinkProtocol {
+    UPLINK_HTTP = 0,
+    UPLINK_MQTT,
+    UPLINK_COAP, // confirmable CoAP POST over UDP, block-wise for large payload
+    UPLINK_UDP   // single datagram, not acknowledged
+  };
+
+  // Cost of the last measures upload
+  struct UplinkStats {
+    uint32_t bytesSent = 0;     // handed to the module, retransmission included
+    uint32_t bytesReceived = 0;
+    uint32_t airtimeMs = 0;     // first send until final response, radio kept active meanwhile
+    int transmissions = 0;      // request or datagram sent
+  };
+
   virtual bool begin(std::string sn, PayloadType pt);
   virtual void setAPN(const std::string &apn);
   virtual void setNetworkRegistrationTimeoutMs(int timeoutMs);
@@ -66,6 +84,10 @@ public:
   virtual bool mqttDisconnect();
   virtual bool mqttPublishMeasures(const std::string &payload);
   virtual bool mqttPublishMeasures(const AirgradientPayload &payload);
+  virtual bool coapPostMeasures(const std::string &payload);
+  virtual bool coapPostMeasures(const AirgradientPayload &payload);
+  virtual bool udpSendMeasures(const std::string &payload);
+  virtual bool udpSendMeasures(const AirgradientPayload &payload);
 
   // Implemented on base class, not override function
 
@@ -84,6 +106,100 @@ public:
   bool isLastPostMeasureSucceed();
   bool isRegisteredOnAgServer();
 
+  /**
+   * @brief Bound each following client operation, including its retries, to finish within budget
+   *
+   * @param budgetMs time budget per operation in ms, 0 for no bound
+   */
+  void setOperationBudgetMs(uint32_t budgetMs);
+
+  /**
+   * @brief Check if last client operation failed because its budget was spent
+   */
+  bool isLastOperationDeadlineExceeded();
+
+  void setUplinkProtocol(UplinkProtocol protocol);
+  UplinkProtocol getUplinkProtocol();
+
+  /**
+   * @brief Send measures with protocol set by setUplinkProtocol(). For MQTT, mqttConnect() first
+   */
+  bool postMeasures(const AirgradientPayload &payload);
+
+  /**
+   * @brief set server of CoAP and UDP uplink
+   *
+   * @param host server host, empty to use http domain
+   * @param port server UDP port
+   */
+  void setDatagramServer(const std::string &host, int port);
+  UplinkStats getLastUplinkStats();
+
+  /**
+   * @brief Check if configuration returned by last successful httpFetchConfig() differ from the
+   * one before, false when server answered not modified. Parse it again only if true
+   */
+  bool isConfigChanged();
+
+  /**
+   * @brief Fetch configuration with httpFetchConfig() and parse only the fields firmware use.
+   * Body is parsed again only when it changed, config.changed tell which fields differ since
+   * previous fetch (every received field on first fetch after boot)
+   *
+   * @param config where parsed configuration will placed
+   * @return true if configuration successfully fetched and parsed
+   */
+  bool fetchRemoteConfig(RemoteConfig &config);
+
+  /**
+   * @brief Check if server answered 429 or 503 and the time it asked to wait is not over. Until
+   * then httpPostMeasures() return false without sending anything, keep the measures and post
+   * them together once it is over
+   */
+  bool isRateLimited();
+
+  /**
+   * @brief Time left before posting is allowed again in ms, 0 if not rate limited
+   */
+  uint32_t getRateLimitRemainingMs();
+
+  /**
+   * @brief Spread uploads of devices powered on together over the measure interval. The device
+   * slot is derived from serial number so it is the same across reboot. Client never waits for
+   * it, firmware schedule uploads with getNextUploadDelayMs()
+   *
+   * @param intervalMs interval to spread uploads over, usually the measure interval. 0 to disable
+   * @param jitterMs maximum random delay added before each following upload
+   */
+  void setUploadSlotting(uint32_t intervalMs, uint32_t jitterMs = 0);
+
+  /**
+   * @brief Offset of the device slot within the interval in ms
+   */
+  uint32_t getUploadSlotOffsetMs();
+
+  /**
+   * @brief How long firmware should wait before the next upload (configuration fetch, post or
+   * MQTT publish). First call return the slot offset and anchor the slot grid, following calls
+   * return time to the next slot on the grid plus a fresh random jitter, so jitter never
+   * accumulate into the schedule and devices do not line up again after a common outage. Missed
+   * slots are skipped. On ESP8266 the jitter is derived from serial number and upload count
+   * instead of hardware random
+   *
+   * ```
+   * client.setUploadSlotting(60000, 5000);
+   * nextUploadAt = millis() + client.getNextUploadDelayMs();
+   * ...
+   * if ((int32_t)(millis() - nextUploadAt) >= 0) {
+   *   client.httpPostMeasures(...);
+   *   nextUploadAt = millis() + client.getNextUploadDelayMs();
+   * }
+   * ```
+   *
+   * @return delay in ms, 0 if slotting disabled
+   */
+  uint32_t getNextUploadDelayMs();
+
 protected:
   PayloadType payloadType;
   std::string httpDomain = AIRGRADIENT_HTTP_DOMAIN;
@@ -126,13 +242,62 @@ protected:
       "-----END CERTIFICATE-----\n";
 
   std::string buildFetchConfigUrl(bool useHttps = false);
+  void buildFetchConfigUrl(char *url, size_t size, bool useHttps = false);
   std::string buildPostMeasuresUrl(bool useHttps = false);
   std::string buildMqttTopicPublishMeasures();
 
+  /**
+   * @brief Load configuration and its ETag kept by previous fetch, once
+   */
+  void loadConfigCache();
+
+  /**
+   * @brief Keep fetched configuration and its ETag, update configChanged
+   *
+   * @param config configuration body
+   * @param etag ETag response header, empty if not provided by server
+   */
+  void updateConfigCache(const std::string &config, const std::string &etag);
+
+  /**
+   * @brief Hold posts after server answered 429 or 503. Without Retry-After, the wait doubles
+   * on each consecutive answer
+   *
+   * @param retryAfter Retry-After response header in seconds, nullptr or empty if not provided
+   */
+  void startRateLimit(const char *retryAfter);
+
+  /**
+   * @brief Server accepted a post, forget previous wait
+   */
+  void clearRateLimit();
+
   std::string serialNumber;
   bool lastPostMeasuresSucceed = true;
   bool lastFetchConfigSucceed = true;
   bool registeredOnAgServer = true;
   bool clientReady = true;
+  uint32_t operationBudgetMs = 0;
+  bool lastDeadlineExceeded = false;
+  UplinkProtocol uplinkProtocol = UPLINK_HTTP;
+  std::string datagramHost;
+  int datagramPort = 5683; // CoAP default port
+  UplinkStats lastUplinkStats;
+  // Last configuration fetched, served again when server answer 304 Not Modified
+  std::string cachedConfig;
+  std::string cachedConfigEtag;
+  bool configCacheLoaded = false;
+  bool configChanged = false;
+  // Last parsed configuration, returned as is while body does not change
+  RemoteConfig remoteConfig;
+  bool remoteConfigParsed = false;
+  // Posts held from rateLimitStartMs for rateLimitWindowMs, 0 when not limited
+  uint32_t rateLimitStartMs = 0;
+  uint32_t rateLimitWindowMs = 0;
+  uint32_t rateLimitBackoffMs = 0;
+  uint32_t uploadSlotIntervalMs = 0;
+  uint32_t uploadSlotJitterMs = 0;
+  uint32_t uploadSlotCount = 0;
+  uint32_t uploadSlotNextMs = 0; // next slot on the grid, kept close to now so it survive wrap
 };
 #endif // AIRGRADIENT_CLIENT_H
@@ -42,7 +42,11 @@
 
 #include "airgradientWifiClient.h"
 #include "agLogger.h"
+#include "agResourceMonitor.h"
 #include "ArduinoJson.h"
+#include <algorithm>
+#include <cstring>
+#include <strings.h>
 
 #ifdef ARDUINO
 #include <HTTPClient.h>
@@ -51,32 +55,37 @@
 #endif
 
 bool AirgradientWifiClient::begin(std::string sn, PayloadType pt) {
+  AG_RESOURCE_SCOPE("WifiClient::begin");
   serialNumber = sn;
   payloadType = pt;
   return true;
 }
 
 std::string AirgradientWifiClient::httpFetchConfig() {
+  AG_RESOURCE_SCOPE("WifiClient::httpFetchConfig");
   std::string url = buildFetchConfigUrl(false);
   AG_LOGI(TAG, "Fetch configuration from %s", url.c_str());
 
-  // Perform HTTP GET
+  // Perform HTTP GET, server answer 304 without body when cached configuration still valid
+  loadConfigCache();
   int responseCode;
   std::string responseBody;
-  if (_httpGet(url, responseCode, responseBody) == false) {
+  std::string etag;
+  if (_httpGet(url, responseCode, responseBody, cachedConfigEtag.c_str(), &etag) == false) {
     lastFetchConfigSucceed = false;
     return {};
   }
 
+  if (responseCode == 304 && !cachedConfig.empty()) {
+    AG_LOGI(TAG, "Configuration not modified, use cached configuration");
+    registeredOnAgServer = true;
+    lastFetchConfigSucceed = true;
+    configChanged = false;
+    return cachedConfig;
+  }
+
   // Define result by response code
-  if (responseCode != 200) {
-    // client.end();
-    AG_LOGE(TAG, "Failed fetch configuration from server with return code %d", responseCode);
-    // Return code 400 means device not registered on ag server
-    if (responseCode == 400) {
-      registeredOnAgServer = false;
-    }
-    lastFetchConfigSucceed = false;
+  if (!_handleFetchConfigResponseCode(responseCode)) {
     return {};
   }
 
@@ -87,7 +96,12 @@ std::string AirgradientWifiClient::httpFetchConfig() {
     return responseBody;
   }
 
-  AG_LOGI(TAG, "Received configuration: (%d) %s", responseBody.length(), responseBody.c_str());
+  updateConfigCache(responseBody, etag);
+  if (configChanged) {
+    AG_LOGI(TAG, "Received configuration: (%d) %s", responseBody.length(), responseBody.c_str());
+  } else {
+    AG_LOGI(TAG, "Received configuration is the same as cached one");
+  }
 
   // Set success state flag
   registeredOnAgServer = true;
@@ -96,24 +110,129 @@ std::string AirgradientWifiClient::httpFetchConfig() {
 
   return responseBody;
 }
+
+bool AirgradientWifiClient::httpFetchConfig(JsonDocument &config) {
+  AG_RESOURCE_SCOPE("WifiClient::httpFetchConfig(json)");
+  std::string url = buildFetchConfigUrl(false);
+  AG_LOGI(TAG, "Fetch configuration from %s", url.c_str());
+
+  // Deserialize while the body is being received
+  int responseCode;
+  DeserializationError err;
+  int bodyLen = 0;
+  bool success = _httpGet(url, responseCode, [&](BodyReader &reader) {
+    if (responseCode != 200) {
+      return true;
+    }
+    err = deserializeJson(config, reader);
+    bodyLen = reader.totalRead();
+    return !err;
+  });
+
+  if (!success) {
+    if (err) {
+      AG_LOGE(TAG, "Failed parse configuration from server: %s", err.c_str());
+    }
+    lastFetchConfigSucceed = false;
+    return false;
+  }
+
+  // Define result by response code
+  if (!_handleFetchConfigResponseCode(responseCode)) {
+    return false;
+  }
+
+  // Not compared against cache, caller always get a freshly parsed configuration
+  registeredOnAgServer = true;
+  lastFetchConfigSucceed = true;
+  configChanged = true;
+  AG_LOGI(TAG, "Success fetch and parse configuration from server (%d bytes)", bodyLen);
+
+  return true;
+}
+
+bool AirgradientWifiClient::httpFetchConfig(const BodySink &sink) {
+  AG_RESOURCE_SCOPE("WifiClient::httpFetchConfig(sink)");
+  std::string url = buildFetchConfigUrl(false);
+  AG_LOGI(TAG, "Fetch configuration from %s", url.c_str());
+
+  int responseCode;
+  int bodyLen = 0;
+  bool success = _httpGet(url, responseCode, [&](BodyReader &reader) {
+    if (responseCode != 200) {
+      return true;
+    }
+    char chunk[128];
+    size_t len;
+    while ((len = reader.readBytes(chunk, sizeof(chunk))) > 0) {
+      if (!sink(chunk, len)) {
+        AG_LOGW(TAG, "Body sink stop receiving configuration");
+        return false;
+      }
+    }
+    bodyLen = reader.totalRead();
+    return true;
+  });
+
+  if (!success) {
+    lastFetchConfigSucceed = false;
+    return false;
+  }
+
+  // Define result by response code
+  if (!_handleFetchConfigResponseCode(responseCode)) {
+    return false;
+  }
+
+  if (bodyLen == 0) {
+    AG_LOGW(TAG, "Success fetch configuration from server but somehow body is empty");
+    lastFetchConfigSucceed = false;
+    return false;
+  }
+
+  registeredOnAgServer = true;
+  lastFetchConfigSucceed = true;
+  configChanged = true;
+  AG_LOGI(TAG, "Success fetch configuration from server (%d bytes)", bodyLen);
+
+  return true;
+}
+
 bool AirgradientWifiClient::httpPostMeasures(const std::string &payload) {
+  AG_RESOURCE_SCOPE("WifiClient::httpPostMeasures");
   std::string url = buildPostMeasuresUrl(false);
   AG_LOGI(TAG, "Post measures to %s", url.c_str());
   AG_LOGI(TAG, "Payload: %s", payload.c_str());
 
+  // Caller keep the measures while server asked to wait
+  if (isRateLimited()) {
+    AG_LOGW(TAG, "Post measures deferred, rate limited for another %lums",
+            (unsigned long)getRateLimitRemainingMs());
+    lastPostMeasuresSucceed = false;
+    return false;
+  }
+
   // Perform HTTP POST
   int responseCode;
-  if (_httpPost(url, payload, responseCode) == false) {
+  std::string retryAfter;
+  if (_httpPost(url, payload, responseCode, retryAfter) == false) {
+    lastPostMeasuresSucceed = false;
+    return false;
+  }
+
+  if (responseCode == 429 || responseCode == 503) {
+    startRateLimit(retryAfter.c_str());
     lastPostMeasuresSucceed = false;
     return false;
   }
 
-  if ((responseCode != 200) && (responseCode != 429)) {
+  if (responseCode != 200) {
     AG_LOGE(TAG, "Failed post measures to server with response code %d", responseCode);
     lastPostMeasuresSucceed = false;
     return false;
   }
 
+  clearRateLimit();
   lastPostMeasuresSucceed = true;
   AG_LOGI(TAG, "Success post measures to server with response code %d", responseCode);
 
@@ -121,6 +240,7 @@ bool AirgradientWifiClient::httpPostMeasures(const std::string &payload) {
 }
 
 bool AirgradientWifiClient::httpPostMeasures(const AirgradientPayload &payload) {
+  AG_RESOURCE_SCOPE("WifiClient::httpPostMeasures(payload)");
   JsonDocument jdoc;
   jdoc[JSON_PROP_SIGNAL] = payload.signal;
 
@@ -143,29 +263,97 @@ bool AirgradientWifiClient::httpPostMeasures(const AirgradientPayload &payload)
 }
 
 bool AirgradientWifiClient::_httpGet(const std::string &url, int &responseCode,
-                                     std::string &responseBody) {
+                                     std::string &responseBody, const char *ifNoneMatch,
+                                     std::string *etag) {
+  responseBody.clear();
+  return _httpGet(
+      url, responseCode,
+      [&responseBody](BodyReader &reader) {
+        char chunk[128];
+        size_t len;
+        while ((len = reader.readBytes(chunk, sizeof(chunk))) > 0) {
+          responseBody.append(chunk, len);
+        }
+        return true;
+      },
+      ifNoneMatch, etag);
+}
+
+#ifndef ARDUINO
+static esp_err_t captureEtag(esp_http_client_event_t *event) {
+  if (event->event_id == HTTP_EVENT_ON_HEADER && event->user_data != nullptr &&
+      strcasecmp(event->header_key, "ETag") == 0) {
+    static_cast<std::string *>(event->user_data)->assign(event->header_value);
+  }
+  return ESP_OK;
+}
+
+static esp_err_t captureRetryAfter(esp_http_client_event_t *event) {
+  if (event->event_id == HTTP_EVENT_ON_HEADER &&
+      strcasecmp(event->header_key, "Retry-After") == 0) {
+    static_cast<std::string *>(event->user_data)->assign(event->header_value);
+  }
+  return ESP_OK;
+}
+#endif
+
+bool AirgradientWifiClient::_httpGet(const std::string &url, int &responseCode,
+                                     const BodyConsumer &consumer, const char *ifNoneMatch,
+                                     std::string *etag) {
+  responseCode = -1;
+  if (etag != nullptr) {
+    etag->clear();
+  }
 #ifdef ARDUINO
   // Init http client
   HTTPClient client;
   client.setConnectTimeout(timeoutMs); // Set timeout when establishing connection to server
   client.setTimeout(timeoutMs);        // Timeout when waiting for response from AG server
+  // HTTP/1.0 to prevent chunked transfer encoding, so body can be read directly from the stream
+  client.useHTTP10(true);
   // By default, airgradient using https
   if (client.begin(String(url.c_str()), AG_SERVER_ROOT_CA) == false) {
     AG_LOGE(TAG, "Failed begin HTTPClient using TLS");
     return false;
   }
+  if (ifNoneMatch != nullptr && *ifNoneMatch != '\0') {
+    client.addHeader("If-None-Match", ifNoneMatch);
+  }
+  const char *collect[] = {"ETag"};
+  client.collectHeaders(collect, 1);
 
   responseCode = client.GET();
-  responseBody = client.getString().c_str();
+  if (responseCode <= 0) {
+    AG_LOGE(TAG, "Failed perform HTTP GET");
+    client.end();
+    return false;
+  }
+  if (etag != nullptr) {
+    etag->assign(client.header("ETag").c_str());
+  }
+
+  BodyReader reader(client.getStreamPtr(), client.getSize());
+  bool success = consumer(reader);
+  if (reader.failed()) {
+    AG_LOGE(TAG, "Failed read HTTP response body after %d bytes", reader.totalRead());
+    success = false;
+  }
   client.end();
-  return true;
+  return success;
 #else
   esp_http_client_config_t config = {};
   config.url = url.c_str();
   config.method = HTTP_METHOD_GET;
   config.cert_pem = AG_SERVER_ROOT_CA;
+  config.timeout_ms = timeoutMs;
+  // Headers are only reported through event handler
+  config.event_handler = captureEtag;
+  config.user_data = etag;
 
   esp_http_client_handle_t client = esp_http_client_init(&config);
+  if (ifNoneMatch != nullptr && *ifNoneMatch != '\0') {
+    esp_http_client_set_header(client, "If-None-Match", ifNoneMatch);
+  }
 
   if (esp_http_client_open(client, 0) != ESP_OK) {
     AG_LOGE(TAG, "Failed perform HTTP GET");
@@ -175,25 +363,37 @@ bool AirgradientWifiClient::_httpGet(const std::string &url, int &responseCode,
   esp_http_client_fetch_headers(client);
   responseCode = esp_http_client_get_status_code(client);
 
-  int totalRead = 0;
-  int readLen;
-  while ((readLen = esp_http_client_read(client, responseBuffer + totalRead,
-                                         MAX_RESPONSE_BUFFER - totalRead)) > 0) {
-    totalRead += readLen;
+  BodyReader reader(client);
+  bool success = consumer(reader);
+  if (reader.failed()) {
+    AG_LOGE(TAG, "Failed read HTTP response body after %d bytes", reader.totalRead());
+    success = false;
   }
 
   esp_http_client_close(client);
   esp_http_client_cleanup(client);
 
-  responseBuffer[totalRead] = '\0';
-  responseBody = std::string(responseBuffer);
-
-  return true;
+  return success;
 #endif
 }
 
+bool AirgradientWifiClient::_handleFetchConfigResponseCode(int responseCode) {
+  if (responseCode == 200) {
+    return true;
+  }
+
+  AG_LOGE(TAG, "Failed fetch configuration from server with return code %d", responseCode);
+  // Return code 400 means device not registered on ag server
+  if (responseCode == 400) {
+    registeredOnAgServer = false;
+  }
+  lastFetchConfigSucceed = false;
+  return false;
+}
+
 bool AirgradientWifiClient::_httpPost(const std::string &url, const std::string &payload,
-                                      int &responseCode) {
+                                      int &responseCode, std::string &retryAfter) {
+  retryAfter.clear();
 #ifdef ARDUINO
   HTTPClient client;
   client.setConnectTimeout(timeoutMs); // Set timeout when establishing connection to server
@@ -205,7 +405,10 @@ bool AirgradientWifiClient::_httpPost(const std::string &url, const std::string
   }
 
   client.addHeader("content-type", "application/json");
+  const char *collect[] = {"Retry-After"};
+  client.collectHeaders(collect, 1);
   responseCode = client.POST(String(payload.c_str()));
+  retryAfter.assign(client.header("Retry-After").c_str());
   client.end();
   return true;
 #else
@@ -214,6 +417,8 @@ bool AirgradientWifiClient::_httpPost(const std::string &url, const std::string
   config.method = HTTP_METHOD_POST;
   config.cert_pem = AG_SERVER_ROOT_CA;
   config.timeout_ms = timeoutMs;
+  config.event_handler = captureRetryAfter;
+  config.user_data = &retryAfter;
   esp_http_client_handle_t client = esp_http_client_init(&config);
 
   esp_http_client_set_header(client, "Content-Type", "application/json");
@@ -293,4 +498,82 @@ void AirgradientWifiClient::_serialize(JsonDocument &doc, const MaxSensorPayload
   }
 }
 
+#ifdef ARDUINO
+AirgradientWifiClient::BodyReader::BodyReader(Stream *stream, int contentLength)
+    : _stream(stream), _remaining(contentLength) {}
+
+int AirgradientWifiClient::BodyReader::read() {
+  char c;
+  if (readBytes(&c, 1) != 1) {
+    return -1;
+  }
+  return static_cast<uint8_t>(c);
+}
+
+size_t AirgradientWifiClient::BodyReader::readBytes(char *buffer, size_t length) {
+  if (_stream == nullptr || _remaining == 0) {
+    return 0;
+  }
+
+  // Content length -1 means unknown, read until connection closed or stream timeout
+  if (_remaining > 0 && length > static_cast<size_t>(_remaining)) {
+    length = _remaining;
+  }
+
+  size_t n = _stream->readBytes(buffer, length);
+  if (_remaining > 0) {
+    _remaining -= n;
+    if (n == 0) {
+      // Stream timed out before content length reached
+      _failed = true;
+    }
+  }
+  _totalRead += n;
+  return n;
+}
+#else
+AirgradientWifiClient::BodyReader::BodyReader(esp_http_client_handle_t client) : _client(client) {}
+
+int AirgradientWifiClient::BodyReader::read() {
+  if (_chunkPos >= _chunkLen && !_fill()) {
+    return -1;
+  }
+  _totalRead++;
+  return static_cast<uint8_t>(_chunk[_chunkPos++]);
+}
+
+size_t AirgradientWifiClient::BodyReader::readBytes(char *buffer, size_t length) {
+  size_t copied = 0;
+  while (copied < length) {
+    if (_chunkPos >= _chunkLen && !_fill()) {
+      break;
+    }
+    size_t n = std::min(length - copied, static_cast<size_t>(_chunkLen - _chunkPos));
+    memcpy(buffer + copied, _chunk + _chunkPos, n);
+    _chunkPos += n;
+    copied += n;
+  }
+  _totalRead += copied;
+  return copied;
+}
+
+bool AirgradientWifiClient::BodyReader::_fill() {
+  if (_eof) {
+    return false;
+  }
+
+  int readLen = esp_http_client_read(_client, _chunk, HTTP_STREAM_CHUNK_SIZE);
+  if (readLen <= 0) {
+    // Nothing more to read either way, but error must not pass as end of body
+    _eof = true;
+    _failed = (readLen < 0);
+    return false;
+  }
+
+  _chunkLen = readLen;
+  _chunkPos = 0;
+  return true;
+}
+#endif
+
 #endif // ESP8266
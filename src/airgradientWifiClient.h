@@ -10,34 +10,118 @@
 
 #ifndef ESP8266
 
+#include <functional>
 #include <string>
 #include <ArduinoJson.h>
 
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include "esp_http_client.h"
+#endif
+
 #include "airgradientClient.h"
 
 #ifndef ARDUINO
-#define MAX_RESPONSE_BUFFER 2048
+// Size of the chunk read from esp_http_client for each iteration when streaming response body
+#define HTTP_STREAM_CHUNK_SIZE 256
 #endif
 
 class AirgradientWifiClient : public AirgradientClient {
+public:
+  /**
+   * @brief Receive response body chunk by chunk as it arrive from the network
+   *
+   * @param data pointer to the received chunk, only valid during the call
+   * @param len length of the received chunk
+   * @return false to stop receiving the rest of the body
+   */
+  typedef std::function<bool(const char *data, int len)> BodySink;
+
+  /**
+   * @brief Pull-based reader over the HTTP response body
+   *
+   * Implements the ArduinoJson custom reader interface (read() and readBytes()), so the body can
+   * be deserialized directly from the network without buffering the whole response
+   */
+  class BodyReader {
+  public:
+#ifdef ARDUINO
+    BodyReader(Stream *stream, int contentLength);
+#else
+    BodyReader(esp_http_client_handle_t client);
+#endif
+    int read();
+    size_t readBytes(char *buffer, size_t length);
+    int totalRead() const { return _totalRead; }
+    // True if body stopped by connection error rather than its end, content is incomplete
+    bool failed() const { return _failed; }
+
+  private:
+#ifdef ARDUINO
+    Stream *_stream;
+    int _remaining;
+#else
+    bool _fill();
+    esp_http_client_handle_t _client;
+    char _chunk[HTTP_STREAM_CHUNK_SIZE];
+    int _chunkLen = 0;
+    int _chunkPos = 0;
+    bool _eof = false;
+#endif
+    int _totalRead = 0;
+    bool _failed = false;
+  };
+
 private:
   const char *const TAG = "AgWifiClient";
   uint16_t timeoutMs = 15000; // Default set to 15s
-#ifndef ARDUINO
-  char responseBuffer[2048];
-#endif
+
 public:
   AirgradientWifiClient() {};
-  ~AirgradientWifiClient() {};
+  ~AirgradientWifiClient() override {};
+
+  bool begin(std::string sn, PayloadType pt) override;
+  std::string httpFetchConfig() override;
 
-  bool begin(std::string sn, PayloadType pt);
-  std::string httpFetchConfig();
-  bool httpPostMeasures(const std::string &payload);
-  bool httpPostMeasures(const AirgradientPayload &payload);
+  /**
+   * @brief Fetch configuration and deserialize it directly from the response stream
+   *
+   * Memory used is bounded by the JsonDocument, response body is never buffered as a whole
+   *
+   * @param config where deserialized configuration will placed
+   * @return true if configuration successfully fetched and parsed
+   */
+  bool httpFetchConfig(JsonDocument &config);
+
+  /**
+   * @brief Fetch configuration and pass the response body to the sink chunk by chunk
+   *
+   * @param sink callback that receive each body chunk
+   * @return true if configuration successfully fetched and completely passed to the sink
+   */
+  bool httpFetchConfig(const BodySink &sink);
+
+  bool httpPostMeasures(const std::string &payload) override;
+  bool httpPostMeasures(const AirgradientPayload &payload) override;
 
 private:
-  bool _httpGet(const std::string &url, int &responseCode, std::string &responseBody);
-  bool _httpPost(const std::string &url, const std::string &payload, int &responseCode);
+  typedef std::function<bool(BodyReader &reader)> BodyConsumer;
+
+  bool _httpGet(const std::string &url, int &responseCode, std::string &responseBody,
+                const char *ifNoneMatch = nullptr, std::string *etag = nullptr);
+  /**
+   * @param ifNoneMatch send If-None-Match request header when not empty
+   * @param etag receive ETag response header when not nullptr
+   */
+  bool _httpGet(const std::string &url, int &responseCode, const BodyConsumer &consumer,
+                const char *ifNoneMatch = nullptr, std::string *etag = nullptr);
+  bool _handleFetchConfigResponseCode(int responseCode);
+  /**
+   * @param retryAfter receive Retry-After response header, empty if not provided
+   */
+  bool _httpPost(const std::string &url, const std::string &payload, int &responseCode,
+                 std::string &retryAfter);
   void _serialize(JsonDocument &doc, const MaxSensorPayload *payload);
 
 };
@@ -11,59 +11,431 @@
 #include <cstring>
 #include "common.h"
 #include "agLogger.h"
+#include "agTrace.h"
+#include "nvs.h"
 
 #define AT_YIELD()                                                                                 \
   {                                                                                                \
     DELAY_MS(2);                                                                                   \
   }
 
+#define LATENCY_NVS_NAMESPACE "agatcmd"
+#define LATENCY_NVS_KEY "latency"
+// Persist latency estimates every this number of samples, to limit flash wear
+#define LATENCY_SAVE_INTERVAL 32
+#define LATENCY_MAX_BACKOFF 4
+// Longest time to finish reading a partially received URC line before release the serial line
+#define URC_LINE_TIMEOUT_MS 100
+
+// Timeout bounds for each CommandClass in ms, ceiling is the static timeout used previously
+static const uint32_t TIMEOUT_FLOOR[] = {1000, 3000, 30000, 5000};
+static const uint32_t TIMEOUT_CEILING[] = {DEFAULT_WAIT_RESPONSE_TIMEOUT,
+                                           DEFAULT_WAIT_RESPONSE_TIMEOUT, 140000, 30000};
+
 ATCommandHandler::ATCommandHandler(AirgradientSerial *agSerial) : agSerial_(agSerial) {}
 
 bool ATCommandHandler::testAT(uint32_t timeoutMs) {
-  for (uint32_t start = MILLIS(); (MILLIS() - start) < timeoutMs;) {
-    sendRaw("AT");
-    if (waitResponse(500) == ExpArg1) {
-      return true;
+  for (uint32_t start = MILLIS(); (MILLIS() - start) < timeoutMs && !isDeadlineExceeded();) {
+    if (_lineBlocked()) {
+      return false;
+    }
+    {
+      // Line released between attempts, caller already holding it keep it
+      Transaction transaction(this, PriorityLow);
+      sendRaw("AT");
+      if (waitResponse(500) == ExpArg1) {
+        return true;
+      }
     }
-    DELAY_MS(100);
+    DELAY_MS(20);
   }
 
   return false;
 }
 
+bool ATCommandHandler::lock(Priority priority) {
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  std::unique_lock<std::mutex> lock(_lineMutex);
+  if (_ownerDepth > 0 && _owner == self) {
+    _ownerDepth++;
+    return true;
+  }
+
+  // Data session can last for hours, don't wait for it
+  _waiting[priority]++;
+  _lineReleased.wait(lock,
+                     [this, priority]() { return _dataSession || _canAcquire(priority); });
+  _waiting[priority]--;
+  if (_dataSession) {
+    return false;
+  }
+  _owner = self;
+  _ownerDepth = 1;
+  return true;
+}
+
+bool ATCommandHandler::tryLock() {
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  std::lock_guard<std::mutex> lock(_lineMutex);
+  if (_ownerDepth > 0 && _owner == self) {
+    _ownerDepth++;
+    return true;
+  }
+
+  // Yield to any task waiting, whatever its priority
+  for (int waiting : _waiting) {
+    if (waiting > 0) {
+      return false;
+    }
+  }
+  if (_ownerDepth > 0 || _dataSession) {
+    return false;
+  }
+
+  _owner = self;
+  _ownerDepth = 1;
+  return true;
+}
+
+void ATCommandHandler::unlock() {
+  {
+    std::lock_guard<std::mutex> lock(_lineMutex);
+    if (_ownerDepth == 0 || _owner != xTaskGetCurrentTaskHandle()) {
+      AG_LOGE(TAG, "unlock() called by task not holding the serial line");
+      return;
+    }
+    if (--_ownerDepth > 0) {
+      return;
+    }
+    _owner = nullptr;
+  }
+  _lineReleased.notify_all();
+}
+
+void ATCommandHandler::beginDataSession() {
+  {
+    std::lock_guard<std::mutex> lock(_lineMutex);
+    if (_ownerDepth == 0 || _owner != xTaskGetCurrentTaskHandle()) {
+      AG_LOGE(TAG, "beginDataSession() called by task not holding the serial line");
+      return;
+    }
+    _dataSession = true;
+  }
+  // Task waiting in lock() give up
+  _lineReleased.notify_all();
+}
+
+void ATCommandHandler::endDataSession() {
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  std::unique_lock<std::mutex> lock(_lineMutex);
+  // Task that started the session might still hold the line
+  _lineReleased.wait(lock, [this, self]() { return _ownerDepth == 0 || _owner == self; });
+  _dataSession = false;
+  if (_ownerDepth > 0) {
+    _ownerDepth++;
+  } else {
+    _owner = self;
+    _ownerDepth = 1;
+  }
+}
+
+bool ATCommandHandler::isDataSession() {
+  std::lock_guard<std::mutex> lock(_lineMutex);
+  return _dataSession;
+}
+
+void ATCommandHandler::setChannel(AgCmuxChannel *channel) { _channel = channel; }
+
+void ATCommandHandler::expectURC(const char *prefix) {
+  std::lock_guard<std::mutex> lock(_urcMutex);
+  for (const char *expected : _expectedURC) {
+    if (expected == prefix) {
+      return;
+    }
+  }
+  for (const char *&expected : _expectedURC) {
+    if (expected == nullptr) {
+      expected = prefix;
+      return;
+    }
+  }
+  AG_LOGW(TAG, "Too many URC expected, %s might be mixed with other response", prefix);
+}
+
+ATCommandHandler::Response ATCommandHandler::waitURC(const char *prefix, uint32_t timeoutMs,
+                                                     std::string &value) {
+  if (_lineBlocked()) {
+    return Timeout;
+  }
+  expectURC(prefix);
+  timeoutMs = clampToDeadline(timeoutMs);
+
+  Response response = Timeout;
+  uint32_t waitStartTime = MILLIS();
+  do {
+    // Other task might already receive it as part of its transaction
+    if (_takeURC(prefix, value)) {
+      response = ExpArg1;
+      break;
+    }
+
+    // Serial line is free, read pending lines ourselves
+    if (tryLock()) {
+      // Line buffer is free while holding the serial line
+      int idx = 0;
+      uint32_t lineStartTime = MILLIS();
+      while (_available() ||
+             (idx > 0 && (MILLIS() - lineStartTime) < URC_LINE_TIMEOUT_MS)) {
+        if (!_available()) {
+          DELAY_MS(1);
+          continue;
+        }
+        char b = _read();
+        if (b == '\n') {
+          _stashURC(_buffer, idx);
+          idx = 0;
+          lineStartTime = MILLIS();
+        } else if (b != '\r' && idx < DEFAULT_BUFFER_ALLOC) {
+          _buffer[idx++] = b;
+        }
+      }
+      unlock();
+
+      if (_takeURC(prefix, value)) {
+        response = ExpArg1;
+        break;
+      }
+    }
+
+    DELAY_MS(10);
+  } while ((MILLIS() - waitStartTime) < timeoutMs);
+
+  _forgetURC(prefix);
+  return response;
+}
+
+uint32_t ATCommandHandler::getTimeout(CommandClass cls, uint32_t ceilingMs) {
+  uint32_t ceiling = ceilingMs > 0 ? ceilingMs : TIMEOUT_CEILING[cls];
+  uint32_t floor = TIMEOUT_FLOOR[cls] < ceiling ? TIMEOUT_FLOOR[cls] : ceiling;
+  std::lock_guard<std::mutex> lock(_latencyMutex);
+  const LatencyEstimate &est = _latency[cls];
+  if (est.samples == 0) {
+    return ceiling;
+  }
+
+  uint32_t timeout = (est.srtt + 4 * est.rttvar) << _backoff[cls];
+  if (timeout < floor) {
+    timeout = floor;
+  } else if (timeout > ceiling) {
+    timeout = ceiling;
+  }
+
+  return timeout;
+}
+
+void ATCommandHandler::recordLatency(CommandClass cls, uint32_t latencyMs) {
+  bool save;
+  {
+    std::lock_guard<std::mutex> lock(_latencyMutex);
+    LatencyEstimate &est = _latency[cls];
+    if (est.samples == 0) {
+      est.srtt = latencyMs;
+      est.rttvar = latencyMs / 2;
+    } else {
+      uint32_t delta = est.srtt > latencyMs ? est.srtt - latencyMs : latencyMs - est.srtt;
+      est.rttvar = (3 * est.rttvar + delta) / 4;
+      est.srtt = (7 * est.srtt + latencyMs) / 8;
+    }
+    est.samples++;
+    _backoff[cls] = 0;
+
+    _samplesSinceSaved++;
+    save = _samplesSinceSaved >= LATENCY_SAVE_INTERVAL;
+  }
+
+  if (save) {
+    saveLatencyStats();
+  }
+}
+
+void ATCommandHandler::recordTimeout(CommandClass cls) {
+  if (isDeadlineExceeded()) {
+    // Cut short by caller budget, not a sign of slow response
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(_latencyMutex);
+  if (_backoff[cls] < LATENCY_MAX_BACKOFF) {
+    _backoff[cls]++;
+  }
+}
+
+void ATCommandHandler::setDeadline(uint32_t budgetMs) {
+  TaskState *state = _findTaskState(budgetMs > 0);
+  if (state == nullptr) {
+    return;
+  }
+  state->deadlineSet = (budgetMs > 0);
+  state->deadline = MILLIS() + budgetMs;
+  if (!state->deadlineSet) {
+    state->deadlineSuspended = 0;
+  }
+  _releaseTaskState(state);
+}
+
+bool ATCommandHandler::isDeadlineExceeded() {
+  TaskState *state = _findTaskState(false);
+  return state != nullptr && state->deadlineSet && state->deadlineSuspended == 0 &&
+         static_cast<int32_t>(MILLIS() - state->deadline) >= 0;
+}
+
+uint32_t ATCommandHandler::clampToDeadline(uint32_t timeoutMs) {
+  TaskState *state = _findTaskState(false);
+  if (state == nullptr || !state->deadlineSet || state->deadlineSuspended > 0) {
+    return timeoutMs;
+  }
+
+  int32_t remaining = static_cast<int32_t>(state->deadline - MILLIS());
+  if (remaining <= 0) {
+    return 0;
+  }
+  return static_cast<uint32_t>(remaining) < timeoutMs ? static_cast<uint32_t>(remaining)
+                                                       : timeoutMs;
+}
+
+void ATCommandHandler::suspendDeadline() {
+  // Nothing to suspend without deadline, slot is not claimed for it
+  TaskState *state = _findTaskState(false);
+  if (state != nullptr && state->deadlineSet) {
+    state->deadlineSuspended++;
+  }
+}
+
+void ATCommandHandler::resumeDeadline() {
+  TaskState *state = _findTaskState(false);
+  if (state != nullptr && state->deadlineSuspended > 0) {
+    state->deadlineSuspended--;
+  }
+}
+
+bool ATCommandHandler::loadLatencyStats() {
+  nvs_handle_t handle;
+  if (nvs_open(LATENCY_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+    return false;
+  }
+
+  LatencyEstimate stored[CommandClassCount];
+  size_t length = sizeof(stored);
+  esp_err_t err = nvs_get_blob(handle, LATENCY_NVS_KEY, stored, &length);
+  nvs_close(handle);
+  if (err != ESP_OK || length != sizeof(stored)) {
+    return false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_latencyMutex);
+    memcpy(_latency, stored, sizeof(_latency));
+  }
+  for (int i = 0; i < CommandClassCount; i++) {
+    AG_LOGD(TAG, "Command class %d timeout %dms", i, getTimeout(static_cast<CommandClass>(i)));
+  }
+
+  return true;
+}
+
+bool ATCommandHandler::saveLatencyStats() {
+  // Consistent copy, flash write is slow and done without holding the lock
+  LatencyEstimate stored[CommandClassCount];
+  {
+    std::lock_guard<std::mutex> lock(_latencyMutex);
+    memcpy(stored, _latency, sizeof(stored));
+    _samplesSinceSaved = 0;
+  }
+
+  nvs_handle_t handle;
+  if (nvs_open(LATENCY_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+    AG_LOGW(TAG, "Failed open nvs to store latency estimates");
+    return false;
+  }
+
+  esp_err_t err = nvs_set_blob(handle, LATENCY_NVS_KEY, stored, sizeof(stored));
+  if (err == ESP_OK) {
+    err = nvs_commit(handle);
+  }
+  nvs_close(handle);
+
+  return err == ESP_OK;
+}
+
 void ATCommandHandler::sendAT(const char *cmd) {
-  agSerial_->print("AT");
-  agSerial_->print(cmd);
-  agSerial_->print("\r\n");
+  if (_lineBlocked()) {
+    return;
+  }
+  _traceCommandBegin(cmd);
+  _print("AT");
+  _print(cmd);
+  _print("\r\n");
+  _markSent(_classify(cmd));
   AT_YIELD();
 }
 
 void ATCommandHandler::sendRaw(const char *raw) {
-  agSerial_->print(raw);
-  agSerial_->print("\r\n");
+  if (_lineBlocked()) {
+    return;
+  }
+  _traceCommandBegin(raw);
+  _print(raw);
+  _print("\r\n");
+  _markSent(LocalCommand);
+  AT_YIELD();
+}
+
+void ATCommandHandler::sendData(const char *data, int length) {
+  if (_lineBlocked()) {
+    return;
+  }
+  _write(reinterpret_cast<const uint8_t *>(data), length);
+  _markSent(LocalCommand);
   AT_YIELD();
 }
 
 ATCommandHandler::Response ATCommandHandler::waitResponse(uint32_t timeoutMs, const char *expArg1,
                                                           const char *expArg2,
                                                           const char *expArg3) {
+  // Response waited with explicit timeout is not a latency sample
+  CommandClass cls;
+  uint32_t sentTime;
+  _takeSample(cls, sentTime);
+  if (_lineBlocked()) {
+    AG_LOGW(TAG, "Serial line in data session");
+    return CMxError;
+  }
+  timeoutMs = clampToDeadline(timeoutMs);
+
   // Reset buffer
   memset(_buffer, 0, DEFAULT_BUFFER_ALLOC);
 
   int idx = 0;
+  int lineStart = 0;
   Response response = Timeout;
   uint32_t waitStartTime = MILLIS();
 
   do {
-    while (agSerial_->available() && response == Timeout) {
+    while (_available() && response == Timeout) {
       // buffer overflow check
       if (idx >= DEFAULT_BUFFER_ALLOC) {
         AG_LOGE(TAG, "waitResponse() buffer overflow");
         return Response::CMxError; // TODO: Handle better, should not CMxError
       }
-      _buffer[idx] = agSerial_->read();
+      _buffer[idx] = _read();
       idx++;
 
+      // Keep URC other task waiting for that arrive in between this response
+      if (_buffer[idx - 1] == '\n') {
+        _stashURC(_buffer + lineStart, idx - lineStart);
+        lineStart = idx;
+      }
+
       if (expArg1 && _endsWith(_buffer, expArg1)) {
         response = ExpArg1;
       } else if (expArg2 && _endsWith(_buffer, expArg2)) {
@@ -83,27 +455,121 @@ ATCommandHandler::Response ATCommandHandler::waitResponse(uint32_t timeoutMs, co
     DELAY_MS(10);
   } while ((MILLIS() - waitStartTime) < timeoutMs && response == Timeout);
 
+  _traceCommandEnd();
   return response;
 }
 
 ATCommandHandler::Response ATCommandHandler::waitResponse(const char *expArg1, const char *expArg2,
                                                           const char *expArg3) {
-  return waitResponse(DEFAULT_WAIT_RESPONSE_TIMEOUT, expArg1, expArg2, expArg3);
+  CommandClass cls;
+  uint32_t sentTime;
+  bool sample = _takeSample(cls, sentTime);
+  Response response = waitResponse(getTimeout(cls), expArg1, expArg2, expArg3);
+  if (sample) {
+    _sampleLastCommand(cls, sentTime, response);
+  }
+  return response;
+}
+
+ATCommandHandler::Response ATCommandHandler::waitResponseLines(std::vector<std::string> &lines,
+                                                               uint32_t timeoutMs) {
+  lines.clear();
+
+  // Only first response after command sent represent its latency
+  CommandClass cls;
+  uint32_t sentTime;
+  bool sample = _takeSample(cls, sentTime) && (timeoutMs == 0);
+  if (timeoutMs == 0) {
+    timeoutMs = getTimeout(cls);
+  }
+  if (_lineBlocked()) {
+    AG_LOGW(TAG, "Serial line in data session");
+    return CMxError;
+  }
+  timeoutMs = clampToDeadline(timeoutMs);
+
+  std::string line;
+  Response response = Timeout;
+  uint32_t waitStartTime = MILLIS();
+
+  do {
+    while (_available() && response == Timeout) {
+      char b = _read();
+      if (b == '\r') {
+        continue;
+      }
+      if (b != '\n') {
+        line += b;
+        continue;
+      }
+
+      // Complete line received, skip empty line between results
+      if (line.empty()) {
+        continue;
+      }
+
+      if (line == AT_OK) {
+        response = ExpArg1;
+      } else if (line == AT_ERROR) {
+        response = ExpArg2;
+      } else if (line.rfind(RESP_ERROR_CME, 0) == 0 || line.rfind(RESP_ERROR_CMS, 0) == 0) {
+        AG_LOGW(TAG, "CMx error message: %s", line.c_str());
+        response = CMxError;
+      } else {
+        // URC other task waiting for is not a result of this command
+        if (!_stashURC(line.c_str(), line.length())) {
+          lines.push_back(line);
+        }
+      }
+      line.clear();
+    }
+
+    if (response == Timeout) {
+      DELAY_MS(10);
+    }
+  } while ((MILLIS() - waitStartTime) < timeoutMs && response == Timeout);
+
+  if (sample) {
+    _sampleLastCommand(cls, sentTime, response);
+  }
+
+  _traceCommandEnd();
+  return response;
+}
+
+bool ATCommandHandler::findResultLine(const std::vector<std::string> &lines, const char *prefix,
+                                      std::string &value) {
+  size_t prefixLen = strlen(prefix);
+  for (const auto &line : lines) {
+    if (line.compare(0, prefixLen, prefix) != 0) {
+      continue;
+    }
+
+    size_t pos = line.find_first_not_of(' ', prefixLen);
+    value = (pos == std::string::npos) ? std::string() : line.substr(pos);
+    return true;
+  }
+
+  return false;
 }
 
 int ATCommandHandler::waitAndRecvRespLine(char *received, int memorySize, uint32_t timeoutMs,
                                           bool excludeWhitespace) {
   int idx = 0;
   bool finish = false;
+  timeoutMs = clampToDeadline(timeoutMs);
   uint32_t waitStartTime = MILLIS();
 
   // Sanity check, making sure 'received' has empty memory
   memset(received, 0, memorySize);
+  if (_lineBlocked()) {
+    return -1;
+  }
 
   do {
-    while (agSerial_->available() && !finish) {
+    while (_available() && !finish) {
       // Read per 1 byte
-      char b = agSerial_->read();
+      char b = _read();
       if (excludeWhitespace) {
         // Exclude whitespace on first character by skipping first array index
         // Usually if received line like "CPIN: READY"
@@ -114,7 +580,7 @@ int ATCommandHandler::waitAndRecvRespLine(char *received, int memorySize, uint32
 
       // Check if there's an end line sequence
       if (b == '\r') {
-        b = agSerial_->read();
+        b = _read();
         if (b == '\n') {
           finish = true;
           break;
@@ -145,25 +611,33 @@ int ATCommandHandler::waitAndRecvRespLine(char *received, int memorySize, uint32
 
 int ATCommandHandler::waitAndRecvRespLine(std::string &received, int length, uint32_t timeoutMs,
                                           bool excludeWhitespace) {
-  char buff[length];
-  int result = waitAndRecvRespLine(buff, length, timeoutMs);
-  received = std::string(buff);
+  // Response buffer is free after waitResponse(), reuse it instead of stack
+  if (length >= DEFAULT_BUFFER_ALLOC) {
+    length = DEFAULT_BUFFER_ALLOC - 1;
+  }
+  int result = waitAndRecvRespLine(_buffer, length, timeoutMs);
+  _buffer[length] = '\0';
+  received.assign(_buffer);
   return result;
 }
 
 int ATCommandHandler::retrieveBuffer(char *output, int length, uint32_t timeoutMs) {
+  if (_lineBlocked()) {
+    return -1;
+  }
 
   int idx = 0;
   bool finish = false;
+  timeoutMs = clampToDeadline(timeoutMs);
   uint32_t waitStartTime = MILLIS();
 
   // Sanity check, making sure 'output' has empty memory
   memset(output, 0, sizeof(length));
 
   do {
-    while (agSerial_->available() && !finish) {
+    while (_available() && !finish) {
       // Read per 1 bytes and append to buffer
-      output[idx] = agSerial_->read();
+      output[idx] = _read();
       idx++;
       // Check if its already the expected length to retrieve
       if (idx >= length) {
@@ -183,9 +657,201 @@ int ATCommandHandler::retrieveBuffer(char *output, int length, uint32_t timeoutM
 }
 
 void ATCommandHandler::clearBuffer() {
-  while (agSerial_->available()) {
-    agSerial_->read();
+  // Discard everything but URC other task waiting for, line buffer no longer needed here
+  int idx = 0;
+  while (_available()) {
+    char b = _read();
+    if (b == '\n') {
+      _stashURC(_buffer, idx);
+      idx = 0;
+    } else if (b != '\r' && idx < DEFAULT_BUFFER_ALLOC) {
+      _buffer[idx++] = b;
+    }
+  }
+}
+
+ATCommandHandler::CommandClass ATCommandHandler::_classify(const char *cmd) {
+  // Commands that wait for the network, or for the radio stack to reconfigure, before returning
+  // final result. Local latency estimate would cut them short
+  static const char *networkCommands[] = {"+CGATT", "+CGACT", "+COPS", "+CMQTT", "+CNMP=",
+                                          "+CNBP=", "+CPOF", "+CRESET", "+HTTPINIT", "+NETOPEN",
+                                          "+CIPOPEN", "+CIPCLOSE", "+CDNSGIP", "+CCERTLIST"};
+  for (const char *prefix : networkCommands) {
+    if (strncmp(cmd, prefix, strlen(prefix)) == 0) {
+      return NetworkCommand;
+    }
+  }
+
+  return LocalCommand;
+}
+
+ATCommandHandler::TaskState *ATCommandHandler::_findTaskState(bool claim) {
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  std::lock_guard<std::mutex> lock(_taskStateMutex);
+  TaskState *free = nullptr;
+  for (TaskState &state : _taskStates) {
+    if (state.task == self) {
+      return &state;
+    }
+    if (free == nullptr && state.task == nullptr) {
+      free = &state;
+    }
+  }
+
+  if (!claim) {
+    return nullptr;
+  }
+  if (free == nullptr) {
+    AG_LOGW(TAG, "No free task state slot, deadline and latency sample ignored");
+    return nullptr;
+  }
+  *free = TaskState();
+  free->task = self;
+  return free;
+}
+
+void ATCommandHandler::_releaseTaskState(TaskState *state) {
+  if (state->deadlineSet || !state->lastSampled) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(_taskStateMutex);
+  state->task = nullptr;
+}
+
+void ATCommandHandler::_markSent(CommandClass cls) {
+  TaskState *state = _findTaskState(true);
+  if (state == nullptr) {
+    return;
+  }
+  state->lastClass = cls;
+  state->lastSentTime = MILLIS();
+  state->lastSampled = false;
+}
+
+bool ATCommandHandler::_takeSample(CommandClass &cls, uint32_t &sentTime) {
+  cls = LocalCommand;
+  sentTime = 0;
+  TaskState *state = _findTaskState(false);
+  if (state == nullptr) {
+    return false;
+  }
+
+  cls = state->lastClass;
+  sentTime = state->lastSentTime;
+  bool sample = !state->lastSampled;
+  state->lastSampled = true;
+  _releaseTaskState(state);
+  return sample;
+}
+
+void ATCommandHandler::_sampleLastCommand(CommandClass cls, uint32_t sentTime,
+                                          Response response) {
+  if (response == Timeout) {
+    recordTimeout(cls);
+    return;
+  }
+
+  recordLatency(cls, MILLIS() - sentTime);
+}
+
+void ATCommandHandler::_traceCommandBegin(const char *cmd) {
+#if CONFIG_TRACE_ENABLED
+  _traceCommandEnd();
+  _traceId = AgTrace::begin("at", cmd);
+  _traceOpen = true;
+#endif
+}
+
+bool ATCommandHandler::_lineBlocked() {
+  std::lock_guard<std::mutex> lock(_lineMutex);
+  return _dataSession && (_ownerDepth == 0 || _owner != xTaskGetCurrentTaskHandle());
+}
+
+bool ATCommandHandler::_canAcquire(Priority priority) {
+  if (_ownerDepth > 0 || _dataSession) {
+    return false;
+  }
+  for (int p = priority + 1; p < PriorityCount; p++) {
+    if (_waiting[p] > 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ATCommandHandler::_stashURC(const char *line, size_t length) {
+  while (length > 0 && (line[length - 1] == '\r' || line[length - 1] == '\n')) {
+    length--;
+  }
+
+  std::lock_guard<std::mutex> lock(_urcMutex);
+  for (const char *prefix : _expectedURC) {
+    if (prefix == nullptr) {
+      continue;
+    }
+    size_t prefixLen = strlen(prefix);
+    if (length < prefixLen || strncmp(line, prefix, prefixLen) != 0) {
+      continue;
+    }
+
+    for (char *stashed : _stashedURC) {
+      if (stashed[0] == '\0') {
+        if (length >= URC_LINE_MAX) {
+          AG_LOGW(TAG, "URC longer than %d, truncated %.*s", URC_LINE_MAX - 1, (int)length, line);
+        }
+        size_t copyLen = length < (URC_LINE_MAX - 1) ? length : (URC_LINE_MAX - 1);
+        memcpy(stashed, line, copyLen);
+        stashed[copyLen] = '\0';
+        return true;
+      }
+    }
+    AG_LOGW(TAG, "URC stash full, drop %.*s", (int)length, line);
+    return true;
+  }
+  return false;
+}
+
+bool ATCommandHandler::_takeURC(const char *prefix, std::string &value) {
+  size_t prefixLen = strlen(prefix);
+  std::lock_guard<std::mutex> lock(_urcMutex);
+  for (char *stashed : _stashedURC) {
+    if (stashed[0] == '\0' || strncmp(stashed, prefix, prefixLen) != 0) {
+      continue;
+    }
+    const char *start = stashed + prefixLen;
+    while (*start == ' ') {
+      start++;
+    }
+    value = start;
+    stashed[0] = '\0';
+    return true;
+  }
+  return false;
+}
+
+void ATCommandHandler::_forgetURC(const char *prefix) {
+  // Stop capturing, late URC must not be taken as result of the next command
+  std::lock_guard<std::mutex> lock(_urcMutex);
+  for (const char *&expected : _expectedURC) {
+    if (expected == prefix) {
+      expected = nullptr;
+    }
+  }
+  size_t prefixLen = strlen(prefix);
+  for (char *stashed : _stashedURC) {
+    if (strncmp(stashed, prefix, prefixLen) == 0) {
+      stashed[0] = '\0';
+    }
+  }
+}
+
+void ATCommandHandler::_traceCommandEnd() {
+#if CONFIG_TRACE_ENABLED
+  if (_traceOpen) {
+    AgTrace::end(_traceId);
+    _traceOpen = false;
   }
+#endif
 }
 
 bool ATCommandHandler::_endsWith(const char *str, const char *target) {
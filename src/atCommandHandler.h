@@ -10,14 +10,21 @@
 
 #ifndef ESP8266
 
+#include <condition_variable>
 #include <cstdint>
+#include <mutex>
 #include <string>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 #ifdef ARDUINO
 #include "agSerial.h"
 #else
 #include "AirgradientSerial.h"
 #endif
+#include "agCmux.h"
 
 #define AT_DEBUG
 #define AT_OK "OK"
@@ -31,6 +38,15 @@
 #define DEFAULT_BUFFER_ALLOC 4000
 #endif
 
+// Number of URC prefix expected at once, and URC line kept until taken by waitURC()
+#define URC_EXPECTED_MAX 4
+#define URC_STASH_MAX 4
+// Longest is +CDNSGIP result; 63 chars host and IPv4 address
+#define URC_LINE_MAX 112
+
+// Number of tasks that can hold a deadline or an unsampled command at once
+#define AT_TASK_STATE_MAX 6
+
 static const char RESP_AT_OK[] = AT_OK AT_NL;
 static const char RESP_AT_ERROR[] = AT_ERROR AT_NL;
 static const char RESP_ERROR_CME[] = "+CME ERROR:";
@@ -50,11 +66,246 @@ private:
 public:
   enum Response { ExpArg1, ExpArg2, ExpArg3, Timeout, CMxError };
 
+  /**
+   * @brief Group of commands with similar response latency, each has its own latency estimate
+   * used to derive response timeout
+   */
+  enum CommandClass {
+    LocalCommand = 0, // answered by the module itself; query, configuration
+    NetworkCommand,   // needs network round trip; attach, PDP context, operator selection
+    HttpAction,       // +HTTPACTION result URC
+    MqttAction,       // +CMQTTCONNECT and +CMQTTPUB result URC
+    CommandClassCount
+  };
+
+  /**
+   * @brief Priority to acquire the serial line when several tasks wait for it, higher go first
+   */
+  enum Priority {
+    PriorityLow = 0, // step of long operation; HTTP, MQTT, network registration
+    PriorityNormal,
+    PriorityHigh, // short status query; signal, SIM, registration status
+    PriorityCount
+  };
+
+  /**
+   * @brief Hold the serial line for one AT transaction, from command sent until its final
+   * result received, so response lines of other tasks can not interleave
+   *
+   * ```
+   * {
+   *   ATCommandHandler::Transaction transaction(at, ATCommandHandler::PriorityHigh);
+   *   at->sendAT("+CSQ");
+   *   at->waitResponse("+CSQ:");
+   *   ...
+   * } // serial line released for next waiting task
+   * ```
+   */
+  class Transaction {
+  public:
+    Transaction(ATCommandHandler *at, Priority priority = PriorityNormal) : _at(at) {
+      _locked = _at->lock(priority);
+    }
+    ~Transaction() {
+      if (_locked) {
+        _at->unlock();
+      }
+    }
+    Transaction(const Transaction &) = delete;
+    Transaction &operator=(const Transaction &) = delete;
+    // False while data session active, then every command of this transaction fail right away
+    bool locked() const { return _locked; }
+
+  private:
+    ATCommandHandler *_at;
+    bool _locked;
+  };
+
+  /**
+   * @brief End the data session and hold the serial line until out of scope, see
+   * endDataSession()
+   */
+  class DataSessionEnd {
+  public:
+    DataSessionEnd(ATCommandHandler *at) : _at(at) { _at->endDataSession(); }
+    ~DataSessionEnd() { _at->unlock(); }
+    DataSessionEnd(const DataSessionEnd &) = delete;
+    DataSessionEnd &operator=(const DataSessionEnd &) = delete;
+
+  private:
+    ATCommandHandler *_at;
+  };
+
+  /**
+   * @brief Ignore deadline of the calling task until out of scope, see suspendDeadline()
+   */
+  class DeadlineSuspend {
+  public:
+    DeadlineSuspend(ATCommandHandler *at) : _at(at) { _at->suspendDeadline(); }
+    ~DeadlineSuspend() { _at->resumeDeadline(); }
+    DeadlineSuspend(const DeadlineSuspend &) = delete;
+    DeadlineSuspend &operator=(const DeadlineSuspend &) = delete;
+
+  private:
+    ATCommandHandler *_at;
+  };
+
   ATCommandHandler(AirgradientSerial *agSerial);
   ~ATCommandHandler() {};
 
   bool testAT(uint32_t timeoutMs = 60000);
 
+  /**
+   * @brief Acquire the serial line, blocking until released by other task and no higher
+   * priority task waiting. Recursive for the same task. Prefer Transaction
+   *
+   * @param priority acquire priority
+   * @return false without waiting if data session active, or once it started while waiting.
+   * Don't call unlock() then
+   */
+  bool lock(Priority priority = PriorityNormal);
+
+  /**
+   * @brief Acquire the serial line only if free and no other task waiting for it
+   *
+   * @return true if acquired, call unlock() after
+   */
+  bool tryLock();
+
+  /**
+   * @brief Release the serial line acquired by lock() or tryLock()
+   */
+  void unlock();
+
+  /**
+   * @brief Hand the serial line over to a data session, eg. PPP after CONNECT. Call while
+   * holding the line; once released, lock() and tryLock() of every task fail, and commands sent
+   * without the line fail right away with CMxError, until endDataSession()
+   */
+  void beginDataSession();
+
+  /**
+   * @brief End the data session and acquire the serial line right away, so escape sequence is
+   * sent before any other task command. Call unlock() after
+   */
+  void endDataSession();
+
+  bool isDataSession();
+
+  /**
+   * @brief Run AT commands over a multiplexer channel instead of the serial line directly. Call
+   * while holding the line
+   *
+   * @param channel multiplexer channel, nullptr to go back to the serial line
+   */
+  void setChannel(AgCmuxChannel *channel);
+
+  /**
+   * @brief Start capturing unsolicited result line with prefix, so the line is kept for
+   * waitURC() when received while other task holding the serial line
+   * Call before releasing the serial line after the command that will produce the URC
+   *
+   * @param prefix URC prefix, eg. "+HTTPACTION:"
+   */
+  void expectURC(const char *prefix);
+
+  /**
+   * @brief Wait for URC registered by expectURC() without holding the serial line in between,
+   * letting other tasks run their transactions while waiting. Capture stop when return
+   *
+   * ```
+   * {
+   *   ATCommandHandler::Transaction transaction(at, ATCommandHandler::PriorityLow);
+   *   at->sendAT("+HTTPACTION=0");
+   *   at->waitResponse();
+   *   at->expectURC("+HTTPACTION:");
+   * }
+   * std::string value;
+   * at->waitURC("+HTTPACTION:", 60000, value);
+   * value == "0,200,1024"
+   * ```
+   *
+   * @param prefix URC prefix, same pointer given to expectURC()
+   * @param timeoutMs how long to wait for the URC
+   * @param value where the rest of URC line after prefix placed, without leading whitespace
+   * @return ExpArg1 if received, Timeout otherwise
+   */
+  Response waitURC(const char *prefix, uint32_t timeoutMs, std::string &value);
+
+  /**
+   * @brief Response timeout derived from observed latency of a command class (TCP RTO style)
+   * smoothed latency + 4 * latency variance, doubled for each consecutive timeout, and
+   * clamped within class floor and ceiling. Return the ceiling until latency is observed
+   *
+   * @param cls command class
+   * @param ceilingMs override class default ceiling, 0 to use the default
+   * @return timeout in ms
+   */
+  uint32_t getTimeout(CommandClass cls, uint32_t ceilingMs = 0);
+
+  /**
+   * @brief Add latency sample of a command class, resetting timeout backoff
+   *
+   * waitResponse() without timeout argument already record it for the last command sent.
+   * Call this for responses that waited with explicit timeout, eg. result URC
+   *
+   * @param cls command class
+   * @param latencyMs time from command sent until expected response received
+   */
+  void recordLatency(CommandClass cls, uint32_t latencyMs);
+
+  /**
+   * @brief Notify a command class timed out, next timeout for the class is doubled
+   * Timeout caused by passed deadline is ignored
+   */
+  void recordTimeout(CommandClass cls);
+
+  /**
+   * @brief Bound every following wait of the calling task to finish within a time budget from
+   * now. Wait that would pass the deadline is shortened, and return timeout right away once the
+   * budget is spent. Waits of other tasks are not affected
+   *
+   * @param budgetMs time budget in ms, 0 to remove the deadline
+   */
+  void setDeadline(uint32_t budgetMs);
+
+  /**
+   * @brief Check if deadline set by setDeadline() of the calling task has passed
+   *
+   * @return true if passed, false if not or no deadline set
+   */
+  bool isDeadlineExceeded();
+
+  /**
+   * @brief Shorten a wait or sleep to the remaining budget of the calling task deadline
+   *
+   * @param timeoutMs wanted duration in ms
+   * @return timeoutMs, or less if deadline come first, 0 once passed
+   */
+  uint32_t clampToDeadline(uint32_t timeoutMs);
+
+  /**
+   * @brief Stop applying deadline of the calling task until resumeDeadline(), for sequence that
+   * leave module in unknown state if cut short, eg. baud rate switch. Nestable. Prefer
+   * DeadlineSuspend
+   */
+  void suspendDeadline();
+  void resumeDeadline();
+
+  /**
+   * @brief Load latency estimates persisted from previous boot
+   *
+   * @return true if loaded
+   */
+  bool loadLatencyStats();
+
+  /**
+   * @brief Persist latency estimates, also done periodically when recording latency
+   *
+   * @return true if saved
+   */
+  bool saveLatencyStats();
+
   /**
    * @brief send AT command while "AT" prefix and linebreak already provided
    *
@@ -81,6 +332,14 @@ public:
    */
   void sendRaw(const char *raw);
 
+  /**
+   * @brief send binary data as is, without linebreak. Eg. socket payload after ">" prompt
+   *
+   * @param data data to send, might contain NUL
+   * @param length data length
+   */
+  void sendData(const char *data, int length);
+
   /**
    * @brief Wait for AT response with multiple response expectation in the form of argument
    * Call this function after sending AT command and expect a response
@@ -127,6 +386,9 @@ public:
    * resp == ExpArg2 // receive "ERROR" response
    * resp == Timeout // timeout wait for response
    * ```
+   *
+   * Timeout is derived from observed latency of the last command sent, see getTimeout()
+   *
    * @param expArg1 expected response 1 (Default: OK)
    * @param expArg2 expected response 2 (Default: ERROR)
    * @param expArg3 expected response 2 (Default: null)
@@ -135,6 +397,45 @@ public:
   Response waitResponse(const char *expArg1 = RESP_AT_OK, const char *expArg2 = RESP_AT_ERROR,
                         const char *expArg3 = nullptr);
 
+  /**
+   * @brief Wait for final result of a command and collect every intermediate result line
+   * Mainly for concatenated command line, where each sub command print its own result line
+   * and only one final result is returned for the whole line
+   *
+   * Example:
+   * ```
+   * at.sendAT("+CREG?;+CGREG?;+CEREG?;+CSQ");
+   * std::vector<std::string> lines;
+   * Response resp = at.waitResponseLines(lines);
+   * resp == ExpArg1 // receive "OK", lines == {"+CREG: 0,1", "+CGREG: 0,1", ...}
+   * resp == ExpArg2 // receive "ERROR", lines contain result of sub command before the failed one
+   * resp == CMxError // receive "+CME ERROR:" or "+CMS ERROR:"
+   * resp == Timeout // timeout wait for final result
+   * ```
+   *
+   * @param lines where intermediate result lines placed, without linebreak
+   * @param timeoutMs how long to wait for final result, 0 to derive from observed latency
+   * @return Response response enum member
+   */
+  Response waitResponseLines(std::vector<std::string> &lines, uint32_t timeoutMs = 0);
+
+  /**
+   * @brief Find result line of a sub command from lines collected by waitResponseLines()
+   *
+   * ```
+   * std::string value;
+   * at.findResultLine(lines, "+CSQ:", value);
+   * value == "20,99"
+   * ```
+   *
+   * @param lines result lines
+   * @param prefix result prefix of the sub command
+   * @param value where value after prefix placed, without leading whitespace
+   * @return true if found
+   */
+  bool findResultLine(const std::vector<std::string> &lines, const char *prefix,
+                      std::string &value);
+
   /**
    * @brief receive the rest of response on rx buffer until linebreak
    *
@@ -190,9 +491,87 @@ public:
   void clearBuffer();
 
 private:
+  // Coroutine engine drive the serial line itself while holding it
+  friend class ATEngine;
+
+  // RFC 6298 style estimator, all in ms
+  struct LatencyEstimate {
+    uint32_t srtt;
+    uint32_t rttvar;
+    uint32_t samples;
+  };
+
+  // Deadline and last command sent of one task, slot free while task is nullptr
+  struct TaskState {
+    TaskHandle_t task = nullptr;
+    bool deadlineSet = false;
+    uint32_t deadline = 0;
+    uint8_t deadlineSuspended = 0; // nesting depth of suspendDeadline()
+    CommandClass lastClass = LocalCommand;
+    uint32_t lastSentTime = 0;
+    bool lastSampled = true;
+  };
+
   bool _endsWith(const char *str, const char *target);
+  CommandClass _classify(const char *cmd);
+  TaskState *_findTaskState(bool claim);
+  void _releaseTaskState(TaskState *state);
+  void _markSent(CommandClass cls);
+  bool _takeSample(CommandClass &cls, uint32_t &sentTime);
+  void _sampleLastCommand(CommandClass cls, uint32_t sentTime, Response response);
+  void _traceCommandBegin(const char *cmd);
+  void _traceCommandEnd();
+  bool _canAcquire(Priority priority);
+  bool _lineBlocked();
+  bool _stashURC(const char *line, size_t length);
+  bool _takeURC(const char *prefix, std::string &value);
+  void _forgetURC(const char *prefix);
+
+  // Serial line or multiplexer channel
+  int _available() { return _channel ? _channel->available() : agSerial_->available(); }
+  char _read() { return _channel ? _channel->read() : agSerial_->read(); }
+  void _print(const char *str) {
+    if (_channel) {
+      _channel->print(str);
+    } else {
+      agSerial_->print(str);
+    }
+  }
+  void _write(const uint8_t *data, int length) {
+    if (_channel) {
+      _channel->write(data, length);
+    } else {
+      agSerial_->write(data, length);
+    }
+  }
 
   char _buffer[DEFAULT_BUFFER_ALLOC];
+  LatencyEstimate _latency[CommandClassCount] = {};
+  uint8_t _backoff[CommandClassCount] = {};
+  uint32_t _samplesSinceSaved = 0;
+  // Estimates are sampled by every task using the handler, guard _latency, _backoff and
+  // _samplesSinceSaved
+  std::mutex _latencyMutex;
+  // Only owning task touch its slot beside the task field, guarded by _taskStateMutex
+  std::mutex _taskStateMutex;
+  TaskState _taskStates[AT_TASK_STATE_MAX];
+  // Span of last command sent, until its first response
+  uint32_t _traceId = 0;
+  bool _traceOpen = false;
+
+  // Serial line arbitration
+  std::mutex _lineMutex;
+  std::condition_variable _lineReleased;
+  TaskHandle_t _owner = nullptr;
+  int _ownerDepth = 0;
+  int _waiting[PriorityCount] = {};
+  bool _dataSession = false;
+  AgCmuxChannel *_channel = nullptr;
+
+  // URC received while other task hold the serial line, until taken by waitURC()
+  std::mutex _urcMutex;
+  const char *_expectedURC[URC_EXPECTED_MAX] = {};
+  char _stashedURC[URC_STASH_MAX][URC_LINE_MAX] = {};
 };
 
 #endif // ESP8266
@@ -0,0 +1,367 @@
+/**
+ * AirGradient
+ * https://airgradient.com
+ *
+ * CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
+ */
+
+#ifndef ESP8266
+
+#include "atEngine.h"
+
+#if CONFIG_CELLULAR_COROUTINE_ENGINE
+
+#include "common.h"
+#include "agLogger.h"
+#include "atResponseParser.h"
+
+// Longest time to finish reading a partially received line before dropping it
+#define PARTIAL_LINE_TIMEOUT_MS 100
+
+void ATEngine::CommandAwaiter::await_suspend(std::coroutine_handle<> handle) {
+  _handle = handle;
+  if (_engine->_resumingOwner) {
+    _engine->_commands.push_front(this);
+  } else {
+    _engine->_commands.push_back(this);
+  }
+}
+
+void ATEngine::URCAwaiter::await_suspend(std::coroutine_handle<> handle) {
+  _handle = handle;
+  _startTime = MILLIS();
+  _engine->_at->expectURC(_prefix);
+  _engine->_urcWaiters.push_back(this);
+}
+
+void ATEngine::DelayAwaiter::await_suspend(std::coroutine_handle<> handle) {
+  _handle = handle;
+  _startTime = MILLIS();
+  _engine->_delays.push_back(this);
+}
+
+void ATEngine::ConditionAwaiter::await_suspend(std::coroutine_handle<> handle) {
+  _handle = handle;
+  _engine->_conditions.push_back(this);
+}
+
+ATEngine::~ATEngine() {
+  if (_task != nullptr) {
+    // Serial line can only be released by the task holding it
+    _stopRequested = true;
+    while (!_stopped) {
+      DELAY_MS(5);
+    }
+  } else if (_holdingLine) {
+    _at->unlock();
+  }
+
+  // Destroying root destroy every coroutine it awaits
+  std::lock_guard<std::mutex> lock(_spawnMutex);
+  for (RootHandle root : _spawned) {
+    root.destroy();
+  }
+  for (RootHandle root : _roots) {
+    root.destroy();
+  }
+}
+
+ATEngine::CommandAwaiter ATEngine::command(const char *cmd, uint32_t timeoutMs,
+                                           const char *terminator, const char *dataPrefix) {
+  return CommandAwaiter(this, Request{cmd, timeoutMs, terminator, dataPrefix, false});
+}
+
+ATEngine::CommandAwaiter ATEngine::sendRaw(const std::string &data, uint32_t timeoutMs) {
+  return CommandAwaiter(this, Request{data, timeoutMs, nullptr, nullptr, true});
+}
+
+ATEngine::URCAwaiter ATEngine::urc(const char *prefix, uint32_t timeoutMs) {
+  return URCAwaiter(this, prefix, timeoutMs);
+}
+
+ATEngine::DelayAwaiter ATEngine::delay(uint32_t delayMs) { return DelayAwaiter(this, delayMs); }
+
+ATEngine::ConditionAwaiter ATEngine::until(std::function<bool()> ready) {
+  return ConditionAwaiter(this, std::move(ready));
+}
+
+bool ATEngine::poll() {
+  // Newly spawned coroutine run until its first suspension
+  std::vector<RootHandle> spawned;
+  {
+    std::lock_guard<std::mutex> lock(_spawnMutex);
+    spawned.swap(_spawned);
+  }
+  for (RootHandle root : spawned) {
+    _roots.push_back(root);
+    root.resume();
+  }
+
+  _pollCommand();
+  _pollURC();
+  _pollDelay();
+  _pollConditions();
+
+  // Finished root coroutine
+  for (auto it = _roots.begin(); it != _roots.end();) {
+    if (it->done()) {
+      it->destroy();
+      it = _roots.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  // Only keep the serial line while command in flight or a line partially read
+  if (_holdingLine && _current == nullptr && _commands.empty() && _readPendingLines()) {
+    _at->unlock();
+    _holdingLine = false;
+  }
+
+  return !_roots.empty();
+}
+
+bool ATEngine::startTask(UBaseType_t priority, uint32_t stackSize) {
+  if (_task != nullptr) {
+    return true;
+  }
+
+  if (xTaskCreate(_taskEntry, "atEngine", stackSize, this, priority, &_task) != pdTRUE) {
+    AG_LOGE(TAG, "Failed create scheduler task");
+    _task = nullptr;
+    return false;
+  }
+
+  return true;
+}
+
+void ATEngine::_taskEntry(void *arg) {
+  ATEngine *engine = static_cast<ATEngine *>(arg);
+  while (!engine->_stopRequested) {
+    // Short sleep while coroutine in flight to keep up with the serial line
+    DELAY_MS(engine->poll() ? 2 : 20);
+  }
+
+  if (engine->_holdingLine) {
+    engine->_at->unlock();
+    engine->_holdingLine = false;
+  }
+  // Engine might be freed right after, don't touch it anymore
+  engine->_stopped = true;
+  vTaskDelete(nullptr);
+}
+
+void ATEngine::_pollCommand() {
+  if (_current == nullptr) {
+    if (_commands.empty()) {
+      return;
+    }
+    if (!_holdingLine) {
+      // Yield to task waiting with blocking API
+      if (!_at->tryLock()) {
+        return;
+      }
+      _holdingLine = true;
+    }
+    // Let URC line partially read finish first
+    if (!_line.empty() && !_readPendingLines()) {
+      return;
+    }
+
+    _current = _commands.front();
+    _commands.pop_front();
+
+    // Leftover of previous transaction, URC other waits for is kept
+    _at->clearBuffer();
+    Request &request = _current->_request;
+    if (request.raw) {
+      _at->sendRaw(request.cmd.c_str());
+    } else {
+      _at->sendAT(request.cmd.c_str());
+    }
+    // Explicit timeout is not a latency sample
+    uint32_t sentTime;
+    _current->_sample =
+        _at->_takeSample(_current->_sampleClass, sentTime) && request.timeoutMs == 0;
+    if (request.timeoutMs == 0) {
+      request.timeoutMs = _at->getTimeout(_current->_sampleClass);
+    }
+    _current->_sentTime = MILLIS();
+  }
+
+  Request &request = _current->_request;
+  ATResult &result = _current->_result;
+  while (_current != nullptr && _at->_available()) {
+    char b = _at->_read();
+    if (_current->_dataRemaining > 0) {
+      result.data += b;
+      _current->_dataRemaining--;
+      continue;
+    }
+    if (b == '\r') {
+      continue;
+    }
+    if (b != '\n') {
+      _appendLine(b);
+      // Prompt has no linebreak
+      if (request.terminator && _line == request.terminator) {
+        _line.clear();
+        _finishCommand(ATCommandHandler::ExpArg1);
+      }
+      continue;
+    }
+
+    // Complete line received, skip empty line between results
+    if (_line.empty()) {
+      continue;
+    }
+
+    if (_line == AT_OK) {
+      if (request.terminator == nullptr) {
+        _line.clear();
+        _finishCommand(ATCommandHandler::ExpArg1);
+        continue;
+      }
+    } else if (_line == AT_ERROR) {
+      _line.clear();
+      _finishCommand(ATCommandHandler::ExpArg2);
+      continue;
+    } else if (_line.rfind(RESP_ERROR_CME, 0) == 0 || _line.rfind(RESP_ERROR_CMS, 0) == 0) {
+      AG_LOGW(TAG, "CMx error message: %s", _line.c_str());
+      _line.clear();
+      _finishCommand(ATCommandHandler::CMxError);
+      continue;
+    } else if (request.dataPrefix && _line.rfind(request.dataPrefix, 0) == 0) {
+      ATResponseParser parser(_line);
+      int length = 0;
+      if (parser.skipPrefix(request.dataPrefix) && parser.nextInt(length) && length > 0) {
+        result.data.reserve(result.data.size() + length);
+        _current->_dataRemaining = length;
+      }
+    } else if (!_at->_stashURC(_line.c_str(), _line.length())) {
+      result.lines.push_back(_line);
+    }
+    _line.clear();
+  }
+
+  if (_current != nullptr && (MILLIS() - _current->_sentTime) >= request.timeoutMs) {
+    _finishCommand(ATCommandHandler::Timeout);
+  }
+}
+
+void ATEngine::_finishCommand(ATCommandHandler::Response response) {
+  CommandAwaiter *finished = _current;
+  _current = nullptr;
+  finished->_result.response = response;
+
+  if (finished->_sample) {
+    _at->_sampleLastCommand(finished->_sampleClass, finished->_sentTime, response);
+  }
+  _at->_traceCommandEnd();
+
+  // Resumed while still holding the serial line, next command of the same coroutine go first
+  _resumingOwner = true;
+  finished->_handle.resume();
+  _resumingOwner = false;
+}
+
+void ATEngine::_pollURC() {
+  if (_urcWaiters.empty()) {
+    return;
+  }
+
+  // Read it ourselves when nobody else is reading the serial line
+  if (_current == nullptr) {
+    if (!_holdingLine && _at->tryLock()) {
+      _holdingLine = true;
+    }
+    if (_holdingLine) {
+      _readPendingLines();
+    }
+  }
+
+  std::vector<URCAwaiter *> due;
+  uint32_t now = MILLIS();
+  for (auto it = _urcWaiters.begin(); it != _urcWaiters.end();) {
+    URCAwaiter *waiter = *it;
+    if (_at->_takeURC(waiter->_prefix, waiter->_result.value)) {
+      waiter->_result.response = ATCommandHandler::ExpArg1;
+    } else if ((now - waiter->_startTime) >= waiter->_timeoutMs) {
+      waiter->_result.response = ATCommandHandler::Timeout;
+    } else {
+      ++it;
+      continue;
+    }
+    _at->_forgetURC(waiter->_prefix);
+    due.push_back(waiter);
+    it = _urcWaiters.erase(it);
+  }
+
+  for (URCAwaiter *waiter : due) {
+    waiter->_handle.resume();
+  }
+}
+
+void ATEngine::_pollConditions() {
+  std::vector<ConditionAwaiter *> due;
+  for (auto it = _conditions.begin(); it != _conditions.end();) {
+    if ((*it)->_ready()) {
+      due.push_back(*it);
+      it = _conditions.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  for (ConditionAwaiter *condition : due) {
+    condition->_handle.resume();
+  }
+}
+
+void ATEngine::_pollDelay() {
+  std::vector<DelayAwaiter *> due;
+  uint32_t now = MILLIS();
+  for (auto it = _delays.begin(); it != _delays.end();) {
+    if ((now - (*it)->_startTime) >= (*it)->_delayMs) {
+      due.push_back(*it);
+      it = _delays.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  for (DelayAwaiter *delay : due) {
+    delay->_handle.resume();
+  }
+}
+
+bool ATEngine::_readPendingLines() {
+  while (_at->_available()) {
+    char b = _at->_read();
+    if (b == '\n') {
+      _at->_stashURC(_line.c_str(), _line.length());
+      _line.clear();
+    } else if (b != '\r') {
+      _appendLine(b);
+    }
+  }
+
+  // Partial line that never complete is not worth holding the serial line
+  if (!_line.empty() && (MILLIS() - _lineStartTime) >= PARTIAL_LINE_TIMEOUT_MS) {
+    AG_LOGW(TAG, "Drop incomplete line: %s", _line.c_str());
+    _line.clear();
+  }
+
+  return _line.empty();
+}
+
+void ATEngine::_appendLine(char b) {
+  if (_line.empty()) {
+    _lineStartTime = MILLIS();
+  }
+  _line += b;
+}
+
+#endif // CONFIG_CELLULAR_COROUTINE_ENGINE
+
+#endif // ESP8266
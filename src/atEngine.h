@@ -0,0 +1,345 @@
+/**
+ * AirGradient
+ * https://airgradient.com
+ *
+ * CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
+ */
+
+#ifndef AT_ENGINE_H
+#define AT_ENGINE_H
+
+#ifndef ESP8266
+
+#include "sdkconfig.h"
+
+#if CONFIG_CELLULAR_COROUTINE_ENGINE
+
+#if !defined(__cpp_impl_coroutine)
+#error "CONFIG_CELLULAR_COROUTINE_ENGINE needs C++20 coroutine, build with -std=gnu++20"
+#endif
+
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "atCommandHandler.h"
+
+#ifndef CONFIG_CELLULAR_COROUTINE_TASK_STACK
+// This configuration define by kconfig
+#define CONFIG_CELLULAR_COROUTINE_TASK_STACK 4096
+#endif
+
+/**
+ * @brief Coroutine of an AT operation driven by ATEngine. Lazily started, it runs once awaited
+ * by another ATTask or spawned with ATEngine::spawn(). T must be default constructible, use
+ * bool for operation without result
+ *
+ * ```
+ * ATTask<int> signal(ATEngine &engine) {
+ *   ATResult result = co_await engine.command("+CSQ");
+ *   ...
+ *   co_return rssi;
+ * }
+ * ```
+ */
+template <typename T> class ATTask {
+public:
+  struct promise_type {
+    T value{};
+    std::coroutine_handle<> continuation;
+
+    struct FinalAwaiter {
+      bool await_ready() noexcept { return false; }
+      // Resume the awaiting coroutine right away, without going back to the scheduler
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+        std::coroutine_handle<> next = h.promise().continuation;
+        return next ? next : std::noop_coroutine();
+      }
+      void await_resume() noexcept {}
+    };
+
+    ATTask get_return_object() {
+      return ATTask(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void return_value(T v) { value = std::move(v); }
+    // Component built without exception
+    void unhandled_exception() { abort(); }
+  };
+
+  ATTask(ATTask &&other) noexcept : _handle(std::exchange(other._handle, nullptr)) {}
+  ATTask(const ATTask &) = delete;
+  ATTask &operator=(const ATTask &) = delete;
+  ATTask &operator=(ATTask &&) = delete;
+  ~ATTask() {
+    if (_handle) {
+      _handle.destroy();
+    }
+  }
+
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+    _handle.promise().continuation = awaiting;
+    return _handle;
+  }
+  T await_resume() { return std::move(_handle.promise().value); }
+
+private:
+  friend class ATEngine;
+  explicit ATTask(std::coroutine_handle<promise_type> handle) : _handle(handle) {}
+
+  std::coroutine_handle<promise_type> _handle;
+};
+
+/**
+ * @brief Result of an awaited AT command or URC
+ */
+struct ATResult {
+  ATCommandHandler::Response response = ATCommandHandler::Timeout;
+  // Intermediate result lines of the command, without linebreak
+  std::vector<std::string> lines;
+  // Raw bytes announced by the data prefix line, eg. +HTTPREAD body
+  std::string data;
+  // URC value after prefix, without leading whitespace
+  std::string value;
+};
+
+/**
+ * @brief Run AT operations written as coroutines on a single scheduler task
+ *
+ * Each co_await of command() or urc() suspends the coroutine instead of blocking the task. The
+ * scheduler sends queued commands, reads the serial line and resumes the coroutine once its
+ * final result, URC or delay is due. Serial line is acquired from ATCommandHandler only while a
+ * command is in flight, so blocking API of other tasks keep working alongside, and a
+ * coroutine waiting for +HTTPACTION let others run their commands meanwhile
+ *
+ * ```
+ * ATEngine engine(at);
+ * engine.startTask();
+ * engine.spawn(module.httpGetAsync(url), [](CellResult<CellularModule::HttpResponse> &result) {
+ *   ...
+ * });
+ * ```
+ */
+class ATEngine {
+public:
+  /**
+   * @brief Command to send, see command()
+   */
+  struct Request {
+    std::string cmd;
+    uint32_t timeoutMs;
+    const char *terminator;
+    const char *dataPrefix;
+    bool raw;
+  };
+
+  class CommandAwaiter {
+  public:
+    CommandAwaiter(ATEngine *engine, Request request)
+        : _engine(engine), _request(std::move(request)) {}
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle);
+    ATResult await_resume() { return std::move(_result); }
+
+  private:
+    friend class ATEngine;
+    ATEngine *_engine;
+    Request _request;
+    ATResult _result;
+    std::coroutine_handle<> _handle;
+    uint32_t _sentTime = 0;
+    ATCommandHandler::CommandClass _sampleClass = ATCommandHandler::LocalCommand;
+    bool _sample = false;
+    int _dataRemaining = 0;
+  };
+
+  class URCAwaiter {
+  public:
+    URCAwaiter(ATEngine *engine, const char *prefix, uint32_t timeoutMs)
+        : _engine(engine), _prefix(prefix), _timeoutMs(timeoutMs) {}
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle);
+    ATResult await_resume() { return std::move(_result); }
+
+  private:
+    friend class ATEngine;
+    ATEngine *_engine;
+    const char *_prefix;
+    uint32_t _timeoutMs;
+    uint32_t _startTime = 0;
+    ATResult _result;
+    std::coroutine_handle<> _handle;
+  };
+
+  class DelayAwaiter {
+  public:
+    DelayAwaiter(ATEngine *engine, uint32_t delayMs) : _engine(engine), _delayMs(delayMs) {}
+    bool await_ready() const noexcept { return _delayMs == 0; }
+    void await_suspend(std::coroutine_handle<> handle);
+    void await_resume() {}
+
+  private:
+    friend class ATEngine;
+    ATEngine *_engine;
+    uint32_t _delayMs;
+    uint32_t _startTime = 0;
+    std::coroutine_handle<> _handle;
+  };
+
+  class ConditionAwaiter {
+  public:
+    ConditionAwaiter(ATEngine *engine, std::function<bool()> ready)
+        : _engine(engine), _ready(std::move(ready)) {}
+    bool await_ready() { return _ready(); }
+    void await_suspend(std::coroutine_handle<> handle);
+    void await_resume() {}
+
+  private:
+    friend class ATEngine;
+    ATEngine *_engine;
+    std::function<bool()> _ready;
+    std::coroutine_handle<> _handle;
+  };
+
+  explicit ATEngine(ATCommandHandler *at) : _at(at) {}
+  /**
+   * @brief Stop the scheduler task, which release the serial line it hold. Without
+   * startTask(), destroy from the task calling poll()
+   */
+  ~ATEngine();
+  ATEngine(const ATEngine &) = delete;
+  ATEngine &operator=(const ATEngine &) = delete;
+
+  /**
+   * @brief Send AT command and suspend until its final result
+   *
+   * ```
+   * ATResult result = co_await engine.command("+HTTPREAD=0,200", 0, "+HTTPREAD: 0", "+HTTPREAD:");
+   * result.data // body chunk
+   * ```
+   *
+   * @param cmd command without "AT" prefix and linebreak, copied
+   * @param timeoutMs how long to wait for final result, 0 to derive from observed latency
+   * @param terminator line that end the command instead of OK, also matched on prompt without
+   * linebreak. Eg. ">" or "DOWNLOAD"
+   * @param dataPrefix line prefix followed by byte count, that many raw bytes after the line are
+   * placed in ATResult::data
+   */
+  CommandAwaiter command(const char *cmd, uint32_t timeoutMs = 0, const char *terminator = nullptr,
+                         const char *dataPrefix = nullptr);
+
+  /**
+   * @brief Same as command() but send data as is, eg. payload after ">" prompt
+   */
+  CommandAwaiter sendRaw(const std::string &data, uint32_t timeoutMs = 0);
+
+  /**
+   * @brief Suspend until URC with prefix received, without holding the serial line.
+   * Await right after the command that produce it, before awaiting anything else
+   *
+   * @param prefix URC prefix, must outlive the wait. Eg. "+HTTPACTION:"
+   * @param timeoutMs how long to wait for the URC
+   */
+  URCAwaiter urc(const char *prefix, uint32_t timeoutMs);
+
+  /**
+   * @brief Suspend for a while, instead of sleeping the task
+   */
+  DelayAwaiter delay(uint32_t delayMs);
+
+  /**
+   * @brief Suspend until ready() return true, checked on every scheduler step
+   *
+   * @param ready called on scheduler task, must not block
+   */
+  ConditionAwaiter until(std::function<bool()> ready);
+
+  /**
+   * @brief Run a coroutine on the scheduler. Can be called from any task
+   *
+   * @param task coroutine to run
+   * @param onDone called on scheduler task with coroutine result once finished
+   */
+  template <typename T>
+  void spawn(ATTask<T> task, std::function<void(T &)> onDone = std::function<void(T &)>()) {
+    ATTask<bool> root = _complete<T>(std::move(task), std::move(onDone));
+    std::lock_guard<std::mutex> lock(_spawnMutex);
+    _spawned.push_back(std::exchange(root._handle, nullptr));
+  }
+
+  /**
+   * @brief Do one scheduler step; start spawned coroutines, read the serial line and resume
+   * coroutines that are due. Call repeatedly from the same task if not using startTask()
+   *
+   * @return true if any coroutine still in flight
+   */
+  bool poll();
+
+  /**
+   * @brief Create a FreeRTOS task that keep calling poll()
+   *
+   * @return true if task created
+   */
+  bool startTask(UBaseType_t priority = 5, uint32_t stackSize = CONFIG_CELLULAR_COROUTINE_TASK_STACK);
+
+private:
+  const char *const TAG = "ATEngine";
+
+  typedef std::coroutine_handle<ATTask<bool>::promise_type> RootHandle;
+
+  template <typename T>
+  static ATTask<bool> _complete(ATTask<T> task, std::function<void(T &)> onDone) {
+    T value = co_await task;
+    if (onDone) {
+      onDone(value);
+    }
+    co_return true;
+  }
+
+  static void _taskEntry(void *arg);
+  void _pollCommand();
+  void _pollURC();
+  void _pollDelay();
+  void _pollConditions();
+  void _finishCommand(ATCommandHandler::Response response);
+  bool _readPendingLines();
+  void _appendLine(char b);
+
+  ATCommandHandler *_at;
+  TaskHandle_t _task = nullptr;
+  std::atomic<bool> _stopRequested{false};
+  std::atomic<bool> _stopped{false};
+  bool _holdingLine = false;
+  // Command sent by a coroutine resumed from its previous command go first, to keep prompt
+  // and data of one transaction together
+  bool _resumingOwner = false;
+
+  std::mutex _spawnMutex;
+  std::vector<RootHandle> _spawned;
+  std::vector<RootHandle> _roots;
+
+  std::deque<CommandAwaiter *> _commands;
+  CommandAwaiter *_current = nullptr;
+  std::string _line;
+  uint32_t _lineStartTime = 0;
+  std::vector<URCAwaiter *> _urcWaiters;
+  std::vector<DelayAwaiter *> _delays;
+  std::vector<ConditionAwaiter *> _conditions;
+};
+
+#endif // CONFIG_CELLULAR_COROUTINE_ENGINE
+
+#endif // ESP8266
+#endif // AT_ENGINE_H
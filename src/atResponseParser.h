@@ -0,0 +1,210 @@
+/**
+ * AirGradient
+ * https://airgradient.com
+ *
+ * CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
+ */
+
+#ifndef AT_RESPONSE_PARSER_H
+#define AT_RESPONSE_PARSER_H
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+/**
+ * @brief Tokenize comma separated values of an AT response line in place, without copy nor
+ * allocation. Each next*() consume one field and return false if the field is missing or
+ * malformed, leaving the output untouched
+ *
+ * ```
+ * // +HTTPACTION: 0,200,1024
+ * ATResponseParser parser(line);
+ * int method, code, len;
+ * if (parser.skipPrefix("+HTTPACTION:") && parser.nextInt(method) && parser.nextInt(code) &&
+ *     parser.nextInt(len)) { ... }
+ * ```
+ */
+class ATResponseParser {
+public:
+  ATResponseParser(const char *data, size_t length) : _cur(data), _end(data + length) {}
+  explicit ATResponseParser(const char *data) : ATResponseParser(data, strlen(data)) {}
+  explicit ATResponseParser(const std::string &data)
+      : ATResponseParser(data.c_str(), data.length()) {}
+
+  /**
+   * @brief Skip prefix and following whitespace if line starts with it. Eg. "+CSQ:"
+   *
+   * @return true if prefix found
+   */
+  bool skipPrefix(const char *prefix) {
+    size_t length = strlen(prefix);
+    if (static_cast<size_t>(_end - _cur) < length || memcmp(_cur, prefix, length) != 0) {
+      return false;
+    }
+    _cur += length;
+    _skipWhitespace();
+    return true;
+  }
+
+  /**
+   * @brief Parse signed decimal field
+   */
+  bool nextInt(int &out) {
+    _skipWhitespace();
+    const char *p = _cur;
+    bool negative = false;
+    if (p < _end && (*p == '-' || *p == '+')) {
+      negative = (*p == '-');
+      p++;
+    }
+
+    const char *digits = p;
+    long long value = 0;
+    while (p < _end && *p >= '0' && *p <= '9') {
+      value = value * 10 + (*p - '0');
+      if (value > INT_MAX) {
+        return false;
+      }
+      p++;
+    }
+    if (p == digits) {
+      return false;
+    }
+
+    const char *fieldEnd = p;
+    if (!_endField(fieldEnd)) {
+      return false;
+    }
+    out = negative ? static_cast<int>(-value) : static_cast<int>(value);
+    return true;
+  }
+
+  /**
+   * @brief Parse hexadecimal field, with or without "0x" prefix. Eg. band mask
+   */
+  bool nextHex(uint64_t &out) {
+    _skipWhitespace();
+    const char *p = _cur;
+    if ((_end - p) >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+      p += 2;
+    }
+
+    const char *digits = p;
+    uint64_t value = 0;
+    while (p < _end) {
+      int nibble;
+      if (*p >= '0' && *p <= '9') {
+        nibble = *p - '0';
+      } else if (*p >= 'a' && *p <= 'f') {
+        nibble = *p - 'a' + 10;
+      } else if (*p >= 'A' && *p <= 'F') {
+        nibble = *p - 'A' + 10;
+      } else {
+        break;
+      }
+      if ((p - digits) >= 16) {
+        return false;
+      }
+      value = (value << 4) | nibble;
+      p++;
+    }
+    if (p == digits) {
+      return false;
+    }
+
+    const char *fieldEnd = p;
+    if (!_endField(fieldEnd)) {
+      return false;
+    }
+    out = value;
+    return true;
+  }
+
+  /**
+   * @brief Get string field as range of the parsed line, quotes removed if quoted
+   *
+   * @param out start of the string, only valid as long as the parsed line
+   * @param length length of the string
+   */
+  bool nextString(const char *&out, size_t &length) {
+    _skipWhitespace();
+    const char *start = _cur;
+    const char *stop;
+    const char *fieldEnd;
+    if (start < _end && *start == '"') {
+      start++;
+      stop = static_cast<const char *>(memchr(start, '"', _end - start));
+      if (stop == nullptr) {
+        return false;
+      }
+      fieldEnd = stop + 1;
+    } else {
+      stop = start;
+      while (stop < _end && *stop != ',') {
+        stop++;
+      }
+      fieldEnd = stop;
+    }
+
+    if (!_endField(fieldEnd)) {
+      return false;
+    }
+    out = start;
+    length = stop - start;
+    return true;
+  }
+
+  /**
+   * @brief Check if string field equal to expected value, quotes excluded
+   */
+  bool nextStringEquals(const char *expected) {
+    const char *value;
+    size_t length;
+    if (!nextString(value, length)) {
+      return false;
+    }
+    return length == strlen(expected) && memcmp(value, expected, length) == 0;
+  }
+
+  /**
+   * @brief Skip one field regardless of its type
+   */
+  bool skipField() {
+    const char *value;
+    size_t length;
+    return nextString(value, length);
+  }
+
+  /**
+   * @brief Check if all fields consumed
+   */
+  bool atEnd() const { return _cur >= _end; }
+
+private:
+  const char *_cur;
+  const char *_end;
+
+  void _skipWhitespace() {
+    while (_cur < _end && (*_cur == ' ' || *_cur == '\r' || *_cur == '\n')) {
+      _cur++;
+    }
+  }
+
+  // Field must be followed by separator or end of line, then move past it
+  bool _endField(const char *fieldEnd) {
+    const char *p = fieldEnd;
+    while (p < _end && (*p == ' ' || *p == '\r' || *p == '\n')) {
+      p++;
+    }
+    if (p < _end && *p != ',') {
+      return false;
+    }
+    _cur = (p < _end) ? p + 1 : p;
+    return true;
+  }
+};
+
+#endif // AT_RESPONSE_PARSER_H
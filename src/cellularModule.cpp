@@ -48,6 +48,12 @@ CellularModule::httpGet(const std::string &url, int connectionTimeout, int respo
   return CellResult<HttpResponse>();
 }
 
+CellResult<CellularModule::HttpResponse>
+CellularModule::httpGetIfNoneMatch(const std::string &url, const char *etag,
+                                   int connectionTimeout, int responseTimeout) {
+  return httpGet(url, connectionTimeout, responseTimeout);
+}
+
 CellResult<CellularModule::HttpResponse>
 CellularModule::httpPost(const std::string &url, const std::string &body,
                          const std::string &headContentType, int connectionTimeout,
@@ -67,6 +73,45 @@ CellReturnStatus CellularModule::mqttPublish(const std::string &topic, const std
   return CellReturnStatus::Error;
 }
 
+CellResult<int> CellularModule::socketOpen(const std::string &host, int port, uint32_t timeoutMs) {
+  return CellResult<int>{CellReturnStatus::Error, -1};
+}
+
+CellResult<int> CellularModule::socketSend(int socket, const char *data, int length) {
+  return CellResult<int>{CellReturnStatus::Error, 0};
+}
+
+CellResult<int> CellularModule::socketRecv(int socket, char *buffer, int size, uint32_t timeoutMs) {
+  return CellResult<int>{CellReturnStatus::Error, 0};
+}
+
+CellReturnStatus CellularModule::socketClose(int socket) { return CellReturnStatus::Error; }
+
+CellResult<int> CellularModule::udpOpen(int localPort) {
+  return CellResult<int>{CellReturnStatus::Error, -1};
+}
+
+CellResult<int> CellularModule::socketSendTo(int socket, const std::string &host, int port,
+                                             const char *data, int length) {
+  return CellResult<int>{CellReturnStatus::Error, 0};
+}
+
+void CellularModule::setHttpsCACert(const char *caPem) {}
+
+CellReturnStatus CellularModule::enterDataMode() { return CellReturnStatus::Error; }
+
+CellReturnStatus CellularModule::exitDataMode() { return CellReturnStatus::Error; }
+
+CellReturnStatus CellularModule::startMultiplexer() { return CellReturnStatus::Error; }
+
+CellReturnStatus CellularModule::stopMultiplexer() { return CellReturnStatus::Error; }
+
+CellularModule::DnsStats CellularModule::getDnsStats() { return DnsStats(); }
+
+void CellularModule::setDeadline(uint32_t budgetMs) {}
+
+bool CellularModule::isDeadlineExceeded() { return false; }
+
 int CellularModule::csqToDbm(int csq) {
   if (csq == 99) {
     // Unknown or undetectable
@@ -8,6 +8,7 @@
 #ifndef CELLULAR_MODULE_H
 #define CELLULAR_MODULE_H
 
+#include <cstdint>
 #include <memory>
 #include <string>
 
@@ -15,7 +16,8 @@ enum class CellReturnStatus {
   Ok = 1, // command is success and return expected value
   Failed, // command is success but not return expected value
   Error,  // module return error after command sent
-  Timeout // module not return anything
+  Timeout, // module not return anything
+  DeadlineExceeded // operation budget set with setDeadline() spent before it finished
 };
 
 template <typename T> struct CellResult {
@@ -27,10 +29,35 @@ enum class CellTechnology { Auto, TWO_G, LTE_M, LTE_NB_IOT, LTE };
 
 class CellularModule {
 public:
+  // Body either allocated for the response, or points to module buffer valid until next request
+  struct BodyDeleter {
+    bool owned;
+    BodyDeleter() : owned(true) {}
+    explicit BodyDeleter(bool owned) : owned(owned) {}
+    void operator()(char *body) const {
+      if (owned) {
+        delete[] body;
+      }
+    }
+  };
+
   struct HttpResponse {
     int statusCode;
-    std::unique_ptr<char[]> body;
+    std::unique_ptr<char[], BodyDeleter> body;
     int bodyLen;
+    // ETag header, only read by httpGetIfNoneMatch(). Valid until next request
+    const char *etag = nullptr;
+    // Retry-After header of httpPost() answered 429 or 503, nullptr if not provided. Valid until
+    // next request
+    const char *retryAfter = nullptr;
+  };
+
+  // Host lookups through module DNS cache, counted since module initialized
+  struct DnsStats {
+    uint32_t lookups = 0;   // lookup sent to the module
+    uint32_t failures = 0;  // lookup failed, request left to resolve host itself
+    uint32_t cacheHits = 0; // request sent to cached address
+    uint32_t savedMs = 0;   // lookup time of cached address, summed over hits
   };
 
   // URL, Headers opt?, conn timeout, recv timeout,
@@ -40,8 +67,11 @@ public:
   virtual ~CellularModule();
 
   virtual bool init();
+  // Return when module powered on, or right after power key pulse if there's no way to know
   virtual void powerOn();
+  // When forced, return when module completely powered off and ready to be powered on again
   virtual void powerOff(bool force = false);
+  // Return when module restarted, call reinitialize() afterward to make sure module is ready
   virtual bool reset();
   virtual void sleep();
   virtual CellResult<std::string> getModuleInfo();
@@ -56,15 +86,50 @@ public:
   virtual CellReturnStatus reinitialize();
   virtual CellResult<HttpResponse> httpGet(const std::string &url, int connectionTimeout = -1,
                                            int responseTimeout = -1);
+  // GET with If-None-Match; statusCode 304 without body when etag still current. Empty etag
+  // to only read ETag of the response
+  virtual CellResult<HttpResponse> httpGetIfNoneMatch(const std::string &url, const char *etag,
+                                                      int connectionTimeout = -1,
+                                                      int responseTimeout = -1);
   virtual CellResult<HttpResponse> httpPost(const std::string &url, const std::string &body,
                                             const std::string &headContentType = "",
                                             int connectionTimeout = -1, int responseTimeout = -1);
+  // CA certificate (PEM) verifying https:// server of httpGet() and httpPost(), uploaded to the
+  // module once on first https request. Must stay valid while module in use
+  virtual void setHttpsCACert(const char *caPem);
   virtual CellReturnStatus mqttConnect(const std::string &clientId, const std::string &host,
                                        int port = 1883, std::string username = "",
                                        std::string password = "");
   virtual CellReturnStatus mqttDisconnect();
   virtual CellReturnStatus mqttPublish(const std::string &topic, const std::string &payload,
                                        int qos = 1, int retain = 0, int timeoutS = 15);
+  // TCP socket on module IP stack, stay connected across calls until closed. For protocols not
+  // covered by HTTP and MQTT engine, eg. HTTP/1.1 keep-alive. Open return the socket id
+  virtual CellResult<int> socketOpen(const std::string &host, int port, uint32_t timeoutMs = 30000);
+  // Return number of bytes accepted by the module
+  virtual CellResult<int> socketSend(int socket, const char *data, int length);
+  // Return number of bytes placed in buffer, Timeout if nothing received within timeoutMs
+  virtual CellResult<int> socketRecv(int socket, char *buffer, int size, uint32_t timeoutMs = 0);
+  virtual CellReturnStatus socketClose(int socket);
+  // UDP socket bound to localPort, 0 to let the module pick one. Send with socketSendTo(),
+  // receive with socketRecv()
+  virtual CellResult<int> udpOpen(int localPort = 0);
+  // Send one datagram to host, return number of bytes accepted by the module
+  virtual CellResult<int> socketSendTo(int socket, const std::string &host, int port,
+                                       const char *data, int length);
+  // Switch serial line to PPP data mode; AT operations of every task wait until exitDataMode()
+  virtual CellReturnStatus enterDataMode();
+  virtual CellReturnStatus exitDataMode();
+  // Run GSM 07.10 multiplexer over the serial line, so status queries go on their own channel
+  // and don't wait behind long running operations
+  virtual CellReturnStatus startMultiplexer();
+  virtual CellReturnStatus stopMultiplexer();
+  // Lookups done and time saved by cached host address
+  virtual DnsStats getDnsStats();
+  // Bound following operations, including their retries, to finish within budgetMs from now.
+  // Operation that cannot finish in time return DeadlineExceeded. 0 to remove the bound
+  virtual void setDeadline(uint32_t budgetMs);
+  virtual bool isDeadlineExceeded();
 
   // Generic functions
 
@@ -82,4 +147,18 @@ private:
   /* data */
 };
 
+/**
+ * @brief Apply operation deadline to a cellular module for the lifetime of this object
+ */
+class CellDeadlineScope {
+public:
+  CellDeadlineScope(CellularModule *cell, uint32_t budgetMs) : cell_(cell) {
+    cell_->setDeadline(budgetMs);
+  }
+  ~CellDeadlineScope() { cell_->setDeadline(0); }
+
+private:
+  CellularModule *cell_;
+};
+
 #endif // CELLULAR_MODULE_H
@@ -12,16 +12,55 @@
 #include "cellularModuleA7672xx.h"
 #include <cstdint>
 #include <memory>
+#include <new>
 #include <cstring>
+#include <strings.h>
+#include <vector>
 
 #include "common.h"
 #include "agLogger.h"
+#include "agResourceMonitor.h"
+#include "agTrace.h"
 #include "agSerial.h"
 #include "cellularModule.h"
 #include "atCommandHandler.h"
+#include "atResponseParser.h"
 #include "cellularModule.h"
 
-#define REGIS_RETRY_DELAY() DELAY_MS(1000);
+#ifdef ARDUINO
+#include "nvs.h"
+#endif
+
+#define REGIS_RETRY_DELAY() _delayWithinDeadline(1000);
+
+// Result URC of long running command, waited without holding the serial line
+static const char URC_HTTPACTION[] = "+HTTPACTION:";
+static const char URC_MQTT_CONNECT[] = "+CMQTTCONNECT: 0,";
+static const char URC_MQTT_DISCONNECT[] = "+CMQTTDISC: 0,";
+static const char URC_MQTT_PUBLISH[] = "+CMQTTPUB: 0,";
+static const char URC_NETOPEN[] = "+NETOPEN:";
+static const char URC_DNS[] = "+CDNSGIP:";
+// Socket result URC per link, so operation on different sockets don't take each other result
+static const char *const URC_SOCKET_OPEN[] = {"+CIPOPEN: 0,", "+CIPOPEN: 1,", "+CIPOPEN: 2,",
+                                              "+CIPOPEN: 3,"};
+static const char *const URC_SOCKET_SEND[] = {"+CIPSEND: 0,", "+CIPSEND: 1,", "+CIPSEND: 2,",
+                                              "+CIPSEND: 3,"};
+static const char *const URC_SOCKET_CLOSE[] = {"+CIPCLOSE: 0,", "+CIPCLOSE: 1,", "+CIPCLOSE: 2,",
+                                               "+CIPCLOSE: 3,"};
+
+#ifdef ARDUINO
+#define BAUD_RATE_NVS_NAMESPACE "agcell"
+#define BAUD_RATE_NVS_KEY "baud"
+// Baud rate attempted when negotiate, from highest. Supported by both A7672 and WK2132
+static const int BAUD_RATE_CANDIDATES[] = {460800, 230400};
+#endif
+
+#if CONFIG_TRACE_ENABLED
+// Follow NetworkRegistrationState order
+static const char *const NETWORK_REGISTRATION_STATE_NAMES[] = {
+    "CHECK_MODULE_READY", "PREPARE_REGISTRATION", "CHECK_NETWORK_REGISTRATION",
+    "ENSURE_SERVICE_READY", "CONFIGURE_NETWORK", "CONFIGURE_SERVICE", "NETWORK_REGISTERED"};
+#endif
 
 CellularModuleA7672XX::CellularModuleA7672XX(AirgradientSerial *agSerial) : agSerial_(agSerial) {}
 
@@ -30,19 +69,27 @@ CellularModuleA7672XX::CellularModuleA7672XX(AirgradientSerial *agSerial, int po
   _powerIO = static_cast<gpio_num_t>(powerPin);
 }
 
-CellularModuleA7672XX::~CellularModuleA7672XX() {
-  if (at_ != nullptr) {
-    delete at_;
-    at_ = nullptr;
-  }
+CellularModuleA7672XX::CellularModuleA7672XX(AirgradientSerial *agSerial, int powerPin,
+                                             int statusPin) {
+  agSerial_ = agSerial;
+  _powerIO = static_cast<gpio_num_t>(powerPin);
+  _statusIO = static_cast<gpio_num_t>(statusPin);
 }
 
+CellularModuleA7672XX::~CellularModuleA7672XX() { _destroyATHandler(); }
+
 bool CellularModuleA7672XX::init() {
+  AG_RESOURCE_SCOPE("A7672XX::init");
   if (_initialized) {
     AG_LOGI(TAG, "Already initialized");
     return true;
   }
 
+  if (_statusIO != GPIO_NUM_NC) {
+    gpio_reset_pin(_statusIO);
+    gpio_set_direction(_statusIO, GPIO_MODE_INPUT);
+  }
+
   if (_powerIO != GPIO_NUM_NC) {
     gpio_reset_pin(_powerIO);
     gpio_set_direction(_powerIO, GPIO_MODE_OUTPUT);
@@ -53,12 +100,18 @@ bool CellularModuleA7672XX::init() {
   //! NO! it should initialized here! Right?
   // TODO: Add sanity check
 
+#if CONFIG_CELLULAR_STATIC_BUFFERS
+  _dnsUrl.reserve(200);
+  _dnsResponse.reserve(URC_LINE_MAX);
+#endif
+
   // Initialize cellular module and wait for module to ready
-  at_ = new ATCommandHandler(agSerial_);
+  _createATHandler();
+  at_->loadLatencyStats();
   AG_LOGI(TAG, "Checking module readiness...");
-  if (!at_->testAT()) {
+  if (!_testATAnyBaudRate(60000)) {
     AG_LOGW(TAG, "Failed wait cellular module to ready");
-    delete at_;
+    _destroyATHandler();
     return false;
   }
 
@@ -71,62 +124,98 @@ bool CellularModuleA7672XX::init() {
   // Disable echo
   at_->sendAT("E0");
   at_->waitResponse();
-  DELAY_MS(2000);
 
   // TODO: Need to validate the response?
   // Disable GPRS event reporting (URC)
   at_->sendAT("+CGEREP=0");
   at_->waitResponse();
-  DELAY_MS(2000);
 
   // Print product identification information
   at_->sendRaw("ATI");
   at_->waitResponse();
 
+#ifdef ARDUINO
+  _negotiateBaudRate();
+  _applyFlowControl();
+#endif
+
   _initialized = true;
   return true;
 }
 
 void CellularModuleA7672XX::powerOn() {
+  AG_RESOURCE_SCOPE("A7672XX::powerOn");
+  if (_statusIO != GPIO_NUM_NC && gpio_get_level(_statusIO) == 1) {
+    // Another PWRKEY pulse would turn the module off
+    AG_LOGI(TAG, "Module already powered on");
+    return;
+  }
+
+  // Make sure PWRKEY released before the pulse
   gpio_set_level(_powerIO, 0);
-  DELAY_MS(500);
+  DELAY_MS(CONFIG_CELLULAR_POWER_KEY_RELEASE_MS);
   gpio_set_level(_powerIO, 1);
-  DELAY_MS(100);
+  DELAY_MS(CONFIG_CELLULAR_POWER_ON_PULSE_MS);
   gpio_set_level(_powerIO, 0);
-  DELAY_MS(100);
+
+  // Without STATUS pin, readiness is checked by AT polling afterward
+  if (_statusIO != GPIO_NUM_NC && !_waitStatusLevel(1, 5000)) {
+    AG_LOGW(TAG, "STATUS pin not high after power on");
+  }
 }
 
 void CellularModuleA7672XX::powerOff(bool force) {
-  if (force) {
-    // Force power off
-    AG_LOGW(TAG, "Force module to power off");
-    gpio_set_level(_powerIO, 1);
-    DELAY_MS(1300);
-    gpio_set_level(_powerIO, 0);
-    return;
+  AG_RESOURCE_SCOPE("A7672XX::powerOff");
+  std::lock_guard<OperationMutex> operation(_operationMutex);
+  if (!force) {
+    ATCommandHandler::Transaction transaction(at_);
+    at_->sendAT("+CPOF");
+    if (at_->waitResponse() == ATCommandHandler::ExpArg1) {
+      AG_LOGI(TAG, "Module powered off");
+      _dropMultiplexer();
+      return;
+    }
   }
+  _dropMultiplexer();
 
-  at_->sendAT("+CPOF");
-  if (at_->waitResponse() != ATCommandHandler::ExpArg1) {
-    // Force power off
-    AG_LOGW(TAG, "Force module to power off");
-    gpio_set_level(_powerIO, 1);
-    DELAY_MS(1300);
-    gpio_set_level(_powerIO, 0);
-    return;
-  }
+  // Force power off
+  AG_LOGW(TAG, "Force module to power off");
+  gpio_set_level(_powerIO, 1);
+  _delayWithinDeadline(1300);
+  gpio_set_level(_powerIO, 0);
 
-  AG_LOGI(TAG, "Module powered off");
+  // Module needs time to shut down before it can be powered on again
+  if (!_waitStatusLevel(0, CONFIG_CELLULAR_POWER_OFF_WAIT_MS)) {
+    if (_statusIO == GPIO_NUM_NC) {
+      _delayWithinDeadline(CONFIG_CELLULAR_POWER_OFF_WAIT_MS);
+    } else {
+      AG_LOGW(TAG, "STATUS pin not low after power off");
+    }
+  }
 }
 
 bool CellularModuleA7672XX::reset() {
+  AG_RESOURCE_SCOPE("A7672XX::reset");
+  std::lock_guard<OperationMutex> operation(_operationMutex);
+  // Nothing else should talk to the module until it boot
+  ATCommandHandler::Transaction transaction(at_);
   at_->sendAT("+CRESET");
   if (at_->waitResponse() != ATCommandHandler::ExpArg1) {
     AG_LOGW(TAG, "Failed reset module");
     return false;
   }
 
-  AG_LOGI(TAG, "Success reset module");
+  AG_LOGI(TAG, "Success reset module, wait module to boot");
+  _dropMultiplexer();
+#ifdef ARDUINO
+  // Module boot with default baud rate
+  agSerial_->setBaudRate(DEFAULT_BAUD_RATE);
+#endif
+  if (!_waitModuleBoot(CONFIG_CELLULAR_BOOT_TIMEOUT_MS)) {
+    // Not an error, readiness still checked by AT polling when reinitialized
+    AG_LOGW(TAG, "Module boot URC not received");
+  }
+
   return true;
 }
 
@@ -135,21 +224,24 @@ void CellularModuleA7672XX::sleep() {}
 CellResult<std::string> CellularModuleA7672XX::getModuleInfo() { return CellResult<std::string>(); }
 
 CellResult<std::string> CellularModuleA7672XX::retrieveSimCCID() {
+  AG_RESOURCE_SCOPE("A7672XX::retrieveSimCCID");
+  StatusTransaction transaction(this);
+  ATCommandHandler *at = transaction.at();
   CellResult<std::string> result;
   result.status = CellReturnStatus::Timeout;
 
-  at_->sendAT("+CICCID");
-  if (at_->waitResponse("+ICCID:") != ATCommandHandler::ExpArg1) {
+  at->sendAT("+CICCID");
+  if (at->waitResponse("+ICCID:") != ATCommandHandler::ExpArg1) {
     return result;
   }
 
   std::string ccid;
-  if (at_->waitAndRecvRespLine(ccid) == -1) {
+  if (at->waitAndRecvRespLine(ccid) == -1) {
     return result;
   }
 
   // receive OK response from the buffer, ignore it
-  at_->waitResponse();
+  at->waitResponse();
 
   result.status = CellReturnStatus::Ok;
   result.data = ccid;
@@ -158,47 +250,46 @@ CellResult<std::string> CellularModuleA7672XX::retrieveSimCCID() {
 }
 
 CellReturnStatus CellularModuleA7672XX::isSimReady() {
-  at_->sendAT("+CPIN?");
-  if (at_->waitResponse("+CPIN:") != ATCommandHandler::ExpArg1) {
+  AG_RESOURCE_SCOPE("A7672XX::isSimReady");
+  StatusTransaction transaction(this);
+  ATCommandHandler *at = transaction.at();
+  at->sendAT("+CPIN?");
+  if (at->waitResponse("+CPIN:") != ATCommandHandler::ExpArg1) {
     return CellReturnStatus::Timeout;
   }
 
   // NOTE: Add other possible response and maybe add an enum then set it to result.data
-  if (at_->waitResponse("READY") != ATCommandHandler::ExpArg1) {
+  if (at->waitResponse("READY") != ATCommandHandler::ExpArg1) {
     return CellReturnStatus::Failed;
   }
 
   // receive OK response from the buffer, ignore it
-  at_->waitResponse();
+  at->waitResponse();
 
   return CellReturnStatus::Ok;
 }
 
 CellResult<int> CellularModuleA7672XX::retrieveSignal() {
+  AG_RESOURCE_SCOPE("A7672XX::retrieveSignal");
+  StatusTransaction transaction(this);
+  ATCommandHandler *at = transaction.at();
   CellResult<int> result;
   result.status = CellReturnStatus::Timeout;
 
-  at_->sendAT("+CSQ");
-  if (at_->waitResponse("+CSQ:") != ATCommandHandler::ExpArg1) {
+  at->sendAT("+CSQ");
+  if (at->waitResponse("+CSQ:") != ATCommandHandler::ExpArg1) {
     return result;
   }
 
   std::string received;
-  if (at_->waitAndRecvRespLine(received) == -1) {
+  if (at->waitAndRecvRespLine(received) == -1) {
     return result;
   }
 
-  // TODO: Make common function to seperate two values by comma
-  int signal = 99;
-  size_t pos = received.find(",");
-  if (pos != std::string::npos) {
-    // Ignore <ber> value, only <rssi>
-    std::string signalStr = received.substr(0, pos);
-    signal = std::stoi(signalStr);
-  }
+  int signal = _parseSignal(received);
 
   // receive OK response from the buffer, ignore it
-  at_->waitResponse();
+  at->waitResponse();
 
   result.status = CellReturnStatus::Ok;
   result.data = signal;
@@ -207,23 +298,26 @@ CellResult<int> CellularModuleA7672XX::retrieveSignal() {
 }
 
 CellResult<std::string> CellularModuleA7672XX::retrieveIPAddr() {
+  AG_RESOURCE_SCOPE("A7672XX::retrieveIPAddr");
+  StatusTransaction transaction(this);
+  ATCommandHandler *at = transaction.at();
   // CGPADDR
   CellResult<std::string> result;
   result.status = CellReturnStatus::Timeout;
 
   // Retrieve address from pdp cid 1
-  at_->sendAT("+CGPADDR=1");
-  if (at_->waitResponse("+CGPADDR: 1,") != ATCommandHandler::ExpArg1) {
+  at->sendAT("+CGPADDR=1");
+  if (at->waitResponse("+CGPADDR: 1,") != ATCommandHandler::ExpArg1) {
     return result;
   }
 
   std::string ipaddr;
-  if (at_->waitAndRecvRespLine(ipaddr) == -1) {
+  if (at->waitAndRecvRespLine(ipaddr) == -1) {
     return result;
   }
 
   // receive OK response from the buffer, ignore it
-  at_->waitResponse();
+  at->waitResponse();
 
   result.status = CellReturnStatus::Ok;
   result.data = ipaddr;
@@ -232,6 +326,9 @@ CellResult<std::string> CellularModuleA7672XX::retrieveIPAddr() {
 }
 
 CellReturnStatus CellularModuleA7672XX::isNetworkRegistered(CellTechnology ct) {
+  AG_RESOURCE_SCOPE("A7672XX::isNetworkRegistered");
+  StatusTransaction transaction(this);
+  ATCommandHandler *at = transaction.at();
   auto cmdNR = _mapCellTechToNetworkRegisCmd(ct);
   if (cmdNR.empty()) {
     return CellReturnStatus::Error;
@@ -239,25 +336,25 @@ CellReturnStatus CellularModuleA7672XX::isNetworkRegistered(CellTechnology ct) {
 
   char buf[15] = {0};
   sprintf(buf, "+%s?", cmdNR.c_str());
-  at_->sendAT(buf);
-  int resp = at_->waitResponse("+CREG:", "+CEREG:", "+CGREG:");
+  at->sendAT(buf);
+  int resp = at->waitResponse("+CREG:", "+CEREG:", "+CGREG:");
   if (resp != ATCommandHandler::ExpArg1 && resp != ATCommandHandler::ExpArg2 &&
       resp != ATCommandHandler::ExpArg3) {
     return CellReturnStatus::Timeout;
   }
 
   std::string recv;
-  if (at_->waitAndRecvRespLine(recv) == -1) {
+  if (at->waitAndRecvRespLine(recv) == -1) {
     return CellReturnStatus::Timeout;
   }
 
   auto crs = CellReturnStatus::Ok;
-  if (recv != "0,1" && recv != "0,5" && recv != "1,1" && recv != "1,5") {
+  if (!_isRegisteredStatus(recv)) {
     crs = CellReturnStatus::Failed;
   }
 
   // receive OK response from the buffer, ignore it
-  at_->waitResponse();
+  at->waitResponse();
 
   return crs;
 }
@@ -265,6 +362,8 @@ CellReturnStatus CellularModuleA7672XX::isNetworkRegistered(CellTechnology ct) {
 CellResult<std::string>
 CellularModuleA7672XX::startNetworkRegistration(CellTechnology ct, const std::string &apn,
                                                 uint32_t operationTimeoutMs) {
+  AG_RESOURCE_SCOPE("A7672XX::startNetworkRegistration");
+  std::lock_guard<OperationMutex> operation(_operationMutex);
   CellResult<std::string> result;
   result.status = CellReturnStatus::Timeout;
 
@@ -283,7 +382,11 @@ CellularModuleA7672XX::startNetworkRegistration(CellTechnology ct, const std::st
   bool finish = false;
 
   AG_LOGI(TAG, "Start operation network registration");
-  while ((MILLIS() - startOperationTime) < operationTimeoutMs && !finish) {
+  while ((MILLIS() - startOperationTime) < operationTimeoutMs && !finish &&
+         !isDeadlineExceeded()) {
+    AG_TRACE_SPAN("module", NETWORK_REGISTRATION_STATE_NAMES[state]);
+    // Each step take the serial line only for its own command exchange, so status query can
+    // slot in, also while waiting before retry
     switch (state) {
     case CHECK_MODULE_READY: {
       state = _implCheckModuleReady();
@@ -352,6 +455,7 @@ CellularModuleA7672XX::startNetworkRegistration(CellTechnology ct, const std::st
 
   if (state != NETWORK_REGISTERED) {
     AG_LOGW(TAG, "Register to network operation failed!");
+    result.status = _deadlineStatus(result.status);
     return result;
   }
 
@@ -360,8 +464,11 @@ CellularModuleA7672XX::startNetworkRegistration(CellTechnology ct, const std::st
 }
 
 CellReturnStatus CellularModuleA7672XX::reinitialize() {
+  AG_RESOURCE_SCOPE("A7672XX::reinitialize");
+  std::lock_guard<OperationMutex> operation(_operationMutex);
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
   AG_LOGI(TAG, "Initialize module");
-  if (!at_->testAT()) {
+  if (!_testATAnyBaudRate(60000)) {
     AG_LOGW(TAG, "Failed wait cellular module to ready");
     return CellReturnStatus::Error;
   }
@@ -369,18 +476,67 @@ CellReturnStatus CellularModuleA7672XX::reinitialize() {
   // Disable echo
   at_->sendAT("E0");
   at_->waitResponse();
-  DELAY_MS(2000);
 
   // Disable GPRS event reporting (URC)
   at_->sendAT("+CGEREP=0");
   at_->waitResponse();
-  DELAY_MS(2000);
+
+  // Module restarted, socket opened and SSL context configured before are gone
+  _netOpened = false;
+  memset(_socketOpened, 0, sizeof(_socketOpened));
+  _sslConfigured = false;
+  _dnsStats = DnsStats();
+
+#ifdef ARDUINO
+  // Module might be reset back to default baud rate
+  _negotiateBaudRate();
+  _applyFlowControl();
+#endif
 
   return CellReturnStatus::Ok;
 }
 
 CellResult<CellularModule::HttpResponse>
 CellularModuleA7672XX::httpGet(const std::string &url, int connectionTimeout, int responseTimeout) {
+  AG_RESOURCE_SCOPE("A7672XX::httpGet");
+  std::lock_guard<OperationMutex> operation(_operationMutex);
+  return _httpGetResolved(url, nullptr, connectionTimeout, responseTimeout);
+}
+
+CellResult<CellularModule::HttpResponse>
+CellularModuleA7672XX::httpGetIfNoneMatch(const std::string &url, const char *etag,
+                                          int connectionTimeout, int responseTimeout) {
+  AG_RESOURCE_SCOPE("A7672XX::httpGetIfNoneMatch");
+  std::lock_guard<OperationMutex> operation(_operationMutex);
+  return _httpGetResolved(url, etag != nullptr ? etag : "", connectionTimeout, responseTimeout);
+}
+
+CellResult<CellularModule::HttpResponse>
+CellularModuleA7672XX::_httpGetResolved(const std::string &url, const char *ifNoneMatch,
+                                        int connectionTimeout, int responseTimeout) {
+  char host[DNS_HOST_MAX] = {0};
+  const std::string *resolved = _dnsRewriteUrl(url, host);
+  if (resolved == nullptr) {
+    auto result = _httpGet(url, nullptr, ifNoneMatch, connectionTimeout, responseTimeout);
+    result.status = _deadlineStatus(result.status);
+    return result;
+  }
+
+  auto result = _httpGet(*resolved, host, ifNoneMatch, connectionTimeout, responseTimeout);
+  if (result.status != CellReturnStatus::Ok && !isDeadlineExceeded()) {
+    // Cached address might be stale, let module resolve the host again
+    AG_LOGW(TAG, "Request to cached address failed, retry with host %s", host);
+    _dnsForget(host);
+    result = _httpGet(url, nullptr, ifNoneMatch, connectionTimeout, responseTimeout);
+  }
+  result.status = _deadlineStatus(result.status);
+  return result;
+}
+
+CellResult<CellularModule::HttpResponse>
+CellularModuleA7672XX::_httpGet(const std::string &url, const char *hostHeader,
+                                const char *ifNoneMatch, int connectionTimeout,
+                                int responseTimeout) {
   CellResult<CellularModule::HttpResponse> result;
   result.status = CellReturnStatus::Error;
   ATCommandHandler::Response response;
@@ -401,6 +557,24 @@ CellularModuleA7672XX::httpGet(const std::string &url, int connectionTimeout, in
     return result;
   }
 
+  // +HTTPPARA set SSLCFG for https url
+  if (url.rfind("https://", 0) == 0) {
+    result.status = _httpSetSslContext();
+    if (result.status != CellReturnStatus::Ok) {
+      _httpTerminate();
+      return result;
+    }
+  }
+
+  // +HTTPPARA set USERDATA when URL host replaced by its address or conditional request
+  if (hostHeader != nullptr || (ifNoneMatch != nullptr && *ifNoneMatch != '\0')) {
+    result.status = _httpSetUserHeaders(hostHeader, ifNoneMatch);
+    if (result.status != CellReturnStatus::Ok) {
+      _httpTerminate();
+      return result;
+    }
+  }
+
   // +HTTPPARA set URL
   result.status = _httpSetUrl(url);
   if (result.status != CellReturnStatus::Ok) {
@@ -421,9 +595,13 @@ CellularModuleA7672XX::httpGet(const std::string &url, int connectionTimeout, in
       break;
     }
 
+    if (isDeadlineExceeded()) {
+      break;
+    }
+
     ESP_LOGW(TAG, "Retry HTTP request in 2s");
     counter += 1;
-    DELAY_MS(2000);
+    _delayWithinDeadline(2000);
   } while (counter < 3 && result.status == CellReturnStatus::Failed);
 
   // Final check if request is successful or not
@@ -435,19 +613,38 @@ CellularModuleA7672XX::httpGet(const std::string &url, int connectionTimeout, in
   AG_LOGI(TAG, "HTTP response code %d with body len: %d. Retrieving response body...", statusCode,
           bodyLen);
 
+  // Headers stay available until +HTTPTERM, only needed for conditional request
+  if (ifNoneMatch != nullptr && _httpReadHeaders() != CellReturnStatus::Ok) {
+    AG_LOGW(TAG, "Failed read response headers, ETag ignored");
+  }
+
   uint32_t retrieveStartTime = MILLIS();
   char *bodyResponse = nullptr;
   if (bodyLen > 0) {
+#if CONFIG_CELLULAR_STATIC_BUFFERS
+    if (bodyLen + 1 > CONFIG_CELLULAR_BODY_ARENA_SIZE) {
+      AG_LOGE(TAG, "Response body %d bytes exceed body buffer size", bodyLen);
+      _httpTerminate();
+      result.status = CellReturnStatus::Failed;
+      return result;
+    }
+    bodyResponse = _bodyArena;
+    char *buf = _readBuffer;
+#else
     // Create temporary memory to handle the buffer
     bodyResponse = new char[bodyLen + 1];
+    char *buf = new char[HTTPREAD_CHUNK_SIZE + 1]; // Add +1 to give a space at the end
+#endif
     memset(bodyResponse, 0, bodyLen + 1);
 
     // +HTTPREAD
     int offset = 0;
     int receivedBufferLen;
-    char *buf = new char[HTTPREAD_CHUNK_SIZE + 1]; // Add +1 to give a space at the end
 
     do {
+      AG_TRACE_SPAN("module", "HTTPREAD chunk");
+      // Status query of other task can slot in between chunks
+      ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
       memset(buf, 0, (HTTPREAD_CHUNK_SIZE + 1));
       sprintf(buf, "+HTTPREAD=%d,%d", offset, HTTPREAD_CHUNK_SIZE);
       at_->sendAT(buf);
@@ -465,7 +662,10 @@ CellularModuleA7672XX::httpGet(const std::string &url, int connectionTimeout, in
         AG_LOGW(TAG, "Failed retrieve +HTTPREAD value length");
         break;
       }
-      receivedBufferLen = std::stoi(buf);
+      if (!ATResponseParser(buf).nextInt(receivedBufferLen)) {
+        AG_LOGW(TAG, "Invalid +HTTPREAD value length: %s", buf);
+        break;
+      }
 
       // Receive body from http response with include whitespace since its a binary
       // Directly retrieve buffer with expected the expected length
@@ -474,6 +674,9 @@ CellularModuleA7672XX::httpGet(const std::string &url, int connectionTimeout, in
         // Size received not the same as expected, handle better
         AG_LOGE(TAG, "receivedBufferLen: %d | receivedActual: %d", receivedBufferLen,
                 receivedActual);
+#ifdef ARDUINO
+        AG_LOGE(TAG, "Serial RX overflow count: %d", agSerial_->getOverflowCount());
+#endif
         break;
       }
       at_->waitResponse("+HTTPREAD: 0");
@@ -492,23 +695,37 @@ CellularModuleA7672XX::httpGet(const std::string &url, int connectionTimeout, in
 #endif
     } while (offset < bodyLen);
 
+#if !CONFIG_CELLULAR_STATIC_BUFFERS
     delete[] buf;
+#endif
 
     // Check if all response body data received
     if (offset < bodyLen) {
       AG_LOGE(TAG, "Failed to retrieve all response body data from module");
       _httpTerminate();
+#if !CONFIG_CELLULAR_STATIC_BUFFERS
       delete[] bodyResponse;
+#endif
+      if (isDeadlineExceeded()) {
+        result.status = CellReturnStatus::DeadlineExceeded;
+      }
       return result;
     }
   }
 
+  uint32_t retrieveDuration = MILLIS() - retrieveStartTime;
   AG_LOGD(TAG, "Finish retrieve response body from module buffer in %.2fs",
-          ((float)MILLIS() - retrieveStartTime) / 1000);
+          ((float)retrieveDuration) / 1000);
+  if (bodyLen > 0 && retrieveDuration > 0) {
+    AG_LOGI(TAG, "Response body retrieved at %d bytes/s", (bodyLen * 1000) / retrieveDuration);
+  }
 
   // set status code and response body for return function
   result.data.statusCode = statusCode;
   result.data.bodyLen = bodyLen;
+  if (ifNoneMatch != nullptr) {
+    result.data.etag = _etag;
+  }
   if (bodyLen > 0) {
     // // Debug purpose
     // Serial.println("Repsonse body:");
@@ -518,7 +735,11 @@ CellularModuleA7672XX::httpGet(const std::string &url, int connectionTimeout, in
     //   Serial.print((uint8_t)bodyResponse[i], HEX);
     // }
 
-    result.data.body = std::unique_ptr<char[]>(bodyResponse);
+#if CONFIG_CELLULAR_STATIC_BUFFERS
+    result.data.body = std::unique_ptr<char[], BodyDeleter>(bodyResponse, BodyDeleter(false));
+#else
+    result.data.body = std::unique_ptr<char[], BodyDeleter>(bodyResponse);
+#endif
   }
 
   _httpTerminate();
@@ -528,10 +749,49 @@ CellularModuleA7672XX::httpGet(const std::string &url, int connectionTimeout, in
   return result;
 }
 
+void CellularModuleA7672XX::setHttpsCACert(const char *caPem) {
+  std::lock_guard<OperationMutex> operation(_operationMutex);
+  if (_caPem != caPem) {
+    _caPem = caPem;
+    _caUploaded = false;
+    _sslConfigured = false;
+  }
+}
+
 CellResult<CellularModule::HttpResponse>
 CellularModuleA7672XX::httpPost(const std::string &url, const std::string &body,
                                 const std::string &headContentType, int connectionTimeout,
                                 int responseTimeout) {
+  AG_RESOURCE_SCOPE("A7672XX::httpPost");
+  std::lock_guard<OperationMutex> operation(_operationMutex);
+  char host[DNS_HOST_MAX] = {0};
+  const std::string *resolved = _dnsRewriteUrl(url, host);
+  if (resolved == nullptr) {
+    auto result =
+        _httpPost(url, nullptr, body, headContentType, connectionTimeout, responseTimeout);
+    result.status = _deadlineStatus(result.status);
+    return result;
+  }
+
+  _httpErrorCode = 0;
+  auto result =
+      _httpPost(*resolved, host, body, headContentType, connectionTimeout, responseTimeout);
+  if (result.status != CellReturnStatus::Ok && !isDeadlineExceeded() &&
+      _isConnectError(_httpErrorCode)) {
+    // Cached address might be stale, let module resolve the host again. Only when the request
+    // never reached the server, otherwise it might be posted twice
+    AG_LOGW(TAG, "Connect to cached address failed, retry with host %s", host);
+    _dnsForget(host);
+    result = _httpPost(url, nullptr, body, headContentType, connectionTimeout, responseTimeout);
+  }
+  result.status = _deadlineStatus(result.status);
+  return result;
+}
+
+CellResult<CellularModule::HttpResponse>
+CellularModuleA7672XX::_httpPost(const std::string &url, const char *hostHeader,
+                                 const std::string &body, const std::string &headContentType,
+                                 int connectionTimeout, int responseTimeout) {
 
   CellResult<CellularModule::HttpResponse> result;
   result.status = CellReturnStatus::Error;
@@ -555,6 +815,7 @@ CellularModuleA7672XX::httpPost(const std::string &url, const std::string &body,
 
   if (headContentType != "") {
     // AT+HTTPPARA="CONTENT", contenttype
+    ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
     char buffer[100] = {0};
     sprintf(buffer, "+HTTPPARA=\"CONTENT\",\"%s\"", headContentType.c_str());
     at_->sendAT(buffer);
@@ -572,7 +833,23 @@ CellularModuleA7672XX::httpPost(const std::string &url, const std::string &body,
     }
   }
 
-  // TODO: Another +HTTPPARA to handle https request SSLCFG
+  // +HTTPPARA set SSLCFG for https url
+  if (url.rfind("https://", 0) == 0) {
+    result.status = _httpSetSslContext();
+    if (result.status != CellReturnStatus::Ok) {
+      _httpTerminate();
+      return result;
+    }
+  }
+
+  // +HTTPPARA set USERDATA when URL host replaced by its address
+  if (hostHeader != nullptr) {
+    result.status = _httpSetUserHeaders(hostHeader, nullptr);
+    if (result.status != CellReturnStatus::Ok) {
+      _httpTerminate();
+      return result;
+    }
+  }
 
   // +HTTPPARA set URL
   result.status = _httpSetUrl(url);
@@ -582,27 +859,30 @@ CellularModuleA7672XX::httpPost(const std::string &url, const std::string &body,
   }
 
   // +HTTPDATA ; Body len needs to be the same as length send after DOWNLOAD, otherwise error
-  char buf[25] = {0};
-  sprintf(buf, "+HTTPDATA=%d,10", body.length());
-  at_->sendAT(buf);
-  if (at_->waitResponse("DOWNLOAD") != ATCommandHandler::ExpArg1) {
-    // Either timeout wait for expected response or return ERROR
-    AG_LOGW(TAG, "Error +HTTPDATA wait for \"DOWNLOAD\" response");
-    _httpTerminate();
-    result.status = CellReturnStatus::Error;
-    return result;
-  }
+  {
+    ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
+    char buf[25] = {0};
+    sprintf(buf, "+HTTPDATA=%d,10", body.length());
+    at_->sendAT(buf);
+    if (at_->waitResponse("DOWNLOAD") != ATCommandHandler::ExpArg1) {
+      // Either timeout wait for expected response or return ERROR
+      AG_LOGW(TAG, "Error +HTTPDATA wait for \"DOWNLOAD\" response");
+      _httpTerminate();
+      result.status = CellReturnStatus::Error;
+      return result;
+    }
 
-  AG_LOGI(TAG, "Receive \"DOWNLOAD\" event, adding request body");
-  at_->sendRaw(body.c_str());
-  // Wait for 'OK' after send request body
-  // Timeout set based on +HTTPDATA param
-  if (at_->waitResponse(10000) != ATCommandHandler::ExpArg1) {
-    // Timeout wait "OK"
-    AG_LOGW(TAG, "Error +HTTPDATA wait for \"DOWNLOAD\" response");
-    _httpTerminate();
-    result.status = CellReturnStatus::Error;
-    return result;
+    AG_LOGI(TAG, "Receive \"DOWNLOAD\" event, adding request body");
+    at_->sendRaw(body.c_str());
+    // Wait for 'OK' after send request body
+    // Timeout set based on +HTTPDATA param
+    if (at_->waitResponse(10000) != ATCommandHandler::ExpArg1) {
+      // Timeout wait "OK"
+      AG_LOGW(TAG, "Error +HTTPDATA wait for \"DOWNLOAD\" response");
+      _httpTerminate();
+      result.status = CellReturnStatus::Error;
+      return result;
+    }
   }
 
   // +HTTPACTION
@@ -619,6 +899,13 @@ CellularModuleA7672XX::httpPost(const std::string &url, const std::string &body,
 
   // set status code, and ignore response body
   result.data.statusCode = statusCode;
+
+  // Server asked to slow down, tell client how long
+  if (statusCode == 429 || statusCode == 503) {
+    if (_httpReadHeaders() == CellReturnStatus::Ok && _retryAfter[0] != '\0') {
+      result.data.retryAfter = _retryAfter;
+    }
+  }
   // TODO: In the future retrieve the response body
 
   _httpTerminate();
@@ -631,99 +918,139 @@ CellularModuleA7672XX::httpPost(const std::string &url, const std::string &body,
 CellReturnStatus CellularModuleA7672XX::mqttConnect(const std::string &clientId,
                                                     const std::string &host, int port,
                                                     std::string username, std::string password) {
+  AG_RESOURCE_SCOPE("A7672XX::mqttConnect");
+  std::lock_guard<OperationMutex> operation(_operationMutex);
+  char address[16] = {0};
+  if (!_dnsResolve(host.c_str(), address)) {
+    return _deadlineStatus(_mqttConnect(clientId, host, port, username, password));
+  }
+
+  CellReturnStatus status = _mqttConnect(clientId, address, port, username, password);
+  if (status != CellReturnStatus::Ok) {
+    // Module MQTT client already acquired, next connect resolve the host again
+    _dnsForget(host.c_str());
+  }
+  return _deadlineStatus(status);
+}
+
+CellReturnStatus CellularModuleA7672XX::_mqttConnect(const std::string &clientId,
+                                                     const std::string &host, int port,
+                                                     std::string username, std::string password) {
   char buf[200] = {0};
   std::string result;
+  uint32_t connectStartTime;
 
-  // +CMQTTSTART
-  at_->sendAT("+CMQTTSTART");
-  auto atResult = at_->waitResponse(12000, "+CMQTTSTART:");
-  if (atResult == ATCommandHandler::Timeout || atResult == ATCommandHandler::CMxError) {
-    AG_LOGW(TAG, "Timeout wait for +CMQTTSTART response");
-    return CellReturnStatus::Timeout;
-  } else if (atResult == ATCommandHandler::ExpArg1) {
-    // +CMQTTSTART response received as arg1
-    // Get value of CMQTTSTART, expected is 0
-    if (at_->waitAndRecvRespLine(result) == -1) {
+  {
+    ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
+
+    // +CMQTTSTART
+    at_->sendAT("+CMQTTSTART");
+    auto atResult = at_->waitResponse(12000, "+CMQTTSTART:");
+    if (atResult == ATCommandHandler::Timeout || atResult == ATCommandHandler::CMxError) {
+      AG_LOGW(TAG, "Timeout wait for +CMQTTSTART response");
       return CellReturnStatus::Timeout;
+    } else if (atResult == ATCommandHandler::ExpArg1) {
+      // +CMQTTSTART response received as arg1
+      // Get value of CMQTTSTART, expected is 0
+      if (at_->waitAndRecvRespLine(result) == -1) {
+        return CellReturnStatus::Timeout;
+      }
+      if (!_isZeroResult(result)) {
+        // Failed to start
+        AG_LOGE(TAG, "CMQTTSTART failed with value %s", result.c_str());
+        return CellReturnStatus::Error;
+      }
+      // CMQTTSTART ok
+    } else if (atResult == ATCommandHandler::ExpArg2) {
+      // Here it return error, but based on the document module MQTT context already started
+      // Do nothing
+      AG_LOGI(TAG, "+CMQTTSTART return error, which means mqtt context already started");
     }
-    if (result != "0") {
-      // Failed to start
-      AG_LOGE(TAG, "CMQTTSTART failed with value %s", result.c_str());
+
+    // +CMQTTACCQ
+    sprintf(buf, "+CMQTTACCQ=0,\"%s\",0", clientId.c_str());
+    at_->sendAT(buf);
+    if (at_->waitResponse() != ATCommandHandler::ExpArg1) {
+      // ERROR or TIMEOUT, doesn't matter
       return CellReturnStatus::Error;
     }
-    // CMQTTSTART ok
-  } else if (atResult == ATCommandHandler::ExpArg2) {
-    // Here it return error, but based on the document module MQTT context already started
-    // Do nothing
-    AG_LOGI(TAG, "+CMQTTSTART return error, which means mqtt context already started");
-  }
 
-  // +CMQTTACCQ
-  sprintf(buf, "+CMQTTACCQ=0,\"%s\",0", clientId.c_str());
-  at_->sendAT(buf);
-  if (at_->waitResponse() != ATCommandHandler::ExpArg1) {
-    // ERROR or TIMEOUT, doesn't matter
-    return CellReturnStatus::Error;
-  }
+#if CONFIG_CELLULAR_MQTT_ACQUIRE_WAIT_MS > 0
+    DELAY_MS(CONFIG_CELLULAR_MQTT_ACQUIRE_WAIT_MS);
+#endif
 
-  DELAY_MS(3000);
-
-  // +CMQTTCONNECT
-  // keep alive 120; cleansession 1
-  memset(buf, 0, 200);
-  if (username != "" && password != "") {
-    // Both username and password provided
-    AG_LOGI(TAG, "Connect with username and password");
-    sprintf(buf, "+CMQTTCONNECT=0,\"tcp://%s:%d\",120,1,\"%s\",\"%s\"", host.c_str(), port,
-            username.c_str(), password.c_str());
-  } else if (username != "") {
-    // Only username that is provided
-    AG_LOGI(TAG, "Connect with username only");
-    sprintf(buf, "+CMQTTCONNECT=0,\"tcp://%s:%d\",120,1,\"%s\"", host.c_str(), port,
-            username.c_str());
-  } else {
-    // No credentials
-    sprintf(buf, "+CMQTTCONNECT=0,\"tcp://%s:%d\",120,1", host.c_str(), port);
-  }
-  at_->sendAT(buf);
-  if (at_->waitResponse(30000, "+CMQTTCONNECT: 0,") != ATCommandHandler::ExpArg1) {
-    at_->clearBuffer();
-    return CellReturnStatus::Error;
+    // +CMQTTCONNECT
+    // keep alive 120; cleansession 1
+    memset(buf, 0, 200);
+    if (username != "" && password != "") {
+      // Both username and password provided
+      AG_LOGI(TAG, "Connect with username and password");
+      sprintf(buf, "+CMQTTCONNECT=0,\"tcp://%s:%d\",120,1,\"%s\",\"%s\"", host.c_str(), port,
+              username.c_str(), password.c_str());
+    } else if (username != "") {
+      // Only username that is provided
+      AG_LOGI(TAG, "Connect with username only");
+      sprintf(buf, "+CMQTTCONNECT=0,\"tcp://%s:%d\",120,1,\"%s\"", host.c_str(), port,
+              username.c_str());
+    } else {
+      // No credentials
+      sprintf(buf, "+CMQTTCONNECT=0,\"tcp://%s:%d\",120,1", host.c_str(), port);
+    }
+    at_->sendAT(buf);
+    connectStartTime = MILLIS();
+    if (at_->waitResponse() != ATCommandHandler::ExpArg1) {
+      return CellReturnStatus::Error;
+    }
+    // Result URC follow OK, capture it before other task can read the serial line
+    at_->expectURC(URC_MQTT_CONNECT);
   }
 
-  if (at_->waitAndRecvRespLine(result) == -1) {
-    return CellReturnStatus::Timeout;
+  // Serial line free for other task while broker connecting
+  auto response =
+      at_->waitURC(URC_MQTT_CONNECT, at_->getTimeout(ATCommandHandler::MqttAction, 30000), result);
+  if (response != ATCommandHandler::ExpArg1) {
+    at_->recordTimeout(ATCommandHandler::MqttAction);
+    return CellReturnStatus::Error;
   }
+  at_->recordLatency(ATCommandHandler::MqttAction, MILLIS() - connectStartTime);
 
   // If result not 0, then error occur
-  if (result != "0") {
+  if (!_isZeroResult(result)) {
     AG_LOGE(TAG, "+CMQTTCONNECT error result: %s", result.c_str());
     return CellReturnStatus::Error;
   }
-  at_->clearBuffer();
 
   return CellReturnStatus::Ok;
 }
 
 CellReturnStatus CellularModuleA7672XX::mqttDisconnect() {
+  AG_RESOURCE_SCOPE("A7672XX::mqttDisconnect");
+  std::lock_guard<OperationMutex> operation(_operationMutex);
   std::string result;
   // +CMQTTDISC
-  at_->sendAT("+CMQTTDISC=0,60"); // Timeout 60s
-  /// wait +CMTTDISC until client_index
-  if (at_->waitResponse(60000, "+CMQTTDISC: 0,") != ATCommandHandler::ExpArg1) {
-    at_->clearBuffer();
-    // Error or timeout
-    return CellReturnStatus::Error;
+  {
+    ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
+    at_->sendAT("+CMQTTDISC=0,60"); // Timeout 60s
+    if (at_->waitResponse() != ATCommandHandler::ExpArg1) {
+      at_->clearBuffer();
+      // Error or timeout
+      return CellReturnStatus::Error;
+    }
+    at_->expectURC(URC_MQTT_DISCONNECT);
   }
 
-  if (at_->waitAndRecvRespLine(result) == -1) {
-    return CellReturnStatus::Timeout;
+  /// wait +CMTTDISC until client_index, serial line free for other task meanwhile
+  if (at_->waitURC(URC_MQTT_DISCONNECT, 60000, result) != ATCommandHandler::ExpArg1) {
+    // Error or timeout
+    return CellReturnStatus::Error;
   }
 
-  if (result != "0") {
+  if (!_isZeroResult(result)) {
     AG_LOGE(TAG, "+CMQTTDISC error result: %s", result.c_str());
     return CellReturnStatus::Error;
   }
+
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
   at_->clearBuffer();
 
   // +CMQTTREL
@@ -749,101 +1076,590 @@ CellReturnStatus CellularModuleA7672XX::mqttDisconnect() {
 CellReturnStatus CellularModuleA7672XX::mqttPublish(const std::string &topic,
                                                     const std::string &payload, int qos, int retain,
                                                     int timeoutS) {
-  char buf[50] = {0};
-  std::string result;
+  AG_RESOURCE_SCOPE("A7672XX::mqttPublish");
+  std::lock_guard<OperationMutex> operation(_operationMutex);
+  return _deadlineStatus(_mqttPublish(topic, payload, qos, retain, timeoutS));
+}
 
-  // +CMQTTTOPIC
-  sprintf(buf, "+CMQTTTOPIC=0,%d", topic.length());
-  at_->sendAT(buf);
-  if (at_->waitResponse(">") != ATCommandHandler::ExpArg1) {
-    // Either timeout wait for expected response or return ERROR
-    AG_LOGW(TAG, "Error +CMQTTTOPIC wait for \">\" response");
-    return CellReturnStatus::Error;
-  }
+CellResult<int> CellularModuleA7672XX::socketOpen(const std::string &host, int port,
+                                                  uint32_t timeoutMs) {
+  AG_RESOURCE_SCOPE("A7672XX::socketOpen");
+  std::lock_guard<OperationMutex> operation(_operationMutex);
+  return _socketOpen("TCP", host, port, timeoutMs);
+}
 
-  AG_LOGI(TAG, "Receive \">\" event, adding topic");
-  at_->sendRaw(topic.c_str());
-  // Wait for 'OK' after send topic
-  if (at_->waitResponse() != ATCommandHandler::ExpArg1) {
-    // Timeout wait "OK"
-    AG_LOGW(TAG, "Error +CMQTTTOPIC wait for \"OK\" response");
-    return CellReturnStatus::Error;
+CellResult<int> CellularModuleA7672XX::udpOpen(int localPort) {
+  AG_RESOURCE_SCOPE("A7672XX::udpOpen");
+  std::lock_guard<OperationMutex> operation(_operationMutex);
+  return _socketOpen("UDP", "", localPort, at_->getTimeout(ATCommandHandler::NetworkCommand));
+}
+
+CellResult<int> CellularModuleA7672XX::socketSend(int socket, const char *data, int length) {
+  AG_RESOURCE_SCOPE("A7672XX::socketSend");
+  std::lock_guard<OperationMutex> operation(_operationMutex);
+  return _socketSend(socket, nullptr, 0, data, length);
+}
+
+CellResult<int> CellularModuleA7672XX::socketSendTo(int socket, const std::string &host, int port,
+                                                    const char *data, int length) {
+  AG_RESOURCE_SCOPE("A7672XX::socketSendTo");
+  std::lock_guard<OperationMutex> operation(_operationMutex);
+  return _socketSend(socket, host.c_str(), port, data, length);
+}
+
+CellResult<int> CellularModuleA7672XX::socketRecv(int socket, char *buffer, int size,
+                                                  uint32_t timeoutMs) {
+  AG_RESOURCE_SCOPE("A7672XX::socketRecv");
+  CellResult<int> result;
+  result.status = CellReturnStatus::Error;
+  result.data = 0;
+  if (size <= 0) {
+    return result;
+  }
+  if (size > SOCKET_RECV_MAX) {
+    size = SOCKET_RECV_MAX;
   }
 
-  // +CMQTTPAYLOAD
-  memset(buf, 0, 50);
-  sprintf(buf, "+CMQTTPAYLOAD=0,%d", payload.length());
-  at_->sendAT(buf);
-  if (at_->waitResponse(">") != ATCommandHandler::ExpArg1) {
-    // Either timeout wait for expected response or return ERROR
-    AG_LOGW(TAG, "Error +CMQTTPAYLOAD wait for \">\" response");
-    return CellReturnStatus::Error;
+  // Received data kept on module until read (+CIPRXGET=1), poll instead of parsing +RECEIVE URC
+  uint32_t startTime = MILLIS();
+  char buf[40];
+  for (;;) {
+    {
+      // Taken per poll, other operation can run while waiting for data
+      std::lock_guard<OperationMutex> operation(_operationMutex);
+      if (!_isSocketOpened(socket)) {
+        return result;
+      }
+      ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
+      sprintf(buf, "+CIPRXGET=2,%d,%d", socket, size);
+      at_->sendAT(buf);
+      ATCommandHandler::Response response = at_->waitResponse("+CIPRXGET: 2,");
+      if (response == ATCommandHandler::Timeout) {
+        AG_LOGW(TAG, "Timeout wait response +CIPRXGET");
+        result.status = CellReturnStatus::Timeout;
+        return result;
+      } else if (response != ATCommandHandler::ExpArg1) {
+        // Socket closed by peer or network
+        AG_LOGW(TAG, "Error +CIPRXGET on socket %d", socket);
+        return result;
+      }
+
+      // <link_num>,<read_len>,<rest_len>
+      if (at_->waitAndRecvRespLine(buf, sizeof(buf)) == -1) {
+        AG_LOGW(TAG, "Failed retrieve +CIPRXGET value");
+        return result;
+      }
+      int link, readLen, restLen;
+      ATResponseParser parser(buf);
+      if (!parser.nextInt(link) || !parser.nextInt(readLen) || !parser.nextInt(restLen) ||
+          readLen > size) {
+        AG_LOGW(TAG, "Invalid +CIPRXGET value: %s", buf);
+        return result;
+      }
+
+      if (readLen > 0) {
+        int receivedActual = at_->retrieveBuffer(buffer, readLen);
+        if (receivedActual != readLen) {
+          AG_LOGE(TAG, "readLen: %d | receivedActual: %d", readLen, receivedActual);
+          return result;
+        }
+        at_->waitResponse();
+        AG_LOGV(TAG, "Socket %d received %d bytes, %d left on module", socket, readLen, restLen);
+        result.status = CellReturnStatus::Ok;
+        result.data = readLen;
+        return result;
+      }
+      at_->waitResponse();
+    }
+
+    if ((MILLIS() - startTime) >= timeoutMs) {
+      break;
+    }
+    // Serial line free for other task while waiting for data
+    DELAY_MS(SOCKET_RECV_POLL_MS);
   }
 
-  AG_LOGI(TAG, "Receive \">\" event, adding payload");
-  at_->sendRaw(payload.c_str());
-  // Wait for 'OK' after send payload
-  if (at_->waitResponse() != ATCommandHandler::ExpArg1) {
-    // Timeout wait "OK"
-    AG_LOGW(TAG, "Error +CMQTTPAYLOAD wait for \"OK\" response");
+  result.status = CellReturnStatus::Timeout;
+  return result;
+}
+
+CellReturnStatus CellularModuleA7672XX::socketClose(int socket) {
+  AG_RESOURCE_SCOPE("A7672XX::socketClose");
+  std::lock_guard<OperationMutex> operation(_operationMutex);
+  if (!_isSocketOpened(socket)) {
     return CellReturnStatus::Error;
   }
+  // Link is reusable whatever the result, module release it on error too
+  _socketOpened[socket] = false;
 
-  memset(buf, 0, 50);
-  sprintf(buf, "+CMQTTPUB=0,%d,%d,%d", qos, timeoutS, retain);
-  int timeoutMs = timeoutS * 1000;
-  at_->sendAT(buf);
-  if (at_->waitResponse(timeoutMs, "+CMQTTPUB: 0,") != ATCommandHandler::ExpArg1) {
-    AG_LOGW(TAG, "+CMQTTPUBLISH error");
-    return CellReturnStatus::Error;
+  // +CIPCLOSE
+  {
+    ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
+    char buf[20] = {0};
+    sprintf(buf, "+CIPCLOSE=%d", socket);
+    at_->sendAT(buf);
+    if (at_->waitResponse() != ATCommandHandler::ExpArg1) {
+      // Already closed by peer
+      AG_LOGW(TAG, "Error +CIPCLOSE");
+      return CellReturnStatus::Error;
+    }
+    at_->expectURC(URC_SOCKET_CLOSE[socket]);
   }
 
-  // Retrieve the value
-  if (at_->waitAndRecvRespLine(result) == -1) {
-    AG_LOGW(TAG, "+CMQTTPUB retrieve value timeout");
+  // +CIPCLOSE: <link_num>,<err>
+  std::string value;
+  if (at_->waitURC(URC_SOCKET_CLOSE[socket], at_->getTimeout(ATCommandHandler::NetworkCommand),
+                   value) != ATCommandHandler::ExpArg1) {
+    AG_LOGW(TAG, "Timeout wait socket %d closed", socket);
     return CellReturnStatus::Timeout;
   }
-
-  if (result != "0") {
-    AG_LOGE(TAG, "Failed +CMQTTPUB with value %s", result.c_str());
-    return CellReturnStatus::Error;
+  if (!_isZeroResult(value)) {
+    AG_LOGW(TAG, "Failed close socket %d with error %s", socket, value.c_str());
+    return CellReturnStatus::Failed;
   }
 
-  // Make sure buffer clean
-  at_->clearBuffer();
-
   return CellReturnStatus::Ok;
 }
 
-CellularModuleA7672XX::NetworkRegistrationState CellularModuleA7672XX::_implCheckModuleReady() {
-  if (at_->testAT() == false) {
-    REGIS_RETRY_DELAY();
-    // TODO: If too long, try reset module
-    return CHECK_MODULE_READY;
+CellReturnStatus CellularModuleA7672XX::enterDataMode() {
+  AG_RESOURCE_SCOPE("A7672XX::enterDataMode");
+  std::lock_guard<OperationMutex> operation(_operationMutex);
+  if (_muxActive) {
+    // PPP driver read the serial line directly
+    AG_LOGW(TAG, "Stop multiplexer before enter data mode");
+    return CellReturnStatus::Error;
   }
-  if (isSimReady() != CellReturnStatus::Ok) {
-    REGIS_RETRY_DELAY();
-    return CHECK_MODULE_READY;
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityHigh);
+
+  // Dial PDP context 1, APN already applied on network registration
+  at_->sendAT("D*99#");
+  ATCommandHandler::Response response =
+      at_->waitResponse(at_->getTimeout(ATCommandHandler::NetworkCommand), "CONNECT");
+  if (response == ATCommandHandler::Timeout) {
+    AG_LOGW(TAG, "Timeout wait \"CONNECT\" response");
+    return CellReturnStatus::Timeout;
+  } else if (response != ATCommandHandler::ExpArg1) {
+    AG_LOGW(TAG, "Failed enter data mode");
+    return CellReturnStatus::Error;
   }
 
-  AG_LOGI(TAG, "Continue: PREPARE_REGISTRATION");
-  return PREPARE_REGISTRATION;
-}
+  // PPP frames follow right away, don't consume anything else from the serial line
+  at_->beginDataSession();
+  AG_LOGI(TAG, "Module in data mode");
 
-CellularModuleA7672XX::NetworkRegistrationState
-CellularModuleA7672XX::_implPrepareRegistration(CellTechnology ct) {
-  // TODO: Check result
-  _disableNetworkRegistrationURC(ct);
-  _applyCellularTechnology(ct);
-  AG_LOGI(TAG, "Continue: CHECK_NETWORK_REGISTRATION");
-  return CHECK_NETWORK_REGISTRATION;
+  return CellReturnStatus::Ok;
 }
 
-CellularModuleA7672XX::NetworkRegistrationState
+CellReturnStatus CellularModuleA7672XX::exitDataMode() {
+  AG_RESOURCE_SCOPE("A7672XX::exitDataMode");
+  std::lock_guard<OperationMutex> operation(_operationMutex);
+  if (!at_->isDataSession()) {
+    return CellReturnStatus::Ok;
+  }
+  ATCommandHandler::DataSessionEnd transaction(at_);
+
+  // Escape sequence only recognized with no data around it
+  DELAY_MS(DATA_MODE_GUARD_TIME_MS);
+  at_->clearBuffer();
+  at_->sendData("+++", 3);
+  DELAY_MS(DATA_MODE_GUARD_TIME_MS);
+  // Might already be in command mode if PPP terminated, then "+++" is just ignored
+  at_->waitResponse();
+
+  // Hang up the data call
+  at_->sendAT("H");
+  at_->waitResponse();
+  at_->clearBuffer();
+
+  if (!at_->testAT(5000)) {
+    AG_LOGW(TAG, "Module not respond after exit data mode");
+    return CellReturnStatus::Error;
+  }
+  AG_LOGI(TAG, "Module back in command mode");
+
+  return CellReturnStatus::Ok;
+}
+
+CellReturnStatus CellularModuleA7672XX::startMultiplexer() {
+  AG_RESOURCE_SCOPE("A7672XX::startMultiplexer");
+  std::lock_guard<OperationMutex> operation(_operationMutex);
+  if (_muxActive) {
+    return CellReturnStatus::Ok;
+  }
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityHigh);
+
+  // Basic option with default frame size, module switch right after OK
+  at_->sendAT("+CMUX=0");
+  if (at_->waitResponse() != ATCommandHandler::ExpArg1) {
+    AG_LOGW(TAG, "Module not accept multiplexer mode");
+    return CellReturnStatus::Error;
+  }
+
+  if (_mux == nullptr) {
+    _mux = new AgCmux(agSerial_);
+    _statusAt = new ATCommandHandler(agSerial_);
+  }
+  if (!_mux->open(2)) {
+    // Might be half opened, close down to get single AT channel back
+    _mux->close();
+    at_->clearBuffer();
+    at_->testAT(5000);
+    return CellReturnStatus::Error;
+  }
+
+  at_->setChannel(_mux->channel(1));
+  _statusAt->setChannel(_mux->channel(2));
+  _muxActive = true;
+
+  // Status channel start with module default settings
+  {
+    ATCommandHandler::Transaction status(_statusAt, ATCommandHandler::PriorityHigh);
+    _statusAt->sendAT("E0");
+    _statusAt->waitResponse();
+  }
+  AG_LOGI(TAG, "Multiplexer started");
+
+  return CellReturnStatus::Ok;
+}
+
+CellReturnStatus CellularModuleA7672XX::stopMultiplexer() {
+  AG_RESOURCE_SCOPE("A7672XX::stopMultiplexer");
+  std::lock_guard<OperationMutex> operation(_operationMutex);
+  if (!_muxActive) {
+    return CellReturnStatus::Ok;
+  }
+
+  // Wait for status query in progress, following ones go to at_ once channels switched back
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityHigh);
+  {
+    ATCommandHandler::Transaction status(_statusAt, ATCommandHandler::PriorityHigh);
+    _muxActive = false;
+    _mux->close();
+    at_->setChannel(nullptr);
+    _statusAt->setChannel(nullptr);
+  }
+
+  DELAY_MS(500);
+  at_->clearBuffer();
+  if (!at_->testAT(5000)) {
+    AG_LOGW(TAG, "Module not respond after stop multiplexer");
+    return CellReturnStatus::Error;
+  }
+  AG_LOGI(TAG, "Multiplexer stopped");
+
+  return CellReturnStatus::Ok;
+}
+
+CellularModule::DnsStats CellularModuleA7672XX::getDnsStats() {
+  std::lock_guard<OperationMutex> operation(_operationMutex);
+  return _dnsStats;
+}
+
+void CellularModuleA7672XX::setDeadline(uint32_t budgetMs) {
+  if (at_ != nullptr) {
+    at_->setDeadline(budgetMs);
+  }
+}
+
+bool CellularModuleA7672XX::isDeadlineExceeded() {
+  return at_ != nullptr && at_->isDeadlineExceeded();
+}
+
+CellReturnStatus CellularModuleA7672XX::_mqttPublish(const std::string &topic,
+                                                     const std::string &payload, int qos,
+                                                     int retain, int timeoutS) {
+  char buf[50] = {0};
+  std::string result;
+  uint32_t publishStartTime;
+  int timeoutMs = at_->getTimeout(ATCommandHandler::MqttAction, timeoutS * 1000);
+
+  {
+    ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
+
+    // +CMQTTTOPIC
+    sprintf(buf, "+CMQTTTOPIC=0,%d", topic.length());
+    at_->sendAT(buf);
+    if (at_->waitResponse(">") != ATCommandHandler::ExpArg1) {
+      // Either timeout wait for expected response or return ERROR
+      AG_LOGW(TAG, "Error +CMQTTTOPIC wait for \">\" response");
+      return CellReturnStatus::Error;
+    }
+
+    AG_LOGI(TAG, "Receive \">\" event, adding topic");
+    at_->sendRaw(topic.c_str());
+    // Wait for 'OK' after send topic
+    if (at_->waitResponse() != ATCommandHandler::ExpArg1) {
+      // Timeout wait "OK"
+      AG_LOGW(TAG, "Error +CMQTTTOPIC wait for \"OK\" response");
+      return CellReturnStatus::Error;
+    }
+
+    // +CMQTTPAYLOAD
+    memset(buf, 0, 50);
+    sprintf(buf, "+CMQTTPAYLOAD=0,%d", payload.length());
+    at_->sendAT(buf);
+    if (at_->waitResponse(">") != ATCommandHandler::ExpArg1) {
+      // Either timeout wait for expected response or return ERROR
+      AG_LOGW(TAG, "Error +CMQTTPAYLOAD wait for \">\" response");
+      return CellReturnStatus::Error;
+    }
+
+    AG_LOGI(TAG, "Receive \">\" event, adding payload");
+    at_->sendRaw(payload.c_str());
+    // Wait for 'OK' after send payload
+    if (at_->waitResponse() != ATCommandHandler::ExpArg1) {
+      // Timeout wait "OK"
+      AG_LOGW(TAG, "Error +CMQTTPAYLOAD wait for \"OK\" response");
+      return CellReturnStatus::Error;
+    }
+
+    memset(buf, 0, 50);
+    sprintf(buf, "+CMQTTPUB=0,%d,%d,%d", qos, timeoutS, retain);
+    at_->sendAT(buf);
+    publishStartTime = MILLIS();
+    if (at_->waitResponse() != ATCommandHandler::ExpArg1) {
+      AG_LOGW(TAG, "+CMQTTPUBLISH error");
+      return CellReturnStatus::Error;
+    }
+    // Result URC follow OK, capture it before other task can read the serial line
+    at_->expectURC(URC_MQTT_PUBLISH);
+  }
+
+  // Serial line free for other task while message delivered
+  if (at_->waitURC(URC_MQTT_PUBLISH, timeoutMs, result) != ATCommandHandler::ExpArg1) {
+    at_->recordTimeout(ATCommandHandler::MqttAction);
+    AG_LOGW(TAG, "+CMQTTPUBLISH error");
+    return CellReturnStatus::Error;
+  }
+  at_->recordLatency(ATCommandHandler::MqttAction, MILLIS() - publishStartTime);
+
+  if (!_isZeroResult(result)) {
+    AG_LOGE(TAG, "Failed +CMQTTPUB with value %s", result.c_str());
+    return CellReturnStatus::Error;
+  }
+
+  return CellReturnStatus::Ok;
+}
+
+CellReturnStatus CellularModuleA7672XX::_socketNetOpen() {
+  if (_netOpened) {
+    return CellReturnStatus::Ok;
+  }
+
+  {
+    ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
+    // Keep received data on module until read with +CIPRXGET, only applied before +NETOPEN
+    at_->sendAT("+CIPRXGET=1");
+    at_->waitResponse();
+
+    at_->sendAT("+NETOPEN");
+    ATCommandHandler::Response response = at_->waitResponse();
+    if (response == ATCommandHandler::Timeout) {
+      AG_LOGW(TAG, "Timeout wait response +NETOPEN");
+      return CellReturnStatus::Timeout;
+    } else if (response != ATCommandHandler::ExpArg1) {
+      // Error returned when network already opened, eg. by previous boot of the MCU
+      at_->sendAT("+NETOPEN?");
+      if (at_->waitResponse("+NETOPEN: 1") != ATCommandHandler::ExpArg1) {
+        AG_LOGW(TAG, "Error +NETOPEN");
+        return CellReturnStatus::Error;
+      }
+      at_->waitResponse();
+      _netOpened = true;
+      return CellReturnStatus::Ok;
+    }
+    at_->expectURC(URC_NETOPEN);
+  }
+
+  // +NETOPEN: <err>
+  std::string value;
+  if (at_->waitURC(URC_NETOPEN, at_->getTimeout(ATCommandHandler::NetworkCommand), value) !=
+      ATCommandHandler::ExpArg1) {
+    AG_LOGW(TAG, "Timeout wait +NETOPEN result");
+    return CellReturnStatus::Timeout;
+  }
+  if (!_isZeroResult(value)) {
+    AG_LOGW(TAG, "Failed +NETOPEN with error %s", value.c_str());
+    return CellReturnStatus::Failed;
+  }
+
+  _netOpened = true;
+  return CellReturnStatus::Ok;
+}
+
+bool CellularModuleA7672XX::_isSocketOpened(int socket) {
+  if (socket < 0 || socket >= SOCKET_COUNT || !_socketOpened[socket]) {
+    AG_LOGW(TAG, "Socket %d is not opened", socket);
+    return false;
+  }
+  return true;
+}
+
+CellResult<int> CellularModuleA7672XX::_socketOpen(const char *protocol, const std::string &host,
+                                                   int port, uint32_t timeoutMs) {
+  CellResult<int> result;
+  result.data = -1;
+
+  result.status = _socketNetOpen();
+  if (result.status != CellReturnStatus::Ok) {
+    AG_LOGW(TAG, "Failed open module network for socket");
+    return result;
+  }
+
+  int link = -1;
+  for (int i = 0; i < SOCKET_COUNT; i++) {
+    if (!_socketOpened[i]) {
+      link = i;
+      break;
+    }
+  }
+  if (link == -1) {
+    AG_LOGW(TAG, "No socket available, close unused socket first");
+    result.status = CellReturnStatus::Error;
+    return result;
+  }
+
+  // +CIPOPEN
+  {
+    ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
+    char buf[150] = {0};
+    if (host.empty()) {
+      // UDP, only local port given
+      if (port == 0) {
+        port = SOCKET_UDP_LOCAL_PORT_BASE + link;
+      }
+      snprintf(buf, sizeof(buf), "+CIPOPEN=%d,\"%s\",,,%d", link, protocol, port);
+    } else {
+      snprintf(buf, sizeof(buf), "+CIPOPEN=%d,\"%s\",\"%s\",%d", link, protocol, host.c_str(),
+               port);
+    }
+    at_->sendAT(buf);
+    ATCommandHandler::Response response = at_->waitResponse();
+    if (response == ATCommandHandler::Timeout) {
+      AG_LOGW(TAG, "Timeout wait response +CIPOPEN");
+      result.status = CellReturnStatus::Timeout;
+      return result;
+    } else if (response != ATCommandHandler::ExpArg1) {
+      AG_LOGW(TAG, "Error +CIPOPEN");
+      result.status = CellReturnStatus::Error;
+      return result;
+    }
+    at_->expectURC(URC_SOCKET_OPEN[link]);
+  }
+
+  // +CIPOPEN: <link_num>,<err> ; serial line free for other task while connecting
+  std::string value;
+  if (at_->waitURC(URC_SOCKET_OPEN[link], timeoutMs, value) != ATCommandHandler::ExpArg1) {
+    AG_LOGW(TAG, "Timeout wait socket %d connected", link);
+    result.status = CellReturnStatus::Timeout;
+    return result;
+  }
+  if (!_isZeroResult(value)) {
+    AG_LOGW(TAG, "Failed connect socket to %s:%d with error %s", host.c_str(), port,
+            value.c_str());
+    result.status = CellReturnStatus::Failed;
+    return result;
+  }
+
+  AG_LOGI(TAG, "Socket %d %s opened to %s:%d", link, protocol, host.c_str(), port);
+  _socketOpened[link] = true;
+  result.status = CellReturnStatus::Ok;
+  result.data = link;
+  return result;
+}
+
+CellResult<int> CellularModuleA7672XX::_socketSend(int socket, const char *host, int port,
+                                                   const char *data, int length) {
+  CellResult<int> result;
+  result.status = CellReturnStatus::Error;
+  result.data = 0;
+  if (!_isSocketOpened(socket)) {
+    return result;
+  }
+
+  // +CIPSEND ; data length is given, so payload can be binary
+  {
+    ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
+    char buf[150] = {0};
+    if (host == nullptr) {
+      sprintf(buf, "+CIPSEND=%d,%d", socket, length);
+    } else {
+      // UDP datagram destination
+      snprintf(buf, sizeof(buf), "+CIPSEND=%d,%d,\"%s\",%d", socket, length, host, port);
+    }
+    at_->sendAT(buf);
+    if (at_->waitResponse(">") != ATCommandHandler::ExpArg1) {
+      AG_LOGW(TAG, "Error +CIPSEND wait for \">\" response");
+      return result;
+    }
+
+    at_->sendData(data, length);
+    if (at_->waitResponse() != ATCommandHandler::ExpArg1) {
+      AG_LOGW(TAG, "Error +CIPSEND wait for \"OK\" response");
+      return result;
+    }
+    at_->expectURC(URC_SOCKET_SEND[socket]);
+  }
+
+  // +CIPSEND: <link_num>,<reqSendLength>,<cnfSendLength>
+  std::string value;
+  if (at_->waitURC(URC_SOCKET_SEND[socket], at_->getTimeout(ATCommandHandler::NetworkCommand),
+                   value) != ATCommandHandler::ExpArg1) {
+    AG_LOGW(TAG, "Timeout wait socket %d send result", socket);
+    result.status = CellReturnStatus::Timeout;
+    return result;
+  }
+
+  int requested, confirmed;
+  ATResponseParser parser(value);
+  if (!parser.nextInt(requested) || !parser.nextInt(confirmed)) {
+    AG_LOGW(TAG, "Invalid +CIPSEND result: %s", value.c_str());
+    return result;
+  }
+  if (confirmed < 0) {
+    // -1 means connection closed by peer
+    AG_LOGW(TAG, "Socket %d disconnected", socket);
+    result.status = CellReturnStatus::Failed;
+    return result;
+  }
+
+  result.status = CellReturnStatus::Ok;
+  result.data = confirmed;
+  return result;
+}
+
+CellularModuleA7672XX::NetworkRegistrationState CellularModuleA7672XX::_implCheckModuleReady() {
+  if (at_->testAT() == false) {
+    REGIS_RETRY_DELAY();
+    // TODO: If too long, try reset module
+    return CHECK_MODULE_READY;
+  }
+  if (isSimReady() != CellReturnStatus::Ok) {
+    REGIS_RETRY_DELAY();
+    return CHECK_MODULE_READY;
+  }
+
+  AG_LOGI(TAG, "Continue: PREPARE_REGISTRATION");
+  return PREPARE_REGISTRATION;
+}
+
+CellularModuleA7672XX::NetworkRegistrationState
+CellularModuleA7672XX::_implPrepareRegistration(CellTechnology ct) {
+  // TODO: Check result
+  _disableNetworkRegistrationURC(ct);
+  _applyCellularTechnology(ct);
+  AG_LOGI(TAG, "Continue: CHECK_NETWORK_REGISTRATION");
+  return CHECK_NETWORK_REGISTRATION;
+}
+
+CellularModuleA7672XX::NetworkRegistrationState
 CellularModuleA7672XX::_implCheckNetworkRegistration(CellTechnology ct) {
   CellReturnStatus crs;
+  int signal = 99;
+  uint32_t startTime = MILLIS();
   if (ct == CellTechnology::Auto) {
-    crs = _checkAllRegistrationStatusCommand();
+    // Signal already retrieved on the same command line
+    crs = _checkAllRegistrationStatusCommand(&signal);
   } else {
     crs = isNetworkRegistered(ct);
   }
@@ -852,17 +1668,23 @@ CellularModuleA7672XX::_implCheckNetworkRegistration(CellTechnology ct) {
     // Go back to check module ready
     return CHECK_MODULE_READY;
   } else if (crs == CellReturnStatus::Failed || crs == CellReturnStatus::Error) {
+    AG_LOGD(TAG, "Registration check took %dms", MILLIS() - startTime);
     REGIS_RETRY_DELAY();
     return CHECK_NETWORK_REGISTRATION;
   }
 
-  CellResult<int> result = retrieveSignal();
-  if (result.status == CellReturnStatus::Timeout) {
-    // Go back to check module ready
-    return CHECK_MODULE_READY;
+  if (ct != CellTechnology::Auto) {
+    CellResult<int> result = retrieveSignal();
+    if (result.status == CellReturnStatus::Timeout) {
+      // Go back to check module ready
+      return CHECK_MODULE_READY;
+    }
+    signal = result.data;
   }
+  AG_LOGD(TAG, "Registration check took %dms", MILLIS() - startTime);
+
   // Check if returned signal is valid
-  if (result.data < 1 || result.data > 31) {
+  if (signal < 1 || signal > 31) {
     REGIS_RETRY_DELAY();
     return CHECK_NETWORK_REGISTRATION;
   }
@@ -932,8 +1754,10 @@ CellularModuleA7672XX::_implConfigureNetwork(const std::string &apn) {
     // TODO: What's next if this return error?
   }
 
-  AG_LOGI(TAG, "Wait band settings to be applied for 5s, before set COPS back to automatic");
-  DELAY_MS(5000);
+  // No indication from module when band settings applied, only on this slow path
+  AG_LOGI(TAG, "Wait band settings to be applied for %dms, before set COPS back to automatic",
+          CONFIG_CELLULAR_BAND_APPLY_WAIT_MS);
+  _delayWithinDeadline(CONFIG_CELLULAR_BAND_APPLY_WAIT_MS);
 
   crs = _applyOperatorSelection();
   if (crs == CellReturnStatus::Timeout) {
@@ -970,33 +1794,47 @@ CellularModuleA7672XX::_implConfigureService(const std::string &apn) {
 }
 
 CellularModuleA7672XX::NetworkRegistrationState CellularModuleA7672XX::_implNetworkRegistered() {
-  CellResult<int> result = retrieveSignal();
-  if (result.status == CellReturnStatus::Timeout) {
+  // Retrieve signal and IP address from pdp cid 1 on one command line
+  std::vector<std::string> lines;
+  ATCommandHandler::Response response;
+  {
+    ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
+    at_->sendAT("+CSQ;+CGPADDR=1");
+    response = at_->waitResponseLines(lines);
+  }
+  if (response == ATCommandHandler::Timeout) {
     // Go back to check module ready
     return CHECK_MODULE_READY;
   }
 
+  std::string value;
+  int signal = 99;
+  if (at_->findResultLine(lines, "+CSQ:", value)) {
+    signal = _parseSignal(value);
+  }
+
   // Check if returned signal is valid
-  if (result.data < 1 || result.data > 31) {
+  if (signal < 1 || signal > 31) {
     REGIS_RETRY_DELAY();
     return ENSURE_SERVICE_READY;
   }
 
   // print signal
-  AG_LOGI(TAG, "Signal ready at: %d", result.data);
+  AG_LOGI(TAG, "Signal ready at: %d", signal);
 
-  CellResult<std::string> resultIP = retrieveIPAddr();
-  if (resultIP.data.empty()) {
+  std::string ipaddr;
+  if (!at_->findResultLine(lines, "+CGPADDR: 1,", ipaddr) || ipaddr.empty()) {
     // Sanity check if IP is empty, go back ensure service ready
     return ENSURE_SERVICE_READY;
   }
 
-  AG_LOGI(TAG, "IP Addr: %s", resultIP.data.c_str());
+  AG_LOGI(TAG, "IP Addr: %s", ipaddr.c_str());
   AG_LOGI(TAG, "Continue: finish");
   return NETWORK_REGISTERED;
 }
 
 CellReturnStatus CellularModuleA7672XX::_disableNetworkRegistrationURC(CellTechnology ct) {
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
   if (ct == CellTechnology::Auto) {
     // Send every network registration command
     at_->sendAT("+CREG=0");
@@ -1028,23 +1866,29 @@ CellReturnStatus CellularModuleA7672XX::_disableNetworkRegistrationURC(CellTechn
   return CellReturnStatus::Ok;
 }
 
-CellReturnStatus CellularModuleA7672XX::_checkAllRegistrationStatusCommand() {
-  // 2G or 3G
-  auto crs = isNetworkRegistered(CellTechnology::Auto);
-  if (crs == CellReturnStatus::Timeout || crs == CellReturnStatus::Ok) {
-    return crs;
+CellReturnStatus CellularModuleA7672XX::_checkAllRegistrationStatusCommand(int *oSignal) {
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
+  std::vector<std::string> lines;
+  at_->sendAT("+CREG?;+CGREG?;+CEREG?;+CSQ");
+  auto response = at_->waitResponseLines(lines);
+  if (response == ATCommandHandler::Timeout) {
+    return CellReturnStatus::Timeout;
+  } else if (response != ATCommandHandler::ExpArg1) {
+    return CellReturnStatus::Error;
   }
 
-  // 2G or 3G
-  crs = isNetworkRegistered(CellTechnology::TWO_G);
-  if (crs == CellReturnStatus::Timeout || crs == CellReturnStatus::Ok) {
-    return crs;
+  std::string value;
+  *oSignal = 99;
+  if (at_->findResultLine(lines, "+CSQ:", value)) {
+    *oSignal = _parseSignal(value);
   }
 
-  // 4G
-  crs = isNetworkRegistered(CellTechnology::LTE);
-  if (crs == CellReturnStatus::Timeout || crs == CellReturnStatus::Ok) {
-    return crs;
+  // 2G or 3G (CREG, CGREG) or 4G (CEREG)
+  const char *prefixes[] = {"+CREG:", "+CGREG:", "+CEREG:"};
+  for (const char *prefix : prefixes) {
+    if (at_->findResultLine(lines, prefix, value) && _isRegisteredStatus(value)) {
+      return CellReturnStatus::Ok;
+    }
   }
 
   // If after all command check its not return OK, then network still not attached
@@ -1052,6 +1896,7 @@ CellReturnStatus CellularModuleA7672XX::_checkAllRegistrationStatusCommand() {
 }
 
 CellReturnStatus CellularModuleA7672XX::_applyCellularTechnology(CellTechnology ct) {
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
   // with assumption CT already validate before calling this function
   int mode = _mapCellTechToMode(ct);
   std::string cmd = std::string("+CNMP=") + std::to_string(mode);
@@ -1065,6 +1910,7 @@ CellReturnStatus CellularModuleA7672XX::_applyCellularTechnology(CellTechnology
 }
 
 CellReturnStatus CellularModuleA7672XX::_applyPreferedBands() {
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
   // Attempt to apply all bands supported (might be different based on the region)
   // Apply for both 2G and 4G
   at_->sendAT("+CNBP=0xFFFFFFFF7FFFFFFF,0x000007FF3FDF3FFF,0x000F");
@@ -1077,6 +1923,7 @@ CellReturnStatus CellularModuleA7672XX::_applyPreferedBands() {
 }
 
 CellReturnStatus CellularModuleA7672XX::_applyOperatorSelection() {
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
   at_->sendAT("+COPS=0,2");
   if (at_->waitResponse() != ATCommandHandler::ExpArg1) {
     // TODO: This should be error or timeout
@@ -1087,6 +1934,7 @@ CellReturnStatus CellularModuleA7672XX::_applyOperatorSelection() {
 }
 
 CellReturnStatus CellularModuleA7672XX::_checkOperatorSelection() {
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
   at_->sendAT("+COPS?");
   if (at_->waitResponse("+COPS:") != ATCommandHandler::ExpArg1) {
     // TODO: This should have better error check
@@ -1108,23 +1956,27 @@ CellReturnStatus CellularModuleA7672XX::_checkOperatorSelection() {
 
 CellReturnStatus CellularModuleA7672XX::_printNetworkInfo() {
   auto crs = CellReturnStatus::Ok;
-  at_->sendAT("+CNBP?");
-  at_->waitResponse();
+  std::vector<std::string> lines;
+  {
+    ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
+    at_->sendAT("+CNBP?;+CPSI?;+CGDCONT?");
+    at_->waitResponseLines(lines);
+  }
+  for (const auto &line : lines) {
+    AG_LOGI(TAG, "%s", line.c_str());
+  }
 
+  // Operator scan takes long, keep it on its own command line
   AG_LOGI(TAG, "Wait to list operator selections..");
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
   at_->sendAT("+COPS=?");
   at_->waitResponse(60000);
 
-  at_->sendAT("+CPSI?");
-  at_->waitResponse();
-
-  at_->sendAT("+CGDCONT?");
-  at_->waitResponse();
-
   return crs;
 }
 
 CellReturnStatus CellularModuleA7672XX::_isServiceAvailable() {
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
   at_->sendAT("+CNSMOD?");
   if (at_->waitResponse("+CNSMOD:") != ATCommandHandler::ExpArg1) {
     return CellReturnStatus::Timeout;
@@ -1137,8 +1989,10 @@ CellReturnStatus CellularModuleA7672XX::_isServiceAvailable() {
 
   auto crs = CellReturnStatus::Ok;
 
-  // Second value '0' is NO SERVICE, expect other than NO SERVICE
-  if (status == "0,0" || status == "1,0") {
+  // <n>,<stat> ; stat '0' is NO SERVICE, expect other than NO SERVICE
+  ATResponseParser parser(status);
+  int stat;
+  if (parser.skipField() && parser.nextInt(stat) && stat == 0) {
     crs = CellReturnStatus::Failed;
   }
 
@@ -1149,6 +2003,7 @@ CellReturnStatus CellularModuleA7672XX::_isServiceAvailable() {
 }
 
 CellReturnStatus CellularModuleA7672XX::_applyAPN(const std::string &apn) {
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
   // set APN to pdp cid 1
   char buf[100] = {0};
   sprintf(buf, "+CGDCONT=1,\"IP\",\"%s\"", apn.c_str());
@@ -1161,18 +2016,24 @@ CellReturnStatus CellularModuleA7672XX::_applyAPN(const std::string &apn) {
 }
 
 CellReturnStatus CellularModuleA7672XX::_ensurePacketDomainAttached(bool forceAttach) {
-  at_->sendAT("+CGATT?");
-  if (at_->waitResponse("+CGATT:") != ATCommandHandler::ExpArg1) {
-    // If return error or not response consider "error"
-    return CellReturnStatus::Error;
-  }
-
   std::string state;
-  if (at_->waitAndRecvRespLine(state) == -1) {
-    // TODO: What to do?
+  {
+    ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
+    at_->sendAT("+CGATT?");
+    if (at_->waitResponse("+CGATT:") != ATCommandHandler::ExpArg1) {
+      // If return error or not response consider "error"
+      return CellReturnStatus::Error;
+    }
+
+    if (at_->waitAndRecvRespLine(state) == -1) {
+      // TODO: What to do?
+    }
+    // receive OK response from the buffer, ignore it
+    at_->waitResponse();
   }
 
-  if (state == "1") {
+  int attached = 0;
+  if (ATResponseParser(state).nextInt(attached) && attached == 1) {
     // Already attached
     return CellReturnStatus::Ok;
   }
@@ -1183,6 +2044,7 @@ CellReturnStatus CellularModuleA7672XX::_ensurePacketDomainAttached(bool forceAt
   }
 
   // Not attached, attempt to
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
   at_->sendAT("+CGATT=1");
   if (at_->waitResponse() != ATCommandHandler::ExpArg1) {
     return CellReturnStatus::Failed;
@@ -1192,6 +2054,7 @@ CellReturnStatus CellularModuleA7672XX::_ensurePacketDomainAttached(bool forceAt
 }
 
 CellReturnStatus CellularModuleA7672XX::_activatePDPContext() {
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
   at_->sendAT("+CGACT=1,1");
   if (at_->waitResponse() != ATCommandHandler::ExpArg1) {
     return CellReturnStatus::Error;
@@ -1201,6 +2064,7 @@ CellReturnStatus CellularModuleA7672XX::_activatePDPContext() {
 }
 
 CellReturnStatus CellularModuleA7672XX::_httpInit() {
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
   at_->sendAT("+HTTPINIT");
   auto response = at_->waitResponse();
   if (response == ATCommandHandler::Timeout) {
@@ -1216,29 +2080,16 @@ CellReturnStatus CellularModuleA7672XX::_httpInit() {
 
 CellReturnStatus CellularModuleA7672XX::_httpSetParamTimeout(int connectionTimeout,
                                                              int responseTimeout) {
-  // Add threshold guard based on module specification (20 - 120). Default 120
-  if (connectionTimeout != -1) {
-    if (connectionTimeout < 20) {
-      connectionTimeout = 20;
-    } else if (connectionTimeout > 120) {
-      connectionTimeout = 120;
-    }
-  }
+  _clampHttpTimeout(connectionTimeout, responseTimeout);
 
-  // Add threshold guard based on module specification (2 - 120). Default 20
-  if (responseTimeout != -1) {
-    if (responseTimeout < 2) {
-      responseTimeout = 2;
-    } else if (responseTimeout > 120) {
-      responseTimeout = 120;
-    }
-  }
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
 
   // +HTTPPARA set connection timeout if provided
   if (connectionTimeout != -1) {
     // AT+HTTPPARA="CONNECTTO",<conntimeout>
-    std::string cmd = std::string("+HTTPPARA=\"CONNECTTO\",") + std::to_string(connectionTimeout);
-    at_->sendAT(cmd.c_str());
+    char cmd[40] = {0};
+    sprintf(cmd, "+HTTPPARA=\"CONNECTTO\",%d", connectionTimeout);
+    at_->sendAT(cmd);
     auto response = at_->waitResponse();
     if (response == ATCommandHandler::Timeout) {
       AG_LOGW(TAG, "Timeout wait response +HTTPPARA CONNECTTO");
@@ -1252,8 +2103,9 @@ CellReturnStatus CellularModuleA7672XX::_httpSetParamTimeout(int connectionTimeo
   // +HTTPPARA set response timeout if provided
   if (responseTimeout != -1) {
     // AT+HTTPPARA="RECVTO",<recv_timeout>
-    std::string cmd = std::string("+HTTPPARA=\"RECVTO\",") + std::to_string(responseTimeout);
-    at_->sendAT(cmd.c_str());
+    char cmd[40] = {0};
+    sprintf(cmd, "+HTTPPARA=\"RECVTO\",%d", responseTimeout);
+    at_->sendAT(cmd);
     auto response = at_->waitResponse();
     if (response == ATCommandHandler::Timeout) {
       AG_LOGW(TAG, "Timeout wait response +HTTPPARA RECVTO");
@@ -1268,6 +2120,7 @@ CellReturnStatus CellularModuleA7672XX::_httpSetParamTimeout(int connectionTimeo
 }
 
 CellReturnStatus CellularModuleA7672XX::_httpSetUrl(const std::string &url) {
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
   char buf[200] = {0};
   sprintf(buf, "+HTTPPARA=\"URL\", \"%s\"", url.c_str());
   at_->sendAT(buf);
@@ -1283,55 +2136,279 @@ CellReturnStatus CellularModuleA7672XX::_httpSetUrl(const std::string &url) {
   return CellReturnStatus::Ok;
 }
 
-CellReturnStatus CellularModuleA7672XX::_httpAction(int httpMethodCode, int connectionTimeout,
-                                                    int responseTimeout, int *oResponseCode,
-                                                    int *oBodyLen) {
-  int code = -1, bodyLen = 0;
-  int waitActionTimeout;
-  std::string data;
+CellReturnStatus CellularModuleA7672XX::_httpSetSslContext() {
+  CellReturnStatus status = _ensureSslContext();
+  if (status != CellReturnStatus::Ok) {
+    return status;
+  }
 
-  // +HTTPACTION
-  data = std::string("+HTTPACTION=") + std::to_string(httpMethodCode);
-  at_->sendAT(data.c_str());
-  auto response = at_->waitResponse(); // Wait for OK
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
+  char buf[30] = {0};
+  sprintf(buf, "+HTTPPARA=\"SSLCFG\",%d", SSL_CONTEXT_ID);
+  at_->sendAT(buf);
+  auto response = at_->waitResponse();
+  if (response == ATCommandHandler::Timeout) {
+    AG_LOGW(TAG, "Timeout wait response +HTTPPARA SSLCFG");
+    return CellReturnStatus::Timeout;
+  } else if (response == ATCommandHandler::ExpArg2) {
+    AG_LOGW(TAG, "Error set HTTP param SSLCFG");
+    return CellReturnStatus::Error;
+  }
+
+  return CellReturnStatus::Ok;
+}
+
+CellReturnStatus CellularModuleA7672XX::_httpSetUserHeaders(const char *host,
+                                                           const char *ifNoneMatch) {
+  // Headers separated by "\r\n" escape, quote in ETag written as "\22" escape
+  char buf[200] = {0};
+  int length = sprintf(buf, "+HTTPPARA=\"USERDATA\",\"");
+  if (host != nullptr) {
+    length += snprintf(buf + length, sizeof(buf) - length, "Host: %s", host);
+  }
+  if (ifNoneMatch != nullptr && *ifNoneMatch != '\0') {
+    length += snprintf(buf + length, sizeof(buf) - length, "%sIf-None-Match: ",
+                       host != nullptr ? "\\r\\n" : "");
+    for (const char *p = ifNoneMatch; *p != '\0' && length < (int)sizeof(buf) - 5; p++) {
+      if (*p == '"') {
+        length += sprintf(buf + length, "\\22");
+      } else {
+        buf[length++] = *p;
+      }
+    }
+  }
+  if (length >= (int)sizeof(buf) - 1) {
+    AG_LOGW(TAG, "HTTP user headers too long");
+    return CellReturnStatus::Error;
+  }
+  buf[length] = '"';
+
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
+  at_->sendAT(buf);
+  auto response = at_->waitResponse();
   if (response == ATCommandHandler::Timeout) {
-    AG_LOGW(TAG, "Timeout wait response +HTTPACTION GET");
+    AG_LOGW(TAG, "Timeout wait response +HTTPPARA USERDATA");
     return CellReturnStatus::Timeout;
   } else if (response == ATCommandHandler::ExpArg2) {
-    AG_LOGW(TAG, "Error execute HTTPACTION GET");
+    AG_LOGW(TAG, "Error set HTTP param USERDATA");
+    return CellReturnStatus::Error;
+  }
+
+  return CellReturnStatus::Ok;
+}
+
+// Skip spaces between header name and its value
+static const char *headerValue(const char *value) {
+  while (*value == ' ') {
+    value++;
+  }
+  return value;
+}
+
+CellReturnStatus CellularModuleA7672XX::_httpReadHeaders() {
+  _etag[0] = '\0';
+  _retryAfter[0] = '\0';
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
+
+  // +HTTPHEAD: <data_len>, followed by header block of that length
+  at_->sendAT("+HTTPHEAD");
+  if (at_->waitResponse("+HTTPHEAD:") != ATCommandHandler::ExpArg1) {
+    AG_LOGW(TAG, "Error execute +HTTPHEAD");
+    return CellReturnStatus::Error;
+  }
+  char line[128] = {0};
+  int remaining = 0;
+  if (at_->waitAndRecvRespLine(line, sizeof(line)) == -1 ||
+      !ATResponseParser(line).nextInt(remaining)) {
+    AG_LOGW(TAG, "Invalid +HTTPHEAD length");
+    return CellReturnStatus::Error;
+  }
+
+  // Go through header block line by line without keeping it, only few headers are needed
+  char chunk[32];
+  size_t lineLength = 0;
+  while (remaining > 0) {
+    int chunkLength = remaining < (int)sizeof(chunk) ? remaining : sizeof(chunk);
+    if (at_->retrieveBuffer(chunk, chunkLength) != chunkLength) {
+      AG_LOGW(TAG, "Timeout retrieve response headers");
+      return CellReturnStatus::Timeout;
+    }
+    remaining -= chunkLength;
+
+    for (int i = 0; i < chunkLength; i++) {
+      char c = chunk[i];
+      if (c != '\r' && c != '\n' && lineLength < sizeof(line) - 1) {
+        line[lineLength++] = c;
+      }
+      if (c != '\n' && (remaining > 0 || i < chunkLength - 1)) {
+        continue;
+      }
+
+      line[lineLength] = '\0';
+      lineLength = 0;
+      if (strncasecmp(line, "ETag:", 5) == 0) {
+        snprintf(_etag, sizeof(_etag), "%s", headerValue(line + 5));
+      } else if (strncasecmp(line, "Retry-After:", 12) == 0) {
+        snprintf(_retryAfter, sizeof(_retryAfter), "%s", headerValue(line + 12));
+      }
+    }
+  }
+  at_->waitResponse();
+
+  return CellReturnStatus::Ok;
+}
+
+CellReturnStatus CellularModuleA7672XX::_ensureSslContext() {
+  if (_sslConfigured) {
+    return CellReturnStatus::Ok;
+  }
+  if (_caPem == nullptr) {
+    AG_LOGW(TAG, "CA certificate not set for https request");
     return CellReturnStatus::Error;
   }
 
-  // calculate how long to wait for +HTTPACTION
-  waitActionTimeout = _calculateResponseTimeout(connectionTimeout, responseTimeout);
+  // Name derived from content (FNV-1a), so changed certificate is uploaded again
+  uint32_t hash = 2166136261u;
+  for (const char *p = _caPem; *p != '\0'; p++) {
+    hash = (hash ^ static_cast<uint8_t>(*p)) * 16777619u;
+  }
+  char name[20] = {0};
+  sprintf(name, "ag_%08lx.pem", static_cast<unsigned long>(hash));
+
+  if (!_caUploaded) {
+    CellReturnStatus status = _uploadCACert(name);
+    if (status != CellReturnStatus::Ok) {
+      return status;
+    }
+    _caUploaded = true;
+  }
+
+  // TLS 1.2 only with server verification, SNI needed by virtual hosted server
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
+  char cmd[4][60];
+  sprintf(cmd[0], "+CSSLCFG=\"sslversion\",%d,3", SSL_CONTEXT_ID);
+  sprintf(cmd[1], "+CSSLCFG=\"authmode\",%d,1", SSL_CONTEXT_ID);
+  sprintf(cmd[2], "+CSSLCFG=\"cacert\",%d,\"%s\"", SSL_CONTEXT_ID, name);
+  sprintf(cmd[3], "+CSSLCFG=\"enableSNI\",%d,1", SSL_CONTEXT_ID);
+  for (const char *c : cmd) {
+    at_->sendAT(c);
+    auto response = at_->waitResponse();
+    if (response == ATCommandHandler::Timeout) {
+      AG_LOGW(TAG, "Timeout wait response %s", c);
+      return CellReturnStatus::Timeout;
+    } else if (response != ATCommandHandler::ExpArg1) {
+      AG_LOGW(TAG, "Error configure SSL context with %s", c);
+      return CellReturnStatus::Error;
+    }
+  }
+
+  AG_LOGI(TAG, "SSL context %d configured with CA %s", SSL_CONTEXT_ID, name);
+  _sslConfigured = true;
+
+  return CellReturnStatus::Ok;
+}
+
+CellReturnStatus CellularModuleA7672XX::_uploadCACert(const char *name) {
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
+
+  // Certificate kept in module flash across restart, only upload when not there yet
+  at_->sendAT("+CCERTLIST");
+  std::vector<std::string> lines;
+  if (at_->waitResponseLines(lines) == ATCommandHandler::ExpArg1) {
+    for (const std::string &line : lines) {
+      if (line.find(name) != std::string::npos) {
+        AG_LOGI(TAG, "CA certificate %s already in module", name);
+        return CellReturnStatus::Ok;
+      }
+    }
+  }
+
+  int length = strlen(_caPem);
+  char buf[50] = {0};
+  sprintf(buf, "+CCERTDOWN=\"%s\",%d", name, length);
+  at_->sendAT(buf);
+  if (at_->waitResponse(">") != ATCommandHandler::ExpArg1) {
+    AG_LOGW(TAG, "Error +CCERTDOWN wait for \">\" prompt");
+    return CellReturnStatus::Error;
+  }
+  at_->sendData(_caPem, length);
+  auto response = at_->waitResponse(10000);
+  if (response == ATCommandHandler::Timeout) {
+    AG_LOGW(TAG, "Timeout wait CA certificate upload");
+    return CellReturnStatus::Timeout;
+  } else if (response != ATCommandHandler::ExpArg1) {
+    AG_LOGW(TAG, "Error upload CA certificate");
+    return CellReturnStatus::Error;
+  }
+  AG_LOGI(TAG, "CA certificate %s uploaded to module", name);
+
+  return CellReturnStatus::Ok;
+}
+
+CellReturnStatus CellularModuleA7672XX::_httpAction(int httpMethodCode, int connectionTimeout,
+                                                    int responseTimeout, int *oResponseCode,
+                                                    int *oBodyLen) {
+  int code = -1, bodyLen = 0;
+  int waitActionTimeout;
+  char data[40] = {0};
+  _httpErrorCode = 0;
+
+  AG_TRACE_SPAN("module", "HTTPACTION");
+
+  // +HTTPACTION
+  {
+    ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
+    sprintf(data, "+HTTPACTION=%d", httpMethodCode);
+    at_->sendAT(data);
+    auto response = at_->waitResponse(); // Wait for OK
+    if (response == ATCommandHandler::Timeout) {
+      AG_LOGW(TAG, "Timeout wait response +HTTPACTION GET");
+      return CellReturnStatus::Timeout;
+    } else if (response == ATCommandHandler::ExpArg2) {
+      AG_LOGW(TAG, "Error execute HTTPACTION GET");
+      return CellReturnStatus::Error;
+    }
+    // Result URC follow OK, capture it before other task can read the serial line
+    at_->expectURC(URC_HTTPACTION);
+  }
+
+  // calculate how long to wait for +HTTPACTION, bounded by configured http timeouts
+  waitActionTimeout =
+      at_->getTimeout(ATCommandHandler::HttpAction,
+                      _calculateResponseTimeout(connectionTimeout, responseTimeout));
 
   // +HTTPACTION: <method>,<statuscode>,<datalen>
   // +HTTPACTION: <method>,<errcode>,<datalen>
-  // Wait for +HTTPACTION finish execute
-  response = at_->waitResponse(waitActionTimeout, "+HTTPACTION:");
-  if (response == ATCommandHandler::Timeout) {
-    AG_LOGW(TAG, "Timeout wait +HTTPACTION success execution");
+  // Wait for +HTTPACTION finish execute, serial line free for other task meanwhile
+  uint32_t actionStartTime = MILLIS();
+  std::string value;
+  if (at_->waitURC(URC_HTTPACTION, waitActionTimeout, value) == ATCommandHandler::Timeout) {
+    AG_LOGW(TAG, "Timeout wait +HTTPACTION success execution after %dms", waitActionTimeout);
+    at_->recordTimeout(ATCommandHandler::HttpAction);
     return CellReturnStatus::Timeout;
   }
+  at_->recordLatency(ATCommandHandler::HttpAction, MILLIS() - actionStartTime);
 
-  // Retrieve +HTTPACTION response value
-  at_->waitAndRecvRespLine(data);
   // Sanity check if value is empty
-  if (data.empty()) {
+  if (value.empty()) {
     AG_LOGW(TAG, "+HTTPACTION result value empty");
     return CellReturnStatus::Failed;
   }
 
   AG_LOGI(TAG, "+HTTPACTION finish! retrieve its values");
 
-  // 0,code,size
-  // start from code, ignore 0 (GET)
-  Common::splitByDelimiter(data.substr(2, data.length()), &code, &bodyLen);
+  // method,code,size
+  // start from code, ignore method
+  ATResponseParser parser(value);
+  if (!parser.skipField() || !parser.nextInt(code) || !parser.nextInt(bodyLen)) {
+    code = -1;
+  }
   if (code == -1 || (code > 700 && code < 720)) {
-    // -1 means string cannot splitted by comma
+    // -1 means value malformed
     // 7xx This is error code <errcode> not http <status_code>
     // 16.3.2 Description of<errcode> datasheet
     AG_LOGW(TAG, "+HTTPACTION error with module errcode: %d", code);
+    _httpErrorCode = code;
     return CellReturnStatus::Failed;
   }
 
@@ -1343,6 +2420,7 @@ CellReturnStatus CellularModuleA7672XX::_httpAction(int httpMethodCode, int conn
 }
 
 CellReturnStatus CellularModuleA7672XX::_httpTerminate() {
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
   // +HTTPTERM to stop http service
   // If previous AT return timeout, here just attempt
   at_->sendAT("+HTTPTERM");
@@ -1358,6 +2436,431 @@ CellReturnStatus CellularModuleA7672XX::_httpTerminate() {
   return CellReturnStatus::Ok;
 }
 
+void CellularModuleA7672XX::_createATHandler() {
+#if CONFIG_CELLULAR_STATIC_BUFFERS
+  at_ = new (_atStorage) ATCommandHandler(agSerial_);
+#else
+  at_ = new ATCommandHandler(agSerial_);
+#endif
+#if CONFIG_CELLULAR_COROUTINE_ENGINE
+  _engine = new ATEngine(at_);
+#endif
+}
+
+void CellularModuleA7672XX::_destroyATHandler() {
+  if (at_ == nullptr) {
+    return;
+  }
+
+  // Handlers and channels are kept until here, other task might still hold a pointer to them
+  _muxActive = false;
+  delete _statusAt;
+  _statusAt = nullptr;
+  delete _mux;
+  _mux = nullptr;
+
+#if CONFIG_CELLULAR_COROUTINE_ENGINE
+  delete _engine;
+  _engine = nullptr;
+#endif
+
+#if CONFIG_CELLULAR_STATIC_BUFFERS
+  at_->~ATCommandHandler();
+#else
+  delete at_;
+#endif
+  at_ = nullptr;
+}
+
+bool CellularModuleA7672XX::_isConnectError(int errcode) {
+  // 712 create socket, 713 DNS, 714 connect socket, 715 SSL handshake failed
+  return errcode >= 712 && errcode <= 715;
+}
+
+const std::string *CellularModuleA7672XX::_dnsRewriteUrl(const std::string &url, char *host) {
+#if !CONFIG_CELLULAR_DNS_CACHE_HTTP
+  // Module add Host header from URL by itself, USERDATA Host would be a second one
+  return nullptr;
+#else
+  // Only plain http, https needs the host name in URL for SNI and certificate check
+  static const char scheme[] = "http://";
+  const size_t start = sizeof(scheme) - 1;
+  if (url.compare(0, start, scheme) != 0) {
+    return nullptr;
+  }
+
+  size_t end = url.find_first_of(":/", start);
+  if (end == std::string::npos) {
+    end = url.length();
+  }
+  if ((end - start) >= DNS_HOST_MAX) {
+    return nullptr;
+  }
+  memcpy(host, url.data() + start, end - start);
+  host[end - start] = '\0';
+
+  char address[16] = {0};
+  if (!_dnsResolve(host, address)) {
+    return nullptr;
+  }
+
+  _dnsUrl.assign(scheme);
+  _dnsUrl.append(address);
+  _dnsUrl.append(url, end, std::string::npos);
+  return &_dnsUrl;
+#endif
+}
+
+bool CellularModuleA7672XX::_dnsResolve(const char *host, char *address) {
+  if (CONFIG_CELLULAR_DNS_CACHE_TTL_S == 0 || strlen(host) >= DNS_HOST_MAX) {
+    return false;
+  }
+
+  // Already an address
+  if (strspn(host, "0123456789.") == strlen(host)) {
+    return false;
+  }
+
+  uint32_t now = MILLIS();
+  DnsEntry *slot = &_dnsCache[0];
+  for (DnsEntry &entry : _dnsCache) {
+    if (strcmp(entry.host, host) == 0) {
+      if ((now - entry.resolvedAt) < (CONFIG_CELLULAR_DNS_CACHE_TTL_S * 1000UL)) {
+        strcpy(address, entry.address);
+        _dnsStats.cacheHits++;
+        _dnsStats.savedMs += entry.lookupMs;
+        return true;
+      }
+      slot = &entry;
+      break;
+    }
+    // Otherwise replace empty or oldest entry
+    if (slot->host[0] != '\0' &&
+        (entry.host[0] == '\0' || (now - entry.resolvedAt) > (now - slot->resolvedAt))) {
+      slot = &entry;
+    }
+  }
+
+  // +CDNSGIP: 1,"<host>","<address>" or +CDNSGIP: 0,<error>
+  _dnsStats.lookups++;
+  uint32_t lookupStartTime = MILLIS();
+  {
+    ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityLow);
+    char buf[DNS_HOST_MAX + 15] = {0};
+    sprintf(buf, "+CDNSGIP=\"%s\"", host);
+    at_->sendAT(buf);
+    if (at_->waitResponse() != ATCommandHandler::ExpArg1) {
+      AG_LOGW(TAG, "Error +CDNSGIP of %s", host);
+      _dnsStats.failures++;
+      return false;
+    }
+    at_->expectURC(URC_DNS);
+  }
+
+  // Result come after OK, serial line free for other task meanwhile
+  if (at_->waitURC(URC_DNS, at_->getTimeout(ATCommandHandler::NetworkCommand), _dnsResponse) !=
+      ATCommandHandler::ExpArg1) {
+    AG_LOGW(TAG, "Timeout wait +CDNSGIP result of %s", host);
+    _dnsStats.failures++;
+    return false;
+  }
+
+  size_t last = _dnsResponse.rfind('"');
+  size_t first = (last == std::string::npos) ? last : _dnsResponse.rfind('"', last - 1);
+  size_t length = last - first - 1;
+  if (_dnsResponse.compare(0, 2, "1,") != 0 || first == std::string::npos || length == 0 ||
+      length >= sizeof(slot->address) ||
+      _dnsResponse.find_first_not_of("0123456789.", first + 1) != last) {
+    AG_LOGW(TAG, "Failed resolve %s: %s", host, _dnsResponse.c_str());
+    _dnsStats.failures++;
+    return false;
+  }
+
+  strcpy(slot->host, host);
+  memcpy(slot->address, _dnsResponse.data() + first + 1, length);
+  slot->address[length] = '\0';
+  slot->resolvedAt = MILLIS();
+  slot->lookupMs = slot->resolvedAt - lookupStartTime;
+  strcpy(address, slot->address);
+  AG_LOGI(TAG, "Resolved %s to %s in %dms", host, address, static_cast<int>(slot->lookupMs));
+
+  return true;
+}
+
+void CellularModuleA7672XX::_dnsForget(const char *host) {
+  for (DnsEntry &entry : _dnsCache) {
+    if (strcmp(entry.host, host) == 0) {
+      entry.host[0] = '\0';
+    }
+  }
+}
+
+ATCommandHandler *CellularModuleA7672XX::_statusHandler() {
+  return _muxActive ? _statusAt : at_;
+}
+
+void CellularModuleA7672XX::_dropMultiplexer() {
+  if (!_muxActive) {
+    return;
+  }
+
+  // Module left multiplexer mode by itself, nothing to close down
+  ATCommandHandler::Transaction transaction(at_, ATCommandHandler::PriorityHigh);
+  ATCommandHandler::Transaction status(_statusAt, ATCommandHandler::PriorityHigh);
+  _muxActive = false;
+  _mux->close(false);
+  at_->setChannel(nullptr);
+  _statusAt->setChannel(nullptr);
+}
+
+CellReturnStatus CellularModuleA7672XX::_deadlineStatus(CellReturnStatus status) {
+  if (status != CellReturnStatus::Ok && isDeadlineExceeded()) {
+    AG_LOGW(TAG, "Operation deadline exceeded");
+    return CellReturnStatus::DeadlineExceeded;
+  }
+
+  return status;
+}
+
+bool CellularModuleA7672XX::_testATAnyBaudRate(uint32_t timeoutMs) {
+#ifdef ARDUINO
+  // Module keep negotiated baud rate until it is power cycled, while MCU might restart
+  int current = agSerial_->getBaudRate();
+  {
+    // Probing is part of baud negotiation, each candidate get its full attempt
+    ATCommandHandler::DeadlineSuspend suspend(at_);
+    if (at_->testAT(2000)) {
+      return true;
+    }
+
+    int candidates[] = {_loadBaudRate(), DEFAULT_BAUD_RATE};
+    for (int baud : candidates) {
+      if (baud <= 0 || baud == current) {
+        continue;
+      }
+      AG_LOGI(TAG, "Module not respond at %d, probing at %d", agSerial_->getBaudRate(), baud);
+      agSerial_->setBaudRate(baud);
+      at_->clearBuffer();
+      if (at_->testAT(2000)) {
+        return true;
+      }
+    }
+  }
+
+  // Module might be still booting, wait on default baud rate
+  agSerial_->setBaudRate(DEFAULT_BAUD_RATE);
+#endif
+
+  return at_->testAT(timeoutMs);
+}
+
+bool CellularModuleA7672XX::_waitModuleBoot(uint32_t timeoutMs) {
+  if (_statusIO != GPIO_NUM_NC) {
+    // Module going down first before booting again
+    _waitStatusLevel(0, 3000);
+    _waitStatusLevel(1, timeoutMs);
+  }
+
+  // Either one is the last boot URC depending on SIM and module firmware
+  auto response = at_->waitResponse(timeoutMs, "*ATREADY", "PB DONE", "SMS DONE");
+  if (response == ATCommandHandler::Timeout || response == ATCommandHandler::CMxError) {
+    return false;
+  }
+
+  AG_LOGI(TAG, "Module boot URC received");
+  return true;
+}
+
+bool CellularModuleA7672XX::_waitStatusLevel(int level, uint32_t timeoutMs) {
+  if (_statusIO == GPIO_NUM_NC) {
+    return false;
+  }
+
+  if (at_ != nullptr) {
+    timeoutMs = at_->clampToDeadline(timeoutMs);
+  }
+  for (uint32_t start = MILLIS(); (MILLIS() - start) < timeoutMs;) {
+    if (gpio_get_level(_statusIO) == level) {
+      return true;
+    }
+    DELAY_MS(10);
+  }
+
+  return false;
+}
+
+void CellularModuleA7672XX::_delayWithinDeadline(uint32_t ms) {
+  if (at_ != nullptr) {
+    ms = at_->clampToDeadline(ms);
+  }
+  DELAY_MS(ms);
+}
+
+#ifdef ARDUINO
+int CellularModuleA7672XX::_negotiateBaudRate() {
+  // Switch cut short leave module and serial line on different baud rate
+  ATCommandHandler::DeadlineSuspend suspend(at_);
+  int previous = agSerial_->getBaudRate();
+  if (previous >= CELLULAR_TARGET_BAUD_RATE) {
+    return previous;
+  }
+  int stored = _loadBaudRate();
+
+  // Multi line response to compare with after switching, AT/OK alone pass on a lossy line
+  std::vector<std::string> reference;
+  at_->sendRaw("ATI");
+  if (at_->waitResponseLines(reference) != ATCommandHandler::ExpArg1 || reference.empty()) {
+    AG_LOGW(TAG, "Failed retrieve reference response, keep baud rate %d", previous);
+    return previous;
+  }
+
+  for (int baud : BAUD_RATE_CANDIDATES) {
+    if (baud > CELLULAR_TARGET_BAUD_RATE) {
+      continue;
+    }
+    if (baud == previous) {
+      // Already at the highest working candidate
+      return baud;
+    }
+    // Skip candidate higher than the one already known to work
+    if (stored > 0 && baud > stored) {
+      continue;
+    }
+    if (baud < previous) {
+      break;
+    }
+
+    AG_LOGI(TAG, "Negotiate baud rate %d", baud);
+    if (_switchBaudRate(baud, &reference)) {
+      AG_LOGI(TAG, "Baud rate switched from %d to %d", previous, baud);
+      _storeBaudRate(baud);
+      return baud;
+    }
+
+    // Fallback to previous baud rate
+    AG_LOGW(TAG, "Baud rate %d not working, fallback to %d", baud, previous);
+    if (!_switchBaudRate(previous, nullptr)) {
+      // Module now unreachable on both, restore serial line and let caller recover
+      agSerial_->setBaudRate(previous);
+      AG_LOGE(TAG, "Failed fallback to baud rate %d", previous);
+      return previous;
+    }
+    // Next time go directly to lower candidate
+    stored = baud;
+  }
+
+  // Fallback baud rate is not a ceiling, next negotiation try every candidate again
+  if (stored > 0) {
+    _storeBaudRate(0);
+  }
+
+  return previous;
+}
+
+bool CellularModuleA7672XX::_switchBaudRate(int baud, const std::vector<std::string> *reference) {
+  char buf[20] = {0};
+  sprintf(buf, "+IPR=%d", baud);
+  at_->sendAT(buf);
+  // Module send OK with current baud rate before switching
+  at_->waitResponse(1000);
+
+  agSerial_->setBaudRate(baud);
+  DELAY_MS(100);
+  at_->clearBuffer();
+
+  if (!at_->testAT(1000)) {
+    return false;
+  }
+  if (reference == nullptr) {
+    return true;
+  }
+
+  std::vector<std::string> lines;
+  at_->sendRaw("ATI");
+  if (at_->waitResponseLines(lines, 1000) != ATCommandHandler::ExpArg1 || lines != *reference) {
+    AG_LOGW(TAG, "Response at baud rate %d differ from reference", baud);
+    return false;
+  }
+
+  return true;
+}
+
+void CellularModuleA7672XX::_applyFlowControl() {
+  // Serial line first, no point to configure module if it cannot be used
+  if (!agSerial_->setFlowControl(true)) {
+    return;
+  }
+
+  // RTS/CTS on both direction
+  at_->sendAT("+IFC=2,2");
+  if (at_->waitResponse() != ATCommandHandler::ExpArg1) {
+    AG_LOGW(TAG, "Failed enable module flow control, disable it on serial line");
+    agSerial_->setFlowControl(false);
+    return;
+  }
+
+  AG_LOGI(TAG, "RTS/CTS flow control enabled");
+}
+
+int CellularModuleA7672XX::_loadBaudRate() {
+  nvs_handle_t handle;
+  if (nvs_open(BAUD_RATE_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+    return -1;
+  }
+
+  uint32_t baud = 0;
+  esp_err_t err = nvs_get_u32(handle, BAUD_RATE_NVS_KEY, &baud);
+  nvs_close(handle);
+  if (err != ESP_OK) {
+    return -1;
+  }
+
+  return baud;
+}
+
+void CellularModuleA7672XX::_storeBaudRate(int baud) {
+  nvs_handle_t handle;
+  if (nvs_open(BAUD_RATE_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+    AG_LOGW(TAG, "Failed open nvs to store baud rate");
+    return;
+  }
+
+  if (baud > 0) {
+    nvs_set_u32(handle, BAUD_RATE_NVS_KEY, baud);
+  } else {
+    nvs_erase_key(handle, BAUD_RATE_NVS_KEY);
+  }
+  nvs_commit(handle);
+  nvs_close(handle);
+}
+#endif
+
+bool CellularModuleA7672XX::_isRegisteredStatus(const std::string &value) {
+  // <n>,<stat>[,...] ; stat 1 is registered home network, 5 is registered roaming
+  ATResponseParser parser(value);
+  int stat;
+  if (!parser.skipField() || !parser.nextInt(stat)) {
+    return false;
+  }
+
+  return stat == 1 || stat == 5;
+}
+
+int CellularModuleA7672XX::_parseSignal(const std::string &value) {
+  // <rssi>,<ber> ; ignore <ber> value, only <rssi>
+  int signal;
+  if (!ATResponseParser(value).nextInt(signal)) {
+    return 99;
+  }
+
+  return signal;
+}
+
+bool CellularModuleA7672XX::_isZeroResult(const std::string &value) {
+  int code;
+  return ATResponseParser(value).nextInt(code) && code == 0;
+}
+
 int CellularModuleA7672XX::_mapCellTechToMode(CellTechnology ct) {
   int mode = -1;
   switch (ct) {
@@ -1413,4 +2916,363 @@ int CellularModuleA7672XX::_calculateResponseTimeout(int connectionTimeout, int
   return waitActionTimeout;
 }
 
+void CellularModuleA7672XX::_clampHttpTimeout(int &connectionTimeout, int &responseTimeout) {
+  // Add threshold guard based on module specification (20 - 120). Default 120
+  if (connectionTimeout != -1) {
+    if (connectionTimeout < 20) {
+      connectionTimeout = 20;
+    } else if (connectionTimeout > 120) {
+      connectionTimeout = 120;
+    }
+  }
+
+  // Add threshold guard based on module specification (2 - 120). Default 20
+  if (responseTimeout != -1) {
+    if (responseTimeout < 2) {
+      responseTimeout = 2;
+    } else if (responseTimeout > 120) {
+      responseTimeout = 120;
+    }
+  }
+}
+
+#if CONFIG_CELLULAR_COROUTINE_ENGINE
+
+ATTask<CellResult<int>> CellularModuleA7672XX::retrieveSignalAsync() {
+  CellResult<int> result;
+  result.status = CellReturnStatus::Timeout;
+
+  ATResult csq = co_await _engine->command("+CSQ");
+  std::string value;
+  if (csq.response != ATCommandHandler::ExpArg1 || !at_->findResultLine(csq.lines, "+CSQ:", value)) {
+    result.status = _asyncStatus(csq.response);
+    co_return result;
+  }
+
+  result.status = CellReturnStatus::Ok;
+  result.data = _parseSignal(value);
+  co_return result;
+}
+
+ATTask<CellResult<CellularModule::HttpResponse>>
+CellularModuleA7672XX::httpGetAsync(std::string url, int connectionTimeout, int responseTimeout) {
+  CellResult<CellularModule::HttpResponse> result;
+  co_await _acquireOperationAsync();
+
+  result.status = co_await _httpSetupAsync(url, "", connectionTimeout, responseTimeout);
+  if (result.status != CellReturnStatus::Ok) {
+    _releaseOperationAsync();
+    co_return std::move(result);
+  }
+
+  // +HTTPACTION, retry 3 times when request failed, not error or timeout from CE card
+  int statusCode = -1;
+  int bodyLen = -1;
+  for (int counter = 0; counter < 3; counter++) {
+    // 0 is GET method defined valus for this module
+    result.status = co_await _httpActionAsync(0, connectionTimeout, responseTimeout, &statusCode,
+                                              &bodyLen);
+    if (result.status != CellReturnStatus::Failed) {
+      break;
+    }
+    AG_LOGW(TAG, "Retry HTTP request in 2s");
+    co_await _engine->delay(2000);
+  }
+  if (result.status != CellReturnStatus::Ok) {
+    AG_LOGE(TAG, "HTTP request failed!");
+    co_await _httpTerminateAsync();
+    _releaseOperationAsync();
+    co_return std::move(result);
+  }
+  AG_LOGI(TAG, "HTTP response code %d with body len: %d. Retrieving response body...", statusCode,
+          bodyLen);
+
+  char *bodyResponse = nullptr;
+  if (bodyLen > 0) {
+#if CONFIG_CELLULAR_STATIC_BUFFERS
+    if (bodyLen + 1 > CONFIG_CELLULAR_BODY_ARENA_SIZE) {
+      AG_LOGE(TAG, "Response body %d bytes exceed body buffer size", bodyLen);
+      co_await _httpTerminateAsync();
+      _releaseOperationAsync();
+      result.status = CellReturnStatus::Failed;
+      co_return std::move(result);
+    }
+    bodyResponse = _bodyArena;
+#else
+    bodyResponse = new char[bodyLen + 1];
+#endif
+    memset(bodyResponse, 0, bodyLen + 1);
+
+    // +HTTPREAD, each chunk a separate command so others can slot in between
+    int offset = 0;
+    char cmd[32] = {0};
+    while (offset < bodyLen) {
+      sprintf(cmd, "+HTTPREAD=%d,%d", offset, HTTPREAD_CHUNK_SIZE);
+      ATResult chunk = co_await _engine->command(cmd, 0, "+HTTPREAD: 0", "+HTTPREAD:");
+      if (chunk.response != ATCommandHandler::ExpArg1 || chunk.data.empty() ||
+          offset + (int)chunk.data.size() > bodyLen) {
+        AG_LOGW(TAG, "Failed retrieve +HTTPREAD chunk at offset %d", offset);
+        break;
+      }
+      memcpy(bodyResponse + offset, chunk.data.data(), chunk.data.size());
+      offset += chunk.data.size();
+    }
+
+    if (offset < bodyLen) {
+      AG_LOGE(TAG, "Failed to retrieve all response body data from module");
+#if !CONFIG_CELLULAR_STATIC_BUFFERS
+      delete[] bodyResponse;
+#endif
+      co_await _httpTerminateAsync();
+      _releaseOperationAsync();
+      result.status = CellReturnStatus::Error;
+      co_return std::move(result);
+    }
+  }
+
+  result.data.statusCode = statusCode;
+  result.data.bodyLen = bodyLen;
+  if (bodyLen > 0) {
+#if CONFIG_CELLULAR_STATIC_BUFFERS
+    result.data.body = std::unique_ptr<char[], BodyDeleter>(bodyResponse, BodyDeleter(false));
+#else
+    result.data.body = std::unique_ptr<char[], BodyDeleter>(bodyResponse);
+#endif
+  }
+
+  co_await _httpTerminateAsync();
+  _releaseOperationAsync();
+  AG_LOGI(TAG, "httpGetAsync() finish");
+
+  result.status = CellReturnStatus::Ok;
+  co_return std::move(result);
+}
+
+ATTask<CellResult<CellularModule::HttpResponse>>
+CellularModuleA7672XX::httpPostAsync(std::string url, std::string body,
+                                     std::string headContentType, int connectionTimeout,
+                                     int responseTimeout) {
+  CellResult<CellularModule::HttpResponse> result;
+  co_await _acquireOperationAsync();
+
+  result.status = co_await _httpSetupAsync(url, headContentType, connectionTimeout,
+                                           responseTimeout);
+  if (result.status != CellReturnStatus::Ok) {
+    _releaseOperationAsync();
+    co_return std::move(result);
+  }
+
+  // +HTTPDATA ; Body len needs to be the same as length send after DOWNLOAD, otherwise error
+  char cmd[25] = {0};
+  sprintf(cmd, "+HTTPDATA=%d,10", body.length());
+  ATResult download = co_await _engine->command(cmd, 0, "DOWNLOAD");
+  ATResult sent;
+  if (download.response == ATCommandHandler::ExpArg1) {
+    // Timeout set based on +HTTPDATA param
+    sent = co_await _engine->sendRaw(body, 10000);
+  }
+  if (download.response != ATCommandHandler::ExpArg1 ||
+      sent.response != ATCommandHandler::ExpArg1) {
+    AG_LOGW(TAG, "Error +HTTPDATA wait for \"DOWNLOAD\" response");
+    co_await _httpTerminateAsync();
+    _releaseOperationAsync();
+    result.status = CellReturnStatus::Error;
+    co_return std::move(result);
+  }
+
+  // +HTTPACTION, 1 is POST method defined valus for this module
+  int statusCode = -1;
+  int bodyLen = -1;
+  result.status =
+      co_await _httpActionAsync(1, connectionTimeout, responseTimeout, &statusCode, &bodyLen);
+  if (result.status == CellReturnStatus::Ok) {
+    AG_LOGI(TAG, "HTTP response code %d with body len: %d", statusCode, bodyLen);
+    result.data.statusCode = statusCode;
+  }
+
+  co_await _httpTerminateAsync();
+  _releaseOperationAsync();
+  co_return std::move(result);
+}
+
+ATTask<CellReturnStatus> CellularModuleA7672XX::mqttPublishAsync(std::string topic,
+                                                                 std::string payload, int qos,
+                                                                 int retain, int timeoutS) {
+  co_await _acquireOperationAsync();
+
+  // +CMQTTTOPIC and +CMQTTPAYLOAD, each followed by its data after ">" prompt
+  char cmd[50] = {0};
+  sprintf(cmd, "+CMQTTTOPIC=0,%d", topic.length());
+  ATResult prompt = co_await _engine->command(cmd, 0, ">");
+  ATResult sent;
+  if (prompt.response == ATCommandHandler::ExpArg1) {
+    sent = co_await _engine->sendRaw(topic);
+  }
+  if (prompt.response != ATCommandHandler::ExpArg1 ||
+      sent.response != ATCommandHandler::ExpArg1) {
+    AG_LOGW(TAG, "Error +CMQTTTOPIC");
+    _releaseOperationAsync();
+    co_return CellReturnStatus::Error;
+  }
+
+  sprintf(cmd, "+CMQTTPAYLOAD=0,%d", payload.length());
+  prompt = co_await _engine->command(cmd, 0, ">");
+  if (prompt.response == ATCommandHandler::ExpArg1) {
+    sent = co_await _engine->sendRaw(payload);
+  }
+  if (prompt.response != ATCommandHandler::ExpArg1 ||
+      sent.response != ATCommandHandler::ExpArg1) {
+    AG_LOGW(TAG, "Error +CMQTTPAYLOAD");
+    _releaseOperationAsync();
+    co_return CellReturnStatus::Error;
+  }
+
+  // +CMQTTPUB, result URC follow OK
+  sprintf(cmd, "+CMQTTPUB=0,%d,%d,%d", qos, timeoutS, retain);
+  uint32_t publishStartTime = MILLIS();
+  ATResult pub = co_await _engine->command(cmd);
+  if (pub.response != ATCommandHandler::ExpArg1) {
+    AG_LOGW(TAG, "+CMQTTPUBLISH error");
+    _releaseOperationAsync();
+    co_return CellReturnStatus::Error;
+  }
+  ATResult published = co_await _engine->urc(
+      URC_MQTT_PUBLISH, at_->getTimeout(ATCommandHandler::MqttAction, timeoutS * 1000));
+  _releaseOperationAsync();
+  if (published.response != ATCommandHandler::ExpArg1) {
+    at_->recordTimeout(ATCommandHandler::MqttAction);
+    AG_LOGW(TAG, "+CMQTTPUBLISH error");
+    co_return CellReturnStatus::Error;
+  }
+  at_->recordLatency(ATCommandHandler::MqttAction, MILLIS() - publishStartTime);
+
+  if (!_isZeroResult(published.value)) {
+    AG_LOGE(TAG, "Failed +CMQTTPUB with value %s", published.value.c_str());
+    co_return CellReturnStatus::Error;
+  }
+
+  co_return CellReturnStatus::Ok;
+}
+
+ATTask<bool> CellularModuleA7672XX::_acquireOperationAsync() {
+  // Queue behind other coroutine and blocking operation, without blocking the scheduler task
+  uint32_t ticket = _operationMutex.takeTicket();
+  co_await _engine->until([this, ticket]() { return _operationMutex.isServing(ticket); });
+  co_return true;
+}
+
+void CellularModuleA7672XX::_releaseOperationAsync() {
+  _operationMutex.unlock();
+}
+
+ATTask<CellReturnStatus> CellularModuleA7672XX::_httpSetupAsync(std::string url,
+                                                                std::string contentType,
+                                                                int connectionTimeout,
+                                                                int responseTimeout) {
+  ATResult response = co_await _engine->command("+HTTPINIT");
+  if (response.response != ATCommandHandler::ExpArg1) {
+    AG_LOGW(TAG, "Failed initialize module HTTP service");
+    co_return _asyncStatus(response.response);
+  }
+
+  _clampHttpTimeout(connectionTimeout, responseTimeout);
+  char cmd[200] = {0};
+  if (connectionTimeout != -1) {
+    sprintf(cmd, "+HTTPPARA=\"CONNECTTO\",%d", connectionTimeout);
+    response = co_await _engine->command(cmd);
+  }
+  if (response.response == ATCommandHandler::ExpArg1 && responseTimeout != -1) {
+    sprintf(cmd, "+HTTPPARA=\"RECVTO\",%d", responseTimeout);
+    response = co_await _engine->command(cmd);
+  }
+  if (response.response == ATCommandHandler::ExpArg1 && !contentType.empty()) {
+    snprintf(cmd, sizeof(cmd), "+HTTPPARA=\"CONTENT\",\"%s\"", contentType.c_str());
+    response = co_await _engine->command(cmd);
+  }
+  if (response.response == ATCommandHandler::ExpArg1 && url.rfind("https://", 0) == 0) {
+    // Uploading certificate is blocking, done by first https request of httpGet() or httpPost()
+    if (!_sslConfigured) {
+      AG_LOGW(TAG, "SSL context not configured yet");
+      co_await _httpTerminateAsync();
+      co_return CellReturnStatus::Error;
+    }
+    sprintf(cmd, "+HTTPPARA=\"SSLCFG\",%d", SSL_CONTEXT_ID);
+    response = co_await _engine->command(cmd);
+  }
+  if (response.response == ATCommandHandler::ExpArg1) {
+    snprintf(cmd, sizeof(cmd), "+HTTPPARA=\"URL\", \"%s\"", url.c_str());
+    response = co_await _engine->command(cmd);
+  }
+
+  if (response.response != ATCommandHandler::ExpArg1) {
+    AG_LOGW(TAG, "Failed set HTTP param");
+    co_await _httpTerminateAsync();
+    co_return _asyncStatus(response.response);
+  }
+
+  co_return CellReturnStatus::Ok;
+}
+
+ATTask<CellReturnStatus> CellularModuleA7672XX::_httpActionAsync(int httpMethodCode,
+                                                                 int connectionTimeout,
+                                                                 int responseTimeout,
+                                                                 int *oResponseCode,
+                                                                 int *oBodyLen) {
+  char cmd[20] = {0};
+  sprintf(cmd, "+HTTPACTION=%d", httpMethodCode);
+  ATResult response = co_await _engine->command(cmd);
+  if (response.response != ATCommandHandler::ExpArg1) {
+    AG_LOGW(TAG, "Failed execute +HTTPACTION");
+    co_return _asyncStatus(response.response);
+  }
+
+  // Suspended without holding the serial line until the result URC
+  uint32_t waitActionTimeout =
+      at_->getTimeout(ATCommandHandler::HttpAction,
+                      _calculateResponseTimeout(connectionTimeout, responseTimeout));
+  uint32_t actionStartTime = MILLIS();
+  ATResult action = co_await _engine->urc(URC_HTTPACTION, waitActionTimeout);
+  if (action.response != ATCommandHandler::ExpArg1) {
+    AG_LOGW(TAG, "Timeout wait +HTTPACTION success execution after %dms", waitActionTimeout);
+    at_->recordTimeout(ATCommandHandler::HttpAction);
+    co_return CellReturnStatus::Timeout;
+  }
+  at_->recordLatency(ATCommandHandler::HttpAction, MILLIS() - actionStartTime);
+
+  // method,code,size ; start from code, ignore method
+  int code = -1;
+  int bodyLen = 0;
+  ATResponseParser parser(action.value);
+  if (!parser.skipField() || !parser.nextInt(code) || !parser.nextInt(bodyLen)) {
+    code = -1;
+  }
+  if (code == -1 || (code > 700 && code < 720)) {
+    // 7xx This is error code <errcode> not http <status_code>
+    AG_LOGW(TAG, "+HTTPACTION error with module errcode: %d", code);
+    co_return CellReturnStatus::Failed;
+  }
+
+  *oResponseCode = code;
+  *oBodyLen = bodyLen;
+  co_return CellReturnStatus::Ok;
+}
+
+ATTask<bool> CellularModuleA7672XX::_httpTerminateAsync() {
+  ATResult response = co_await _engine->command("+HTTPTERM");
+  co_return response.response == ATCommandHandler::ExpArg1;
+}
+
+CellReturnStatus CellularModuleA7672XX::_asyncStatus(ATCommandHandler::Response response) {
+  switch (response) {
+  case ATCommandHandler::ExpArg1:
+    return CellReturnStatus::Ok;
+  case ATCommandHandler::Timeout:
+    return CellReturnStatus::Timeout;
+  default:
+    return CellReturnStatus::Error;
+  }
+}
+
+#endif // CONFIG_CELLULAR_COROUTINE_ENGINE
+
 #endif // ESP8266
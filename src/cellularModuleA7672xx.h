@@ -10,6 +10,9 @@
 
 #ifndef ESP8266
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <string>
 
 #include "driver/gpio.h"
@@ -19,7 +22,9 @@
 #else
 #include "AirgradientSerial.h"
 #endif
+#include "agCmux.h"
 #include "atCommandHandler.h"
+#include "atEngine.h"
 #include "cellularModule.h"
 
 #ifndef CONFIG_HTTPREAD_CHUNK_SIZE
@@ -27,6 +32,54 @@
 #define CONFIG_HTTPREAD_CHUNK_SIZE 200
 #endif
 
+#ifndef CONFIG_CELLULAR_POWER_KEY_RELEASE_MS
+// This configuration define by kconfig
+#define CONFIG_CELLULAR_POWER_KEY_RELEASE_MS 500
+#endif
+
+#ifndef CONFIG_CELLULAR_POWER_ON_PULSE_MS
+// This configuration define by kconfig
+#define CONFIG_CELLULAR_POWER_ON_PULSE_MS 100
+#endif
+
+#ifndef CONFIG_CELLULAR_POWER_OFF_WAIT_MS
+// This configuration define by kconfig
+#define CONFIG_CELLULAR_POWER_OFF_WAIT_MS 2000
+#endif
+
+#ifndef CONFIG_CELLULAR_BOOT_TIMEOUT_MS
+// This configuration define by kconfig
+#define CONFIG_CELLULAR_BOOT_TIMEOUT_MS 20000
+#endif
+
+#ifndef CONFIG_CELLULAR_BAND_APPLY_WAIT_MS
+// This configuration define by kconfig
+#define CONFIG_CELLULAR_BAND_APPLY_WAIT_MS 5000
+#endif
+
+#ifndef CONFIG_CELLULAR_MQTT_ACQUIRE_WAIT_MS
+// This configuration define by kconfig
+#define CONFIG_CELLULAR_MQTT_ACQUIRE_WAIT_MS 0
+#endif
+
+#ifndef CONFIG_CELLULAR_DNS_CACHE_TTL_S
+// This configuration define by kconfig
+#define CONFIG_CELLULAR_DNS_CACHE_TTL_S 300
+#endif
+
+#ifndef CONFIG_CELLULAR_BODY_ARENA_SIZE
+// This configuration define by kconfig
+#define CONFIG_CELLULAR_BODY_ARENA_SIZE 2048
+#endif
+
+#ifdef ARDUINO
+#ifndef CELLULAR_TARGET_BAUD_RATE
+// Highest baud rate negotiated with the module on init, 115200 keep negotiation disabled
+// Bridge UART (WK2132) has no flow control, so rate above 460800 is never tried
+#define CELLULAR_TARGET_BAUD_RATE 115200
+#endif
+#endif
+
 class CellularModuleA7672XX : public CellularModule {
 public:
 #ifdef ARDUINO
@@ -41,8 +94,56 @@ private:
 
   AirgradientSerial *agSerial_ = nullptr;
   gpio_num_t _powerIO = GPIO_NUM_NC;
+  gpio_num_t _statusIO = GPIO_NUM_NC;
   ATCommandHandler *at_ = nullptr;
 
+  // Ticket lock, granted in request order. Not bound to a task, so coroutine on the scheduler
+  // task can queue with takeTicket() and wait for isServing() without blocking
+  class OperationMutex {
+  public:
+    void lock() {
+      std::unique_lock<std::mutex> lock(_mutex);
+      uint32_t ticket = _next++;
+      _released.wait(lock, [this, ticket]() { return _serving == ticket; });
+    }
+    void unlock() {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _serving++;
+      }
+      _released.notify_all();
+    }
+    uint32_t takeTicket() {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _next++;
+    }
+    bool isServing(uint32_t ticket) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _serving == ticket;
+    }
+
+  private:
+    std::mutex _mutex;
+    std::condition_variable _released;
+    uint32_t _next = 0;
+    uint32_t _serving = 0;
+  };
+
+  // Held through multi command operation that keep module state (HTTP, MQTT, registration),
+  // while each AT transaction of it acquire the serial line separately
+  OperationMutex _operationMutex;
+
+  // While multiplexer active, at_ run on channel 1 and status queries on channel 2
+  AgCmux *_mux = nullptr;
+  ATCommandHandler *_statusAt = nullptr;
+  std::atomic<bool> _muxActive{false};
+
+#if CONFIG_CELLULAR_STATIC_BUFFERS
+  alignas(ATCommandHandler) uint8_t _atStorage[sizeof(ATCommandHandler)];
+  char _bodyArena[CONFIG_CELLULAR_BODY_ARENA_SIZE];
+  char _readBuffer[CONFIG_HTTPREAD_CHUNK_SIZE + 1];
+#endif
+
 public:
   enum NetworkRegistrationState {
     // Check if AT ready
@@ -69,39 +170,121 @@ public:
 
   CellularModuleA7672XX(AirgradientSerial *agSerial);
   CellularModuleA7672XX(AirgradientSerial *agSerial, int powerPin);
-  ~CellularModuleA7672XX();
-
-  bool init();
-  void powerOn();
-  void powerOff(bool force);
-  bool reset();
-  void sleep();
-  CellResult<std::string> getModuleInfo();
-  CellResult<std::string> retrieveSimCCID();
-  CellReturnStatus isSimReady();
-  CellResult<int> retrieveSignal();
-  CellResult<std::string> retrieveIPAddr();
-  CellReturnStatus isNetworkRegistered(CellTechnology ct);
+
+  /**
+   * @param statusPin GPIO connected to module STATUS output, high when module powered on. Used to
+   * know when module finish power on or power off instead of fixed wait
+   */
+  CellularModuleA7672XX(AirgradientSerial *agSerial, int powerPin, int statusPin);
+  ~CellularModuleA7672XX() override;
+
+  bool init() override;
+  void powerOn() override;
+  void powerOff(bool force) override;
+  bool reset() override;
+  void sleep() override;
+  CellResult<std::string> getModuleInfo() override;
+  CellResult<std::string> retrieveSimCCID() override;
+  CellReturnStatus isSimReady() override;
+  CellResult<int> retrieveSignal() override;
+  CellResult<std::string> retrieveIPAddr() override;
+  CellReturnStatus isNetworkRegistered(CellTechnology ct) override;
   CellResult<std::string> startNetworkRegistration(CellTechnology ct, const std::string &apn,
-                                                   uint32_t operationTimeoutMs = 90000);
-  CellReturnStatus reinitialize();
+                                                   uint32_t operationTimeoutMs = 90000) override;
+  CellReturnStatus reinitialize() override;
   CellResult<CellularModule::HttpResponse>
-  httpGet(const std::string &url, int connectionTimeout = -1, int responseTimeout = -1);
+  httpGet(const std::string &url, int connectionTimeout = -1, int responseTimeout = -1) override;
+  CellResult<CellularModule::HttpResponse> httpGetIfNoneMatch(const std::string &url,
+                                                              const char *etag,
+                                                              int connectionTimeout = -1,
+                                                              int responseTimeout = -1) override;
   CellResult<CellularModule::HttpResponse> httpPost(const std::string &url, const std::string &body,
                                                     const std::string &headContentType = "",
                                                     int connectionTimeout = -1,
-                                                    int responseTimeout = -1);
+                                                    int responseTimeout = -1) override;
+  void setHttpsCACert(const char *caPem) override;
   CellReturnStatus mqttConnect(const std::string &clientId, const std::string &host,
                                int port = 1883, std::string username = "",
-                               std::string password = "");
-  CellReturnStatus mqttDisconnect();
+                               std::string password = "") override;
+  CellReturnStatus mqttDisconnect() override;
   CellReturnStatus mqttPublish(const std::string &topic, const std::string &payload, int qos = 1,
-                               int retain = 0, int timeoutS = 15);
+                               int retain = 0, int timeoutS = 15) override;
+  CellResult<int> socketOpen(const std::string &host, int port,
+                             uint32_t timeoutMs = 30000) override;
+  CellResult<int> socketSend(int socket, const char *data, int length) override;
+  CellResult<int> socketRecv(int socket, char *buffer, int size, uint32_t timeoutMs = 0) override;
+  CellReturnStatus socketClose(int socket) override;
+  CellResult<int> udpOpen(int localPort = 0) override;
+  CellResult<int> socketSendTo(int socket, const std::string &host, int port, const char *data,
+                               int length) override;
+  CellReturnStatus enterDataMode() override;
+  CellReturnStatus exitDataMode() override;
+  DnsStats getDnsStats() override;
+  CellReturnStatus startMultiplexer() override;
+  CellReturnStatus stopMultiplexer() override;
+  void setDeadline(uint32_t budgetMs) override;
+  bool isDeadlineExceeded() override;
+
+#if CONFIG_CELLULAR_COROUTINE_ENGINE
+  /**
+   * @brief Engine running the *Async() operations, available after init(). Start its scheduler
+   * with engine()->startTask() or call engine()->poll() from an existing task
+   */
+  ATEngine *engine() { return _engine; }
+
+  // Coroutine version of the blocking operations, run with engine()->spawn(). Arguments are
+  // taken by value since the coroutine outlive the caller. Operation deadline is not applied
+  ATTask<CellResult<int>> retrieveSignalAsync();
+  ATTask<CellResult<CellularModule::HttpResponse>>
+  httpGetAsync(std::string url, int connectionTimeout = -1, int responseTimeout = -1);
+  ATTask<CellResult<CellularModule::HttpResponse>>
+  httpPostAsync(std::string url, std::string body, std::string headContentType = "",
+                int connectionTimeout = -1, int responseTimeout = -1);
+  ATTask<CellReturnStatus> mqttPublishAsync(std::string topic, std::string payload, int qos = 1,
+                                            int retain = 0, int timeoutS = 15);
+#endif
 
 private:
   const int DEFAULT_HTTP_CONNECT_TIMEOUT = 120; // seconds
   const int DEFAULT_HTTP_RESPONSE_TIMEOUT = 20; // seconds
   const int HTTPREAD_CHUNK_SIZE = CONFIG_HTTPREAD_CHUNK_SIZE;
+  const int DEFAULT_BAUD_RATE = 115200; // module baud rate after power on
+  static const int SOCKET_COUNT = 4;     // module support 10 links, only first few are used
+  const int SOCKET_RECV_MAX = 1500;      // +CIPRXGET read length limit
+  const int SOCKET_RECV_POLL_MS = 50;
+  const int SOCKET_UDP_LOCAL_PORT_BASE = 49152; // first dynamic port, used when none given
+  const int DATA_MODE_GUARD_TIME_MS = 1000;      // silence around "+++" escape sequence
+  const int SSL_CONTEXT_ID = 0;                  // +CSSLCFG context used by HTTP service
+  static const int DNS_CACHE_SIZE = 4;
+  static const int DNS_HOST_MAX = 64;
+  static const int ETAG_MAX = 72;
+  static const int RETRY_AFTER_MAX = 32;
+
+  // Socket state, reset when module reinitialized
+  bool _netOpened = false;
+  bool _socketOpened[SOCKET_COUNT] = {};
+
+  // HTTPS; certificate stay in module file system, SSL context is gone when module restarted
+  const char *_caPem = nullptr;
+  bool _caUploaded = false;
+  bool _sslConfigured = false;
+
+  // Host address resolved by +CDNSGIP, valid for CONFIG_CELLULAR_DNS_CACHE_TTL_S
+  struct DnsEntry {
+    char host[DNS_HOST_MAX];
+    char address[16]; // IPv4 only, IPv6 address can't be placed in URL as is
+    uint32_t resolvedAt;
+    uint32_t lookupMs;
+  };
+  DnsEntry _dnsCache[DNS_CACHE_SIZE] = {};
+  DnsStats _dnsStats;
+  std::string _dnsUrl;
+  std::string _dnsResponse;
+  // Response headers of last request, read only when needed
+  char _etag[ETAG_MAX] = {};
+  char _retryAfter[RETRY_AFTER_MAX] = {};
+  // Module <errcode> of last failed +HTTPACTION, 0 if none
+  int _httpErrorCode = 0;
 
   // Network Registration implementation for each state
   NetworkRegistrationState _implCheckModuleReady();
@@ -112,9 +295,89 @@ private:
   NetworkRegistrationState _implConfigureService(const std::string &apn);
   NetworkRegistrationState _implNetworkRegistered();
 
+  // Implementation of public operations, wrapped to report DeadlineExceeded
+  CellResult<CellularModule::HttpResponse> _httpGetResolved(const std::string &url,
+                                                            const char *ifNoneMatch,
+                                                            int connectionTimeout,
+                                                            int responseTimeout);
+  CellResult<CellularModule::HttpResponse> _httpGet(const std::string &url,
+                                                    const char *hostHeader,
+                                                    const char *ifNoneMatch,
+                                                    int connectionTimeout, int responseTimeout);
+  CellResult<CellularModule::HttpResponse> _httpPost(const std::string &url,
+                                                     const char *hostHeader,
+                                                     const std::string &body,
+                                                     const std::string &headContentType,
+                                                     int connectionTimeout, int responseTimeout);
+  CellReturnStatus _mqttConnect(const std::string &clientId, const std::string &host, int port,
+                                std::string username, std::string password);
+  CellReturnStatus _mqttPublish(const std::string &topic, const std::string &payload, int qos,
+                                int retain, int timeoutS);
+  CellReturnStatus _deadlineStatus(CellReturnStatus status);
+  CellReturnStatus _socketNetOpen();
+  bool _isSocketOpened(int socket);
+  CellResult<int> _socketOpen(const char *protocol, const std::string &host, int port,
+                              uint32_t timeoutMs);
+  CellResult<int> _socketSend(int socket, const char *host, int port, const char *data,
+                              int length);
+
+  void _createATHandler();
+  void _destroyATHandler();
+  ATCommandHandler *_statusHandler();
+  // Call while holding _operationMutex
+  void _dropMultiplexer();
+
+  // Hold the line of status queries, status channel while multiplexer active or at_ otherwise.
+  // Multiplexer state is checked again once acquired, as it might stop while waiting
+  class StatusTransaction {
+  public:
+    StatusTransaction(CellularModuleA7672XX *module) {
+      while (true) {
+        _at = module->_statusHandler();
+        _locked = _at->lock(ATCommandHandler::PriorityHigh);
+        if (!_locked || _at == module->at_ || module->_muxActive) {
+          break;
+        }
+        _at->unlock();
+      }
+    }
+    ~StatusTransaction() {
+      if (_locked) {
+        _at->unlock();
+      }
+    }
+    StatusTransaction(const StatusTransaction &) = delete;
+    StatusTransaction &operator=(const StatusTransaction &) = delete;
+    ATCommandHandler *at() { return _at; }
+
+  private:
+    ATCommandHandler *_at;
+    bool _locked;
+  };
+
+#if CONFIG_CELLULAR_COROUTINE_ENGINE
+  ATEngine *_engine = nullptr;
+
+  ATTask<bool> _acquireOperationAsync();
+  void _releaseOperationAsync();
+  ATTask<CellReturnStatus> _httpSetupAsync(std::string url, std::string contentType,
+                                           int connectionTimeout, int responseTimeout);
+  ATTask<CellReturnStatus> _httpActionAsync(int httpMethodCode, int connectionTimeout,
+                                            int responseTimeout, int *oResponseCode,
+                                            int *oBodyLen);
+  ATTask<bool> _httpTerminateAsync();
+  CellReturnStatus _asyncStatus(ATCommandHandler::Response response);
+#endif
+
   // AT Command functions
   CellReturnStatus _disableNetworkRegistrationURC(CellTechnology ct); // depend on CellTech
-  CellReturnStatus _checkAllRegistrationStatusCommand();
+  /**
+   * @brief Check +CREG, +CGREG, +CEREG and +CSQ in a single concatenated command line
+   *
+   * @param oSignal where <rssi> of +CSQ placed, 99 if not available
+   * @return Ok if registered on any of the domain, Failed if not registered on any
+   */
+  CellReturnStatus _checkAllRegistrationStatusCommand(int *oSignal);
   CellReturnStatus _applyCellularTechnology(CellTechnology ct);
   CellReturnStatus _applyPreferedBands();
   CellReturnStatus _applyOperatorSelection();
@@ -127,10 +390,91 @@ private:
   CellReturnStatus _httpInit();
   CellReturnStatus _httpSetParamTimeout(int connectionTimeout, int responseTimeout);
   CellReturnStatus _httpSetUrl(const std::string &url);
+  CellReturnStatus _httpSetSslContext();
+  CellReturnStatus _httpSetUserHeaders(const char *host, const char *ifNoneMatch);
+  CellReturnStatus _httpReadHeaders();
+
+  /**
+   * @brief Replace host of plain http URL with its cached address, resolving it when not cached
+   * Only with CONFIG_CELLULAR_DNS_CACHE_HTTP
+   *
+   * @param url original URL
+   * @param host where host name placed, for Host header
+   * @return rewritten URL, nullptr if URL kept as is
+   */
+  const std::string *_dnsRewriteUrl(const std::string &url, char *host);
+  bool _dnsResolve(const char *host, char *address);
+  void _dnsForget(const char *host);
+  CellReturnStatus _ensureSslContext();
+  CellReturnStatus _uploadCACert(const char *name);
   CellReturnStatus _httpAction(int httpMethodCode, int connectionTimeout, int responseTimeout,
                                int *oResponseCode, int *oBodyLen);
+  // +HTTPACTION errcode of failure before request reached the server (socket, DNS, connect)
+  bool _isConnectError(int errcode);
   CellReturnStatus _httpTerminate();
 
+  /**
+   * @brief Wait module to respond AT, when serial line support baud rate change also probe
+   * previously negotiated baud rate in case only the MCU restarted
+   *
+   * @param timeoutMs how long to wait module respond on default baud rate
+   * @return true if module respond
+   */
+  bool _testATAnyBaudRate(uint32_t timeoutMs);
+
+  /**
+   * @brief Wait module print its boot URC (*ATREADY, PB DONE or SMS DONE) after restarted
+   *
+   * @param timeoutMs maximum time to wait
+   * @return true if boot URC received
+   */
+  bool _waitModuleBoot(uint32_t timeoutMs);
+
+  /**
+   * @brief Wait STATUS pin to reach certain level
+   *
+   * @param level expected level, 1 powered on, 0 powered off
+   * @param timeoutMs maximum time to wait, shortened by operation deadline
+   * @return true if level reached, false if timeout or STATUS pin not wired
+   */
+  bool _waitStatusLevel(int level, uint32_t timeoutMs);
+
+  // Fixed sleep shortened to remaining budget of operation deadline
+  void _delayWithinDeadline(uint32_t ms);
+
+#ifdef ARDUINO
+  /**
+   * @brief Switch module (AT+IPR) and serial line to the highest baud rate that is verified to
+   * work, starting from CELLULAR_TARGET_BAUD_RATE. Fallback to previous baud rate on failure
+   *
+   * @return baud rate in use after negotiation
+   */
+  int _negotiateBaudRate();
+
+  /**
+   * @brief Switch module and serial line to baud rate, then verify the line
+   *
+   * @param baud baud rate to switch to
+   * @param reference ATI response lines received at previous baud rate, compared with the one
+   * received after switching. nullptr to only check AT/OK
+   * @return true if module respond as expected
+   */
+  bool _switchBaudRate(int baud, const std::vector<std::string> *reference);
+
+  /**
+   * @brief Enable RTS/CTS flow control on both serial line and module (AT+IFC) if serial line
+   * support it
+   */
+  void _applyFlowControl();
+  int _loadBaudRate();
+  // Negotiated baud rate, also upper bound of next negotiation. 0 to forget it
+  void _storeBaudRate(int baud);
+#endif
+
+  bool _isRegisteredStatus(const std::string &value);
+  int _parseSignal(const std::string &value);
+  bool _isZeroResult(const std::string &value);
+
   int _mapCellTechToMode(CellTechnology ct);
   std::string _mapCellTechToNetworkRegisCmd(CellTechnology ct);
 
@@ -144,6 +488,7 @@ private:
    * @return int total time in ms to wait for +HTTPACTION
    */
   int _calculateResponseTimeout(int connectionTimeout, int responseTimeout);
+  void _clampHttpTimeout(int &connectionTimeout, int &responseTimeout);
 };
 
 #endif // ESP8266
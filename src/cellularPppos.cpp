@@ -0,0 +1,246 @@
+/**
+ * AirGradient
+ * https://airgradient.com
+ *
+ * CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
+ */
+
+#ifndef ESP8266
+
+#include "cellularPppos.h"
+
+#if CONFIG_CELLULAR_PPPOS
+
+#include <chrono>
+
+#include "esp_netif_ppp.h"
+
+#include "common.h"
+#include "agLogger.h"
+#include "agResourceMonitor.h"
+#include "agTrace.h"
+
+// Wait for LCP terminate to be acknowledged by the module
+#define PPP_CLOSE_TIMEOUT_MS 5000
+#define PPP_RX_CHUNK_SIZE 256
+
+CellularPppos::CellularPppos(CellularModule *cell, AirgradientSerial *serial)
+    : cell_(cell), serial_(serial) {
+  _driver.base.post_attach = _postAttach;
+  _driver.base.netif = nullptr;
+  _driver.owner = this;
+}
+
+CellularPppos::~CellularPppos() {
+  stop();
+  // Receive task reference this object, wait until it really stopped
+  while (_rxTask != nullptr && !_stopRxTask()) {
+  }
+  stop();
+}
+
+bool CellularPppos::start(uint32_t timeoutMs) {
+  AG_RESOURCE_SCOPE("Pppos::start");
+  AG_TRACE_SPAN("ppp", "start");
+  if (_netif != nullptr) {
+    return isConnected();
+  }
+
+  if (cell_->enterDataMode() != CellReturnStatus::Ok) {
+    AG_LOGE(TAG, "Failed switch module to data mode");
+    return false;
+  }
+
+  esp_netif_config_t config = ESP_NETIF_DEFAULT_PPP();
+  _netif = esp_netif_new(&config);
+  if (_netif == nullptr) {
+    AG_LOGE(TAG, "Failed create PPP interface");
+    cell_->exitDataMode();
+    return false;
+  }
+
+  // Error events tell when PPP is down, including the end of stop()
+  esp_netif_ppp_config_t pppConfig = {};
+  pppConfig.ppp_phase_event_enabled = false;
+  pppConfig.ppp_error_event_enabled = true;
+  esp_netif_ppp_set_params(_netif, &pppConfig);
+  esp_event_handler_register(IP_EVENT, ESP_EVENT_ANY_ID, _onIPEvent, this);
+  esp_event_handler_register(NETIF_PPP_STATUS, ESP_EVENT_ANY_ID, _onPPPStatus, this);
+
+  {
+    std::lock_guard<std::mutex> lock(_stateMutex);
+    _running = true;
+    _rxStopped = false;
+    _connected = false;
+    _closed = false;
+  }
+  if (xTaskCreate(_rxTaskEntry, "pppRx", CONFIG_CELLULAR_PPPOS_TASK_STACK, this, 5, &_rxTask) !=
+      pdTRUE) {
+    AG_LOGE(TAG, "Failed create receive task");
+    _rxTask = nullptr;
+    stop();
+    return false;
+  }
+
+  esp_netif_attach(_netif, &_driver);
+  esp_netif_action_start(_netif, nullptr, 0, nullptr);
+
+  if (!_waitState(_connected, timeoutMs)) {
+    AG_LOGE(TAG, "Timeout wait PPP connected");
+    stop();
+    return false;
+  }
+
+  // Route sockets of every client over cellular
+  esp_netif_set_default_netif(_netif);
+
+  return true;
+}
+
+void CellularPppos::stop() {
+  if (_netif == nullptr) {
+    return;
+  }
+  AG_RESOURCE_SCOPE("Pppos::stop");
+  AG_TRACE_SPAN("ppp", "stop");
+
+  // Terminate request still goes through the serial line, keep receiving until closed
+  if (_rxTask != nullptr) {
+    esp_netif_action_stop(_netif, nullptr, 0, nullptr);
+    if (!_waitState(_closed, PPP_CLOSE_TIMEOUT_MS)) {
+      AG_LOGW(TAG, "PPP not closed gracefully");
+    }
+    if (!_stopRxTask()) {
+      // Netif and serial line still in use by the task, leave both for next stop()
+      AG_LOGE(TAG, "Receive task not stopped");
+      return;
+    }
+  }
+
+  esp_event_handler_unregister(IP_EVENT, ESP_EVENT_ANY_ID, _onIPEvent);
+  esp_event_handler_unregister(NETIF_PPP_STATUS, ESP_EVENT_ANY_ID, _onPPPStatus);
+  esp_netif_destroy(_netif);
+  _netif = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(_stateMutex);
+    _connected = false;
+  }
+
+  if (cell_->exitDataMode() != CellReturnStatus::Ok) {
+    AG_LOGW(TAG, "Module not back to command mode, reinitialize it");
+  }
+}
+
+bool CellularPppos::isConnected() {
+  std::lock_guard<std::mutex> lock(_stateMutex);
+  return _connected;
+}
+
+esp_err_t CellularPppos::_postAttach(esp_netif_t *netif, esp_netif_iodriver_handle handle) {
+  Driver *driver = static_cast<Driver *>(handle);
+  driver->base.netif = netif;
+
+  esp_netif_driver_ifconfig_t ifconfig = {};
+  ifconfig.handle = driver;
+  ifconfig.transmit = _transmit;
+  return esp_netif_set_driver_config(netif, &ifconfig);
+}
+
+esp_err_t CellularPppos::_transmit(void *handle, void *buffer, size_t length) {
+  CellularPppos *ppp = static_cast<Driver *>(handle)->owner;
+  ppp->serial_->write(static_cast<const uint8_t *>(buffer), length);
+  return ESP_OK;
+}
+
+void CellularPppos::_onIPEvent(void *arg, esp_event_base_t base, int32_t id, void *data) {
+  CellularPppos *ppp = static_cast<CellularPppos *>(arg);
+  if (id == IP_EVENT_PPP_GOT_IP) {
+    ip_event_got_ip_t *event = static_cast<ip_event_got_ip_t *>(data);
+    if (event->esp_netif != ppp->_netif) {
+      return;
+    }
+    AG_LOGI(ppp->TAG, "PPP connected with IP " IPSTR, IP2STR(&event->ip_info.ip));
+    {
+      std::lock_guard<std::mutex> lock(ppp->_stateMutex);
+      ppp->_connected = true;
+    }
+    ppp->_stateChanged.notify_all();
+  } else if (id == IP_EVENT_PPP_LOST_IP) {
+    AG_LOGW(ppp->TAG, "PPP lost IP");
+    std::lock_guard<std::mutex> lock(ppp->_stateMutex);
+    ppp->_connected = false;
+  }
+}
+
+void CellularPppos::_onPPPStatus(void *arg, esp_event_base_t base, int32_t id, void *data) {
+  CellularPppos *ppp = static_cast<CellularPppos *>(arg);
+  esp_netif_t *netif = *static_cast<esp_netif_t **>(data);
+  if (netif != ppp->_netif || id == NETIF_PPP_ERRORNONE || id >= NETIF_PP_PHASE_OFFSET) {
+    return;
+  }
+
+  // Any error code means PPP is down, user error is the result of stop()
+  if (id != NETIF_PPP_ERRORUSER) {
+    AG_LOGW(ppp->TAG, "PPP error %d", static_cast<int>(id));
+  }
+  {
+    std::lock_guard<std::mutex> lock(ppp->_stateMutex);
+    ppp->_connected = false;
+    ppp->_closed = true;
+  }
+  ppp->_stateChanged.notify_all();
+}
+
+void CellularPppos::_rxTaskEntry(void *arg) {
+  CellularPppos *ppp = static_cast<CellularPppos *>(arg);
+  uint8_t buf[PPP_RX_CHUNK_SIZE];
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lock(ppp->_stateMutex);
+      if (!ppp->_running) {
+        break;
+      }
+    }
+
+    int length = 0;
+    while (length < PPP_RX_CHUNK_SIZE && ppp->serial_->available()) {
+      buf[length++] = ppp->serial_->read();
+    }
+    if (length > 0) {
+      // Copied by lwIP
+      esp_netif_receive(ppp->_netif, buf, length, nullptr);
+    } else {
+      DELAY_MS(2);
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(ppp->_stateMutex);
+    ppp->_rxStopped = true;
+  }
+  ppp->_stateChanged.notify_all();
+  vTaskDelete(nullptr);
+}
+
+bool CellularPppos::_waitState(bool &state, uint32_t timeoutMs) {
+  std::unique_lock<std::mutex> lock(_stateMutex);
+  return _stateChanged.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                                [&state]() { return state; });
+}
+
+bool CellularPppos::_stopRxTask() {
+  {
+    std::lock_guard<std::mutex> lock(_stateMutex);
+    _running = false;
+  }
+  // Serial line must be left to AT handler only once the task stopped reading it
+  if (!_waitState(_rxStopped, 1000)) {
+    return false;
+  }
+  _rxTask = nullptr;
+  return true;
+}
+
+#endif // CONFIG_CELLULAR_PPPOS
+
+#endif // ESP8266
@@ -0,0 +1,116 @@
+/**
+ * AirGradient
+ * https://airgradient.com
+ *
+ * CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
+ */
+
+#ifndef CELLULAR_PPPOS_H
+#define CELLULAR_PPPOS_H
+
+#ifndef ESP8266
+
+#include "sdkconfig.h"
+
+#if CONFIG_CELLULAR_PPPOS
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifdef ARDUINO
+#include "agSerial.h"
+#else
+#include "AirgradientSerial.h"
+#endif
+#include "cellularModule.h"
+
+#ifndef CONFIG_CELLULAR_PPPOS_TASK_STACK
+// This configuration define by kconfig
+#define CONFIG_CELLULAR_PPPOS_TASK_STACK 3072
+#endif
+
+/**
+ * @brief PPP over the module serial line as an esp_netif interface, so lwIP socket based
+ * stack (esp_http_client, esp-tls, MQTT) run over cellular instead of module AT engines. Eg.
+ * AirgradientWifiClient work unchanged once started, with keep-alive, streamed body and TLS
+ * session resumption
+ *
+ * Module must be registered to network first. While started, AT operations of the module wait
+ * until stop()
+ *
+ * ```
+ * CellularPppos ppp(&cell, &serial);
+ * if (ppp.start()) {
+ *   AirgradientWifiClient client;
+ *   client.httpPostMeasures(payload);
+ *   ppp.stop();
+ * }
+ * ```
+ */
+class CellularPppos {
+public:
+  CellularPppos(CellularModule *cell, AirgradientSerial *serial);
+  ~CellularPppos();
+  CellularPppos(const CellularPppos &) = delete;
+  CellularPppos &operator=(const CellularPppos &) = delete;
+
+  /**
+   * @brief Switch module to data mode and bring PPP up as default interface. Application must
+   * have called esp_netif_init() and esp_event_loop_create_default()
+   *
+   * @param timeoutMs how long to wait for IP address
+   * @return true if IP address assigned
+   */
+  bool start(uint32_t timeoutMs = 30000);
+
+  /**
+   * @brief Terminate PPP and switch module back to command mode. Left running if receive task
+   * not stopped in time, call again later
+   */
+  void stop();
+
+  bool isConnected();
+  esp_netif_t *netif() { return _netif; }
+
+private:
+  const char *const TAG = "CellularPppos";
+
+  // esp_netif expects driver handle to start with its base
+  struct Driver {
+    esp_netif_driver_base_t base;
+    CellularPppos *owner;
+  };
+
+  static esp_err_t _postAttach(esp_netif_t *netif, esp_netif_iodriver_handle handle);
+  static esp_err_t _transmit(void *handle, void *buffer, size_t length);
+  static void _onIPEvent(void *arg, esp_event_base_t base, int32_t id, void *data);
+  static void _onPPPStatus(void *arg, esp_event_base_t base, int32_t id, void *data);
+  static void _rxTaskEntry(void *arg);
+  bool _waitState(bool &state, uint32_t timeoutMs);
+  bool _stopRxTask();
+
+  CellularModule *cell_;
+  AirgradientSerial *serial_;
+  esp_netif_t *_netif = nullptr;
+  Driver _driver;
+  TaskHandle_t _rxTask = nullptr;
+
+  // Updated from event loop and receive task
+  std::mutex _stateMutex;
+  std::condition_variable _stateChanged;
+  bool _running = false;
+  bool _rxStopped = false;
+  bool _connected = false;
+  bool _closed = false;
+};
+
+#endif // CONFIG_CELLULAR_PPPOS
+
+#endif // ESP8266
+#endif // CELLULAR_PPPOS_H
@@ -0,0 +1,162 @@
+/**
+ * AirGradient
+ * https://airgradient.com
+ *
+ * CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
+ */
+
+#include "coapMessage.h"
+
+#include <cstring>
+
+#define COAP_VERSION 1
+#define COAP_PAYLOAD_MARKER 0xFF
+
+void CoapWriter::header(uint8_t type, uint8_t code, uint16_t messageId, const uint8_t *token,
+                        size_t tokenLength) {
+  if (tokenLength > COAP_TOKEN_MAX) {
+    tokenLength = COAP_TOKEN_MAX;
+  }
+
+  _out.clear();
+  _lastOption = 0;
+  _out += static_cast<char>((COAP_VERSION << 6) | ((type & 0x03) << 4) | tokenLength);
+  _out += static_cast<char>(code);
+  _out += static_cast<char>(messageId >> 8);
+  _out += static_cast<char>(messageId & 0xFF);
+  _out.append(reinterpret_cast<const char *>(token), tokenLength);
+}
+
+void CoapWriter::option(uint16_t number, const char *value, size_t length) {
+  uint8_t deltaNibble, lengthNibble;
+  uint8_t deltaExtended[2], lengthExtended[2];
+  size_t deltaExtendedLength, lengthExtendedLength;
+  _optionNibble(number - _lastOption, deltaNibble, deltaExtended, deltaExtendedLength);
+  _optionNibble(length, lengthNibble, lengthExtended, lengthExtendedLength);
+  _lastOption = number;
+
+  _out += static_cast<char>((deltaNibble << 4) | lengthNibble);
+  _out.append(reinterpret_cast<const char *>(deltaExtended), deltaExtendedLength);
+  _out.append(reinterpret_cast<const char *>(lengthExtended), lengthExtendedLength);
+  _out.append(value, length);
+}
+
+void CoapWriter::option(uint16_t number, const char *value) {
+  option(number, value, strlen(value));
+}
+
+void CoapWriter::uintOption(uint16_t number, uint32_t value) {
+  char bytes[4];
+  size_t length = 0;
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    uint8_t b = (value >> shift) & 0xFF;
+    if (length > 0 || b != 0) {
+      bytes[length++] = static_cast<char>(b);
+    }
+  }
+  option(number, bytes, length);
+}
+
+void CoapWriter::payload(const char *data, size_t length) {
+  if (length == 0) {
+    return;
+  }
+  _out += static_cast<char>(COAP_PAYLOAD_MARKER);
+  _out.append(data, length);
+}
+
+void CoapWriter::_optionNibble(uint32_t value, uint8_t &nibble, uint8_t *extended,
+                               size_t &extendedLength) {
+  if (value < 13) {
+    nibble = value;
+    extendedLength = 0;
+  } else if (value < 269) {
+    nibble = 13;
+    extended[0] = value - 13;
+    extendedLength = 1;
+  } else {
+    nibble = 14;
+    value -= 269;
+    extended[0] = value >> 8;
+    extended[1] = value & 0xFF;
+    extendedLength = 2;
+  }
+}
+
+bool CoapResponse::isToken(const uint8_t *expected, size_t length) const {
+  return tokenLength == length && memcmp(token, expected, length) == 0;
+}
+
+// Option delta or length nibble with its extended bytes, false if reserved or truncated
+static bool readOptionValue(uint8_t nibble, const uint8_t *&p, const uint8_t *end,
+                            uint32_t &value) {
+  if (nibble < 13) {
+    value = nibble;
+  } else if (nibble == 13) {
+    if (p >= end) {
+      return false;
+    }
+    value = *p++ + 13;
+  } else if (nibble == 14) {
+    if ((end - p) < 2) {
+      return false;
+    }
+    value = ((p[0] << 8) | p[1]) + 269;
+    p += 2;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool coapParse(const char *data, size_t length, CoapResponse &out) {
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(data);
+  const uint8_t *end = p + length;
+  if (length < 4 || (p[0] >> 6) != COAP_VERSION) {
+    return false;
+  }
+
+  out.type = (p[0] >> 4) & 0x03;
+  out.tokenLength = p[0] & 0x0F;
+  out.code = p[1];
+  out.messageId = (p[2] << 8) | p[3];
+  p += 4;
+  if (out.tokenLength > COAP_TOKEN_MAX || static_cast<size_t>(end - p) < out.tokenLength) {
+    return false;
+  }
+  memcpy(out.token, p, out.tokenLength);
+  p += out.tokenLength;
+
+  out.hasBlock1 = false;
+  out.payload = nullptr;
+  out.payloadLength = 0;
+  uint32_t number = 0;
+  while (p < end) {
+    if (*p == COAP_PAYLOAD_MARKER) {
+      p++;
+      out.payload = reinterpret_cast<const char *>(p);
+      out.payloadLength = end - p;
+      break;
+    }
+
+    uint8_t head = *p++;
+    uint32_t delta, optionLength;
+    if (!readOptionValue(head >> 4, p, end, delta) ||
+        !readOptionValue(head & 0x0F, p, end, optionLength) ||
+        static_cast<uint32_t>(end - p) < optionLength) {
+      return false;
+    }
+    number += delta;
+
+    if (number == COAP_OPTION_BLOCK1 && optionLength <= 3) {
+      out.hasBlock1 = true;
+      out.block1 = 0;
+      for (uint32_t i = 0; i < optionLength; i++) {
+        out.block1 = (out.block1 << 8) | p[i];
+      }
+    }
+    p += optionLength;
+  }
+
+  return true;
+}
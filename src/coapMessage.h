@@ -0,0 +1,98 @@
+/**
+ * AirGradient
+ * https://airgradient.com
+ *
+ * CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
+ */
+
+#ifndef COAP_MESSAGE_H
+#define COAP_MESSAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// CoAP (RFC 7252) message header values, only what the uplink needs
+#define COAP_TYPE_CONFIRMABLE 0
+#define COAP_TYPE_NON_CONFIRMABLE 1
+#define COAP_TYPE_ACKNOWLEDGEMENT 2
+#define COAP_TYPE_RESET 3
+
+// Code is class.detail packed as (class << 5) | detail
+#define COAP_CODE(cls, detail) (((cls) << 5) | (detail))
+#define COAP_CODE_EMPTY COAP_CODE(0, 0)
+#define COAP_CODE_POST COAP_CODE(0, 2)
+#define COAP_CODE_CONTINUE COAP_CODE(2, 31)
+#define COAP_CODE_CLASS(code) ((code) >> 5)
+
+#define COAP_OPTION_URI_PATH 11
+#define COAP_OPTION_CONTENT_FORMAT 12
+#define COAP_OPTION_BLOCK1 27 // RFC 7959
+
+#define COAP_CONTENT_FORMAT_TEXT 0 // text/plain; charset=utf-8
+
+#define COAP_TOKEN_MAX 8
+
+/**
+ * @brief Encode a CoAP message into a reused string, options must be added in ascending number
+ *
+ * ```
+ * CoapWriter writer(out);
+ * writer.header(COAP_TYPE_CONFIRMABLE, COAP_CODE_POST, messageId, token, 4);
+ * writer.option(COAP_OPTION_URI_PATH, "measures");
+ * writer.payload(data, length);
+ * ```
+ */
+class CoapWriter {
+public:
+  explicit CoapWriter(std::string &out) : _out(out) {}
+
+  // Clear output and write fixed header followed by token
+  void header(uint8_t type, uint8_t code, uint16_t messageId, const uint8_t *token,
+              size_t tokenLength);
+  void option(uint16_t number, const char *value, size_t length);
+  void option(uint16_t number, const char *value);
+  // Unsigned option in minimal length, 0 encoded as empty value
+  void uintOption(uint16_t number, uint32_t value);
+  void payload(const char *data, size_t length);
+
+private:
+  std::string &_out;
+  uint16_t _lastOption = 0;
+
+  void _optionNibble(uint32_t value, uint8_t &nibble, uint8_t *extended, size_t &extendedLength);
+};
+
+/**
+ * @brief Header fields of a received CoAP message, decoded without copy
+ */
+struct CoapResponse {
+  uint8_t type = 0;
+  uint8_t code = 0;
+  uint16_t messageId = 0;
+  uint8_t token[COAP_TOKEN_MAX] = {};
+  size_t tokenLength = 0;
+  bool hasBlock1 = false;
+  uint32_t block1 = 0;
+  // Points into the parsed datagram
+  const char *payload = nullptr;
+  size_t payloadLength = 0;
+
+  bool isToken(const uint8_t *expected, size_t length) const;
+};
+
+/**
+ * @brief Decode a CoAP datagram
+ *
+ * @return false if malformed or not CoAP version 1
+ */
+bool coapParse(const char *data, size_t length, CoapResponse &out);
+
+/**
+ * @brief Block option value, see RFC 7959. szx is log2(block size) - 4
+ */
+inline uint32_t coapBlockValue(uint32_t num, bool more, uint8_t szx) {
+  return (num << 4) | (more ? 0x08 : 0) | (szx & 0x07);
+}
+
+#endif // COAP_MESSAGE_H
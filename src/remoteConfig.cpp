@@ -0,0 +1,161 @@
+/**
+ * AirGradient
+ * https://airgradient.com
+ *
+ * CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
+ */
+
+#include "remoteConfig.h"
+#include "agLogger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <ArduinoJson.h>
+
+#define FNV_OFFSET_BASIS 2166136261UL
+#define FNV_PRIME 16777619UL
+
+static const char *const TAG = "RemoteConfig";
+
+// Indexed by RemoteConfig::Field
+static const char *const FIELD_KEYS[RemoteConfig::FIELD_COUNT] = {
+    "country",
+    "pmStandard",
+    "temperatureUnit",
+    "configurationControl",
+    "postDataToAirGradient",
+    "mqttBrokerUrl",
+    "abcDays",
+    "tvocLearningOffset",
+    "noxLearningOffset",
+    "co2CalibrationRequested",
+    "targetFirmware",
+};
+
+static uint32_t fnv1a(uint32_t hash, const void *data, size_t length) {
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ p[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+// Value that does not fit is not stored, out left empty and fit set to false
+static uint32_t readString(JsonVariant value, char *out, size_t size, bool &fit) {
+  const char *str = value.as<const char *>();
+  if (str == nullptr) {
+    str = "";
+  }
+  size_t len = strlen(str);
+  fit = len < size;
+  if (fit) {
+    memcpy(out, str, len + 1);
+  } else {
+    out[0] = '\0';
+  }
+  return fnv1a(FNV_OFFSET_BASIS, str, len);
+}
+
+static uint32_t readInt(JsonVariant value, int &out) {
+  out = value.as<int>();
+  // Little endian regardless of platform
+  uint8_t bytes[4] = {static_cast<uint8_t>(out), static_cast<uint8_t>(out >> 8),
+                      static_cast<uint8_t>(out >> 16), static_cast<uint8_t>(out >> 24)};
+  return fnv1a(FNV_OFFSET_BASIS, bytes, sizeof(bytes));
+}
+
+static uint32_t readBool(JsonVariant value, bool &out) {
+  out = value.as<bool>();
+  uint8_t byte = out ? 1 : 0;
+  return fnv1a(FNV_OFFSET_BASIS, &byte, 1);
+}
+
+uint32_t RemoteConfig::hash() const {
+  uint32_t hash = FNV_OFFSET_BASIS;
+  hash = fnv1a(hash, &present, sizeof(present));
+  for (int i = 0; i < FIELD_COUNT; i++) {
+    hash = fnv1a(hash, &fieldHash[i], sizeof(fieldHash[i]));
+  }
+  return hash;
+}
+
+bool remoteConfigParse(const char *data, size_t length, RemoteConfig &out) {
+  out = RemoteConfig();
+
+  // Filter make the parser skip every other key without storing it
+  JsonDocument filter;
+  for (int i = 0; i < RemoteConfig::FIELD_COUNT; i++) {
+    filter[FIELD_KEYS[i]] = true;
+  }
+  JsonDocument doc;
+  DeserializationError err =
+      deserializeJson(doc, data, length, DeserializationOption::Filter(filter));
+  if (err || !doc.is<JsonObject>()) {
+    return false;
+  }
+
+  for (int i = 0; i < RemoteConfig::FIELD_COUNT; i++) {
+    JsonVariant value = doc[FIELD_KEYS[i]];
+    if (value.isNull()) {
+      continue;
+    }
+
+    uint32_t hash = 0;
+    bool fit = true;
+    switch (i) {
+    case RemoteConfig::FIELD_COUNTRY:
+      hash = readString(value, out.country, sizeof(out.country), fit);
+      break;
+    case RemoteConfig::FIELD_PM_STANDARD:
+      hash = readString(value, out.pmStandard, sizeof(out.pmStandard), fit);
+      break;
+    case RemoteConfig::FIELD_TEMPERATURE_UNIT:
+      hash = readString(value, out.temperatureUnit, sizeof(out.temperatureUnit), fit);
+      break;
+    case RemoteConfig::FIELD_CONFIGURATION_CONTROL:
+      hash = readString(value, out.configurationControl, sizeof(out.configurationControl),
+                        fit);
+      break;
+    case RemoteConfig::FIELD_POST_DATA_TO_AIRGRADIENT:
+      hash = readBool(value, out.postDataToAirGradient);
+      break;
+    case RemoteConfig::FIELD_MQTT_BROKER_URL:
+      hash = readString(value, out.mqttBrokerUrl, sizeof(out.mqttBrokerUrl), fit);
+      break;
+    case RemoteConfig::FIELD_ABC_DAYS:
+      hash = readInt(value, out.abcDays);
+      break;
+    case RemoteConfig::FIELD_TVOC_LEARNING_OFFSET:
+      hash = readInt(value, out.tvocLearningOffset);
+      break;
+    case RemoteConfig::FIELD_NOX_LEARNING_OFFSET:
+      hash = readInt(value, out.noxLearningOffset);
+      break;
+    case RemoteConfig::FIELD_CO2_CALIBRATION_REQUESTED:
+      hash = readBool(value, out.co2CalibrationRequested);
+      break;
+    case RemoteConfig::FIELD_TARGET_FIRMWARE:
+      hash = readString(value, out.targetFirmware, sizeof(out.targetFirmware), fit);
+      break;
+    }
+    if (!fit) {
+      // Truncated value would be acted on as a different one, eg. another broker host
+      AG_LOGW(TAG, "%s value too long, ignored", FIELD_KEYS[i]);
+      continue;
+    }
+    out.present |= (1UL << i);
+    out.fieldHash[i] = hash;
+  }
+
+  return true;
+}
+
+uint32_t remoteConfigDiff(const RemoteConfig &current, const RemoteConfig &previous) {
+  uint32_t diff = current.present ^ previous.present;
+  for (int i = 0; i < RemoteConfig::FIELD_COUNT; i++) {
+    if (current.fieldHash[i] != previous.fieldHash[i]) {
+      diff |= (1UL << i);
+    }
+  }
+  return diff;
+}
@@ -0,0 +1,77 @@
+/**
+ * AirGradient
+ * https://airgradient.com
+ *
+ * CC BY-SA 4.0 Attribution-ShareAlike 4.0 International License
+ */
+
+#ifndef REMOTE_CONFIG_H
+#define REMOTE_CONFIG_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Configuration fields served by AirGradient server that the firmware act on. Other
+ * fields of the body are skipped while parsing and never allocated. String value longer than its
+ * field is ignored, the field is left empty and not present
+ */
+struct RemoteConfig {
+  enum Field {
+    FIELD_COUNTRY = 0,
+    FIELD_PM_STANDARD,
+    FIELD_TEMPERATURE_UNIT,
+    FIELD_CONFIGURATION_CONTROL,
+    FIELD_POST_DATA_TO_AIRGRADIENT,
+    FIELD_MQTT_BROKER_URL,
+    FIELD_ABC_DAYS,
+    FIELD_TVOC_LEARNING_OFFSET,
+    FIELD_NOX_LEARNING_OFFSET,
+    FIELD_CO2_CALIBRATION_REQUESTED,
+    FIELD_TARGET_FIRMWARE,
+    FIELD_COUNT
+  };
+
+  char country[8] = {};
+  char pmStandard[8] = {};           // "ugm3" or "us-aqi"
+  char temperatureUnit[4] = {};      // "c" or "f"
+  char configurationControl[8] = {}; // "local", "cloud" or "both"
+  bool postDataToAirGradient = true;
+  char mqttBrokerUrl[128] = {};
+  int abcDays = -1;
+  int tvocLearningOffset = -1;
+  int noxLearningOffset = -1;
+  bool co2CalibrationRequested = false;
+  char targetFirmware[32] = {};
+
+  // Bit per Field, set if found in the body
+  uint32_t present = 0;
+  // Bit per Field, set if value differ from previous fetch
+  uint32_t changed = 0;
+  // FNV-1a of each received value, independent of key order and whitespace of the body
+  uint32_t fieldHash[FIELD_COUNT] = {};
+
+  bool has(Field field) const { return present & (1UL << field); }
+  bool isChanged(Field field) const { return changed & (1UL << field); }
+
+  /**
+   * @brief Hash over every field, equal for same configuration across fetch and reboot
+   */
+  uint32_t hash() const;
+};
+
+/**
+ * @brief Parse configuration body, only fields of RemoteConfig are kept
+ *
+ * @return false if body is not valid JSON object
+ */
+bool remoteConfigParse(const char *data, size_t length, RemoteConfig &out);
+
+/**
+ * @brief Compare field hashes of two configurations
+ *
+ * @return bit per RemoteConfig::Field that differ
+ */
+uint32_t remoteConfigDiff(const RemoteConfig &current, const RemoteConfig &previous);
+
+#endif // REMOTE_CONFIG_H